@@ -0,0 +1,300 @@
+#include "TimeSeriesAllocator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <unordered_map>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace oscill {
+	namespace io {
+
+		uint8_t *HeapBufferAllocator::Allocate(size_t size, size_t *capacity)
+		{
+			// Zero sized storage still gets a real pointer
+			uint8_t *data = (uint8_t *)calloc(size > 0 ? size : 1, 1);
+			*capacity = data ? size : 0;
+			return data;
+		}
+		void HeapBufferAllocator::Release(uint8_t *data, size_t)
+		{
+			free(data);
+		}
+
+		// Live slab allocators by id.  Thread caches only hold ids, so blocks belonging to an
+		// allocator that has since gone away are just dropped
+		static std::mutex &SlabRegistryMutex()
+		{
+			static std::mutex registry_mutex;
+			return registry_mutex;
+		}
+		static std::unordered_map<uint64_t, SlabBufferAllocator *> &SlabRegistry()
+		{
+			static std::unordered_map<uint64_t, SlabBufferAllocator *> registry;
+			return registry;
+		}
+		static std::atomic<uint64_t> next_slab_allocator_id(1);
+
+		// Free blocks a thread holds on to.  A thread works with one slab allocator at a time,
+		// switching gives the blocks back to the one before
+		struct SlabThreadCache
+		{
+			uint64_t allocator_id = 0;
+			std::vector<uint8_t *> blocks[SlabBufferAllocator::k_class_count];
+
+			~SlabThreadCache() { Flush(); }
+			void Flush()
+			{
+				std::lock_guard<std::mutex> lock(SlabRegistryMutex());
+				auto found = SlabRegistry().find(allocator_id);
+				for (int size_class = 0; size_class < SlabBufferAllocator::k_class_count; size_class++)
+				{
+					if (found != SlabRegistry().end())
+					{
+						found->second->m_ReturnBlocks(size_class, &blocks[size_class], 0);
+					}
+					blocks[size_class].clear();
+				}
+				allocator_id = 0;
+			}
+		};
+		static thread_local SlabThreadCache slab_thread_cache;
+
+		SlabBufferAllocator::SlabBufferAllocator(bool huge_pages) :
+			m_id(next_slab_allocator_id++), m_huge_pages(huge_pages)
+		{
+			std::lock_guard<std::mutex> lock(SlabRegistryMutex());
+			SlabRegistry()[m_id] = this;
+		}
+		SlabBufferAllocator::~SlabBufferAllocator()
+		{
+			{
+				std::lock_guard<std::mutex> lock(SlabRegistryMutex());
+				SlabRegistry().erase(m_id);
+			}
+			if (slab_thread_cache.allocator_id == m_id)
+			{
+				slab_thread_cache.Flush();
+			}
+
+			for (auto &&slab : m_slabs)
+			{
+#if defined(__linux__)
+				munmap(slab, k_slab_size);
+#else
+				free(slab);
+#endif
+			}
+		}
+		int SlabBufferAllocator::m_SizeClass(size_t size)
+		{
+			if (size > k_max_block_size) return -1;
+			int size_class = 0;
+			while ((k_min_block_size << size_class) < size)
+			{
+				size_class++;
+			}
+			return size_class;
+		}
+		uint8_t *SlabBufferAllocator::m_AllocateSlab()
+		{
+#if defined(__linux__)
+			// Fresh anonymous pages are already zeroed.  Huge pages need the slab lined up on
+			// a slab boundary, so map twice as much and trim the ends
+			size_t map_size = m_huge_pages ? 2 * k_slab_size : k_slab_size;
+			void *mapped = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapped == MAP_FAILED) return nullptr;
+			uint8_t *slab = (uint8_t *)mapped;
+			if (m_huge_pages)
+			{
+				uintptr_t address = (uintptr_t)mapped;
+				uintptr_t aligned = (address + k_slab_size - 1) & ~(uintptr_t)(k_slab_size - 1);
+				if (aligned > address) munmap(mapped, aligned - address);
+				if (aligned + k_slab_size < address + map_size) munmap((void *)(aligned + k_slab_size), address + map_size - aligned - k_slab_size);
+				slab = (uint8_t *)aligned;
+#ifdef MADV_HUGEPAGE
+				madvise(slab, k_slab_size, MADV_HUGEPAGE);
+#endif
+			}
+			return slab;
+#else
+			return (uint8_t *)calloc(k_slab_size, 1);
+#endif
+		}
+		void SlabBufferAllocator::m_Refill(int size_class, std::vector<uint8_t *> *blocks)
+		{
+			size_t block_size = k_min_block_size << size_class;
+			size_t batch = std::max((size_t)1, k_thread_cache_bytes / block_size / 2);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::vector<uint8_t *> &free_blocks = m_free[size_class];
+			if (free_blocks.empty())
+			{
+				uint8_t *slab = m_AllocateSlab();
+				if (!slab) return;
+				m_slabs.push_back(slab);
+				for (size_t offset = 0; offset + block_size <= k_slab_size; offset += block_size)
+				{
+					free_blocks.push_back(slab + offset);
+				}
+			}
+
+			size_t take = std::min(batch, free_blocks.size());
+			blocks->insert(blocks->end(), free_blocks.end() - take, free_blocks.end());
+			free_blocks.resize(free_blocks.size() - take);
+		}
+		void SlabBufferAllocator::m_ReturnBlocks(int size_class, std::vector<uint8_t *> *blocks, size_t keep)
+		{
+			if (blocks->size() <= keep) return;
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free[size_class].insert(m_free[size_class].end(), blocks->begin() + keep, blocks->end());
+			blocks->resize(keep);
+		}
+		uint8_t *SlabBufferAllocator::Allocate(size_t size, size_t *capacity)
+		{
+			int size_class = m_SizeClass(size);
+			if (size_class < 0)
+			{
+				uint8_t *data = (uint8_t *)calloc(size, 1);
+				*capacity = data ? size : 0;
+				return data;
+			}
+
+			if (slab_thread_cache.allocator_id != m_id)
+			{
+				slab_thread_cache.Flush();
+				slab_thread_cache.allocator_id = m_id;
+			}
+			std::vector<uint8_t *> &blocks = slab_thread_cache.blocks[size_class];
+			if (blocks.empty())
+			{
+				m_Refill(size_class, &blocks);
+				if (blocks.empty())
+				{
+					*capacity = 0;
+					return nullptr;
+				}
+			}
+
+			// Blocks that have been used before may have anything in them
+			uint8_t *data = blocks.back();
+			blocks.pop_back();
+			memset(data, 0, size);
+			*capacity = k_min_block_size << size_class;
+			return data;
+		}
+		void SlabBufferAllocator::Release(uint8_t *data, size_t capacity)
+		{
+			int size_class = m_SizeClass(capacity);
+			if (size_class < 0)
+			{
+				free(data);
+				return;
+			}
+
+			if (slab_thread_cache.allocator_id != m_id)
+			{
+				slab_thread_cache.Flush();
+				slab_thread_cache.allocator_id = m_id;
+			}
+			std::vector<uint8_t *> &blocks = slab_thread_cache.blocks[size_class];
+			blocks.push_back(data);
+
+			// Keep half of the limit so the next few allocations don't need the lock
+			size_t block_size = k_min_block_size << size_class;
+			size_t limit = std::max((size_t)1, k_thread_cache_bytes / block_size);
+			if (blocks.size() > limit)
+			{
+				m_ReturnBlocks(size_class, &blocks, limit / 2);
+			}
+		}
+		size_t SlabBufferAllocator::SlabCount()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_slabs.size();
+		}
+
+		static HeapBufferAllocator heap_buffer_allocator;
+		static std::atomic<BufferAllocator *> default_buffer_allocator(&heap_buffer_allocator);
+
+		BufferAllocator &DefaultBufferAllocator()
+		{
+			return *default_buffer_allocator.load();
+		}
+		void SetDefaultBufferAllocator(BufferAllocator *allocator)
+		{
+			default_buffer_allocator.store(allocator ? allocator : &heap_buffer_allocator);
+		}
+
+		bool BufferStorage::AssignZeroed(size_t size)
+		{
+			if (m_data && size <= m_capacity)
+			{
+				memset(m_data, 0, size);
+				m_size = size;
+				return true;
+			}
+
+			Release();
+			BufferAllocator &allocator = DefaultBufferAllocator();
+			size_t capacity = 0;
+			uint8_t *data = allocator.Allocate(size, &capacity);
+			if (!data) return false;
+			m_allocator = &allocator;
+			m_data = data;
+			m_size = size;
+			m_capacity = capacity;
+			return true;
+		}
+		void BufferStorage::ShrinkTo(size_t size)
+		{
+			if (!m_data || size > m_size) return;
+			m_size = size;
+
+			// Storage kept by AssignZeroed can be a lot bigger than what is in it
+			if (!m_allocator || size >= m_capacity) return;
+
+			size_t capacity = 0;
+			uint8_t *data = m_allocator->Allocate(size, &capacity);
+			if (!data) return;
+			if (capacity >= m_capacity)
+			{
+				// Nothing to be gained
+				m_allocator->Release(data, capacity);
+				return;
+			}
+			memcpy(data, m_data, size);
+			m_allocator->Release(m_data, m_capacity);
+			m_data = data;
+			m_capacity = capacity;
+		}
+		void BufferStorage::AssignView(uint8_t *data, size_t size)
+		{
+			Release();
+			m_data = data;
+			m_size = size;
+		}
+		void BufferStorage::Swap(BufferStorage &other)
+		{
+			std::swap(m_allocator, other.m_allocator);
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+			std::swap(m_capacity, other.m_capacity);
+		}
+		void BufferStorage::Release()
+		{
+			if (m_data && m_allocator)
+			{
+				m_allocator->Release(m_data, m_capacity);
+			}
+			m_allocator = nullptr;
+			m_data = nullptr;
+			m_size = 0;
+			m_capacity = 0;
+		}
+	}
+}
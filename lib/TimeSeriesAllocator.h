@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		// Where buffers get their storage from.  Storage always comes back zeroed, since the
+		// bit writers add into it
+		class BufferAllocator
+		{
+		public:
+			virtual ~BufferAllocator() {}
+			// At least size zeroed bytes, capacity gets how many there really are.  Returns
+			// nullptr if there is no memory
+			virtual uint8_t *Allocate(size_t size, size_t *capacity) = 0;
+			// Give back storage from Allocate along with the capacity it came with
+			virtual void Release(uint8_t *data, size_t capacity) = 0;
+		};
+
+		// Plain heap allocations, the default
+		class HeapBufferAllocator : public BufferAllocator
+		{
+		public:
+			virtual uint8_t *Allocate(size_t size, size_t *capacity);
+			virtual void Release(uint8_t *data, size_t capacity);
+		};
+
+		// Storage carved out of large slabs in power of two size classes.  Released storage
+		// goes onto a free list for the calling thread, and moves to a shared list when that
+		// gets too long, so buffers being created and retired all the time don't go back to
+		// the heap.  Slabs are only given back when the allocator is destroyed, which must
+		// not happen while storage from it is still in use.  Anything bigger than the
+		// largest class goes straight to the heap
+		class SlabBufferAllocator : public BufferAllocator
+		{
+		public:
+			static constexpr size_t k_min_block_size = 64;
+			static constexpr int k_class_count = 15;
+			static constexpr size_t k_max_block_size = k_min_block_size << (k_class_count - 1);
+			static constexpr size_t k_slab_size = 2 * 1024 * 1024;
+			// Most bytes of each class a thread keeps to itself
+			static constexpr size_t k_thread_cache_bytes = 4 * 1024 * 1024;
+
+			// huge_pages asks for the slabs to be backed by huge pages where the system
+			// supports it, cutting down on TLB misses with a lot of buffers in use
+			SlabBufferAllocator(bool huge_pages = false);
+			virtual ~SlabBufferAllocator();
+			virtual uint8_t *Allocate(size_t size, size_t *capacity);
+			virtual void Release(uint8_t *data, size_t capacity);
+
+			// Number of slabs taken from the system so far
+			size_t SlabCount();
+
+		private:
+			SlabBufferAllocator(const SlabBufferAllocator &) = delete;
+			SlabBufferAllocator &operator = (const SlabBufferAllocator &) = delete;
+
+			static int m_SizeClass(size_t size);
+			uint8_t *m_AllocateSlab();
+			// Move a batch of free blocks of the class into blocks, carving a new slab if there
+			// aren't any
+			void m_Refill(int size_class, std::vector<uint8_t *> *blocks);
+			void m_ReturnBlocks(int size_class, std::vector<uint8_t *> *blocks, size_t keep);
+
+			uint64_t m_id;
+			bool m_huge_pages;
+			std::mutex m_mutex;
+			std::vector<uint8_t *> m_slabs;
+			std::vector<uint8_t *> m_free[k_class_count];
+			friend struct SlabThreadCache;
+		};
+
+		// Allocator used for the storage of every buffer created from now on
+		BufferAllocator &DefaultBufferAllocator();
+		// Swap the default allocator, nullptr goes back to the heap.  Buffers keep the
+		// allocator they were created with
+		void SetDefaultBufferAllocator(BufferAllocator *allocator);
+
+		// Zeroed bytes from a BufferAllocator, given back when done with
+		class BufferStorage
+		{
+		public:
+			BufferStorage() {}
+			~BufferStorage() { Release(); }
+			uint8_t *Data() { return m_data; }
+			size_t Size() const { return m_size; }
+			uint8_t &operator[](size_t index) { return m_data[index]; }
+
+			// Throw away the contents and make it size zeroed bytes from the default allocator.
+			// Keeps the current storage if it is big enough.  Returns false if there is no memory
+			bool AssignZeroed(size_t size);
+			// Cut the contents down to size bytes, moving them to smaller storage if that
+			// gives anything back, even when they were already that size
+			void ShrinkTo(size_t size);
+			// Point at memory owned by someone else rather than owning any.  It is never
+			// written to or freed from here, the owner has to keep it alive
+			void AssignView(uint8_t *data, size_t size);
+			// Trade contents with other, along with the allocators they came from
+			void Swap(BufferStorage &other);
+			void Release();
+
+		private:
+			BufferStorage(const BufferStorage &) = delete;
+			BufferStorage &operator = (const BufferStorage &) = delete;
+
+			BufferAllocator *m_allocator = nullptr;
+			uint8_t *m_data = nullptr;
+			size_t m_size = 0;
+			size_t m_capacity = 0;
+		};
+	}
+}
@@ -0,0 +1,123 @@
+#include "TimeSeriesCache.h"
+#include <iterator>
+
+namespace oscill {
+	namespace io {
+
+		DecodedChunkCache::DecodedChunkCache(size_t byte_budget, size_t num_shards) :
+			m_hits(0), m_misses(0), m_insertions(0), m_evictions(0), m_bytes(0)
+		{
+			if (num_shards == 0) num_shards = 1;
+			m_shard_budget = byte_budget / num_shards;
+			for (size_t i = 0; i < num_shards; i++)
+			{
+				m_shards.push_back(std::unique_ptr<CacheShard>(new CacheShard()));
+			}
+		}
+		DecodedChunkCache::CacheShard &DecodedChunkCache::mShard(uint64_t chunk_id)
+		{
+			uint64_t mixed = chunk_id * 0x9E3779B97F4A7C15ull;
+			return *m_shards[(mixed >> 32) % m_shards.size()];
+		}
+		void DecodedChunkCache::mRemove(CacheShard &shard, entry_list_t::iterator entry)
+		{
+			m_bytes -= entry->bytes;
+			shard.index.erase(entry->chunk_id);
+			if (entry->is_protected)
+			{
+				shard.protected_bytes -= entry->bytes;
+				shard.protected_entries.erase(entry);
+			}
+			else
+			{
+				shard.probation_bytes -= entry->bytes;
+				shard.probation.erase(entry);
+			}
+		}
+		void DecodedChunkCache::mTrim(CacheShard &shard)
+		{
+			// Protected chunks past their share go back on probation, most recently used first
+			size_t protected_budget = m_shard_budget / 100 * k_protected_percent;
+			while (shard.protected_bytes > protected_budget)
+			{
+				auto demoted = std::prev(shard.protected_entries.end());
+				demoted->is_protected = false;
+				shard.protected_bytes -= demoted->bytes;
+				shard.probation_bytes += demoted->bytes;
+				shard.probation.splice(shard.probation.begin(), shard.protected_entries, demoted);
+			}
+
+			// Then evict from the cold end of probation
+			while (shard.probation_bytes + shard.protected_bytes > m_shard_budget)
+			{
+				entry_list_t &from = shard.probation.empty() ? shard.protected_entries : shard.probation;
+				mRemove(shard, std::prev(from.end()));
+				m_evictions++;
+			}
+		}
+		std::shared_ptr<const DecodedChunk> DecodedChunkCache::Find(uint64_t chunk_id)
+		{
+			CacheShard &shard = mShard(chunk_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.index.find(chunk_id);
+			if (found == shard.index.end())
+			{
+				m_misses++;
+				return nullptr;
+			}
+			m_hits++;
+
+			// Used again, so it is protected now
+			auto entry = found->second;
+			if (entry->is_protected)
+			{
+				shard.protected_entries.splice(shard.protected_entries.begin(), shard.protected_entries, entry);
+			}
+			else
+			{
+				entry->is_protected = true;
+				shard.probation_bytes -= entry->bytes;
+				shard.protected_bytes += entry->bytes;
+				shard.protected_entries.splice(shard.protected_entries.begin(), shard.probation, entry);
+				mTrim(shard);
+			}
+			return entry->chunk;
+		}
+		void DecodedChunkCache::Insert(uint64_t chunk_id, std::shared_ptr<const DecodedChunk> chunk)
+		{
+			if (!chunk) return;
+			size_t bytes = chunk->Bytes();
+			if (bytes > m_shard_budget) return;
+
+			CacheShard &shard = mShard(chunk_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.index.find(chunk_id);
+			if (found != shard.index.end())
+			{
+				// Someone else decoded it at the same time
+				return;
+			}
+
+			shard.probation.push_front({ chunk_id, std::move(chunk), bytes, false });
+			shard.index[chunk_id] = shard.probation.begin();
+			shard.probation_bytes += bytes;
+			m_bytes += bytes;
+			m_insertions++;
+			mTrim(shard);
+		}
+		void DecodedChunkCache::Erase(uint64_t chunk_id)
+		{
+			CacheShard &shard = mShard(chunk_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.index.find(chunk_id);
+			if (found != shard.index.end())
+			{
+				mRemove(shard, found->second);
+			}
+		}
+		DecodedChunkCache::Counters DecodedChunkCache::GetCounters()
+		{
+			return { m_hits.load(), m_misses.load(), m_insertions.load(), m_evictions.load(), m_bytes.load() };
+		}
+	}
+}
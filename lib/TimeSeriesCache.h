@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		// Samples of a whole chunk, already decoded
+		struct DecodedChunk
+		{
+			std::vector<uint64_t> times;
+			std::vector<double> values;
+
+			size_t Bytes() const { return sizeof(DecodedChunk) + times.capacity() * sizeof(uint64_t) + values.capacity() * sizeof(double); }
+		};
+
+		// Decoded chunks by chunk id, kept within a byte budget.  Segmented LRU: a chunk starts
+		// out on probation and is only protected once it is used again, so one large scan
+		// can't push out the chunks that are used all the time.  Split into shards with a
+		// lock and an equal part of the budget each
+		class DecodedChunkCache
+		{
+		public:
+			struct Counters
+			{
+				uint64_t hits;
+				uint64_t misses;
+				uint64_t insertions;
+				uint64_t evictions;
+				size_t bytes;
+			};
+
+			// Share of each shard's budget the protected segment can use
+			static constexpr int k_protected_percent = 80;
+
+			DecodedChunkCache(size_t byte_budget, size_t num_shards = 16);
+			virtual ~DecodedChunkCache() {}
+
+			// The chunk, or null if it isn't cached.  Either way it counts as a hit or a miss
+			std::shared_ptr<const DecodedChunk> Find(uint64_t chunk_id);
+			// Chunks bigger than a shard's budget aren't kept
+			void Insert(uint64_t chunk_id, std::shared_ptr<const DecodedChunk> chunk);
+			// Drop a chunk that no longer exists
+			void Erase(uint64_t chunk_id);
+			Counters GetCounters();
+
+		protected:
+			struct CacheEntry
+			{
+				uint64_t chunk_id;
+				std::shared_ptr<const DecodedChunk> chunk;
+				size_t bytes;
+				bool is_protected;
+			};
+			typedef std::list<CacheEntry> entry_list_t;
+			struct CacheShard
+			{
+				std::mutex mutex;
+				entry_list_t probation;
+				entry_list_t protected_entries;
+				std::unordered_map<uint64_t, entry_list_t::iterator> index;
+				size_t probation_bytes = 0;
+				size_t protected_bytes = 0;
+			};
+
+			CacheShard &mShard(uint64_t chunk_id);
+			// These expect the shard lock to be held
+			void mRemove(CacheShard &shard, entry_list_t::iterator entry);
+			void mTrim(CacheShard &shard);
+
+			size_t m_shard_budget;
+			std::vector<std::unique_ptr<CacheShard>> m_shards;
+
+			std::atomic<uint64_t> m_hits;
+			std::atomic<uint64_t> m_misses;
+			std::atomic<uint64_t> m_insertions;
+			std::atomic<uint64_t> m_evictions;
+			std::atomic<size_t> m_bytes;
+
+		private:
+			DecodedChunkCache(const DecodedChunkCache &) = delete;
+			DecodedChunkCache &operator = (const DecodedChunkCache &) = delete;
+		};
+	}
+}
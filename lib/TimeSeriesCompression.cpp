@@ -1,6 +1,8 @@
 #include "TimeSeriesCompression.h"
+#include "TimeSeriesKernels.h"
 #include <assert.h>
 #include <math.h>
+#include <algorithm>
 
 // TODO - Get Git to update the minor version on checkin
 #define OSCILLIO_TIME_COMPRESS_MAJOR_VERISON 0
@@ -23,6 +25,98 @@ namespace oscill {
         	{0x7FFFFFFF, 32, 30, 5}
 		};
 		
+		// Number of leading ones in every possible top byte, capped at 5.  This resolves
+		// the 0/10/110/1110/11110/11111 timestamp control code with a single lookup
+		static const struct TimestampPrefixTable
+		{
+			uint8_t num_ones[256];
+			TimestampPrefixTable()
+			{
+				for (int byte = 0; byte < 256; byte++)
+				{
+					int ones = 0;
+					while (ones < 5 && (byte & (0x80 >> ones)))
+					{
+						ones++;
+					}
+					num_ones[byte] = (uint8_t)ones;
+				}
+			}
+		} timestamp_prefix_table;
+
+		// A decoded timestamp control code.  num_ones is the length of the prefix, with 0 meaning
+		// no change in delta and 5 meaning a full timestamp follows.  For everything in between
+		// the sign and magnitude of the delta of delta are filled in
+		struct TimestampCode
+		{
+			int num_ones;
+			bool sign;
+			uint64_t magnitude;
+		};
+
+		// Read the control code, sign and magnitude of the next timestamp.  Peeks 16 bits, which
+		// covers everything but the 32-bit and full timestamp cases, and consumes them in one go
+		static bool ReadTimestampCode(ReadByteBuffer &buffer, TimestampCode *code)
+		{
+			uint64_t bit_value = 0;
+			code->sign = false;
+			code->magnitude = 0;
+
+			if (buffer.BitsAvailable() >= 16)
+			{
+				uint64_t window = 0;
+				if (!buffer.PeekBits(&window, 16)) return false;
+				code->num_ones = timestamp_prefix_table.num_ones[window >> 8];
+
+				if (code->num_ones == 0)
+				{
+					return buffer.SkipBits(1);
+				}
+				if (code->num_ones == 5)
+				{
+					return buffer.SkipBits(5);
+				}
+
+				int index = code->num_ones - 1;
+				if (index < 3)
+				{
+					// Prefix, sign and magnitude all fit in the window
+					int pattern_size = timestamp_encoding_info[index].pattern_size;
+					int magnitude_size = timestamp_encoding_info[index].delta_size - 1;
+					int code_size = pattern_size + 1 + magnitude_size;
+					code->sign = ((window >> (16 - pattern_size - 1)) & 1) != 0;
+					code->magnitude = (window >> (16 - code_size)) & (((uint64_t)1 << magnitude_size) - 1);
+					return buffer.SkipBits(code_size);
+				}
+
+				// 32-bit delta of delta, too long for the window
+				if (!buffer.SkipBits(timestamp_encoding_info[index].pattern_size)) return false;
+			}
+			else
+			{
+				// Close to the end of the buffer, take it one bit at a time
+				code->num_ones = 0;
+				if (!buffer.ReadNextBits(&bit_value, 1)) return false;
+				if (bit_value == 0) return true;
+
+				code->num_ones = 1;
+				while (code->num_ones < 5) {
+					if (!buffer.ReadNextBits(&bit_value, 1)) return false;
+					if (bit_value == 0) {
+						break;
+					}
+					code->num_ones++;
+				}
+				if (code->num_ones == 5) return true;
+			}
+
+			int index = code->num_ones - 1;
+			if (!buffer.ReadNextBits(&bit_value, 1)) return false;
+			code->sign = (bit_value == 1);
+			if (!buffer.ReadNextBits(&code->magnitude, timestamp_encoding_info[index].delta_size - 1)) return false;
+			return true;
+		}
+
 		// Helper Function to determine max bit size of value
 		int NumberOfBits(int64_t max, int64_t min)
 		{
@@ -39,6 +133,438 @@ namespace oscill {
 			return num_bits;
 		}
 
+		// Convert a nanosecond timestamp to the given time precision, rounding to the closest value
+		static uint64_t TimestampToPrecision(uint64_t timestamp, int time_precision_nanoseconds_pow, uint64_t time_precision_divisor)
+		{
+			uint64_t timestamp_to_precision = 0;
+			timestamp_to_precision = timestamp / time_precision_divisor;
+
+			// Do our own rounding.  Rounding messes up at bounds of an uint64_t.  We also want to ensure that 
+			// we are round up to the nearest second instead of truncating.  If we care about time stamp precision to 
+			// the second, 1.999 is most likey 2 seconds with some jitter than it is 1 seconds with a lot of jitter.  In 
+			// the future we could make this tolerance configurable.
+			if (time_precision_nanoseconds_pow != 0)
+			{
+				uint64_t timestamp_to_more_precision = timestamp / (uint64_t)pow(10, time_precision_nanoseconds_pow - 1);
+				if (timestamp_to_precision != 0)
+				{
+					uint64_t time_fraction = timestamp_to_more_precision % timestamp_to_precision;
+					if (time_fraction >= 5)
+					{
+						timestamp_to_precision++;
+					}
+				}
+				else
+				{
+					if (timestamp_to_more_precision >= 5)
+					{
+						timestamp_to_precision++;
+					}
+				}
+			}
+			return timestamp_to_precision;
+		}
+
+		// Store doubles in the header by their bit pattern so negative and fractional
+		// values survive the round trip
+		static uint64_t DoubleToBits(double value)
+		{
+			uint64_t bits = 0;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+		static double BitsToDouble(uint64_t bits)
+		{
+			double value = 0;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		// Number of idle samples in a row it takes before a run token is no bigger than them
+		static uint32_t RunLengthThreshold(int idle_record_size)
+		{
+			uint32_t threshold = (RunLengthMetrics::k_token_size + RunLengthMetrics::k_length_size + idle_record_size - 1) / idle_record_size;
+			return std::max(threshold, (uint32_t)2);
+		}
+
+		// Write out a sample whose delta of delta is zero and whose values didn't change.  The
+		// first few in a row are written out as is.  Once there are enough of them they are
+		// swapped for a run token, which later idle samples extend in place
+		static bool WriteIdleSample(WriteByteBuffer &buffer, RunLengthMetrics &run, int idle_record_size)
+		{
+			if (run.length != 0 && run.length < RunLengthMetrics::k_max_length)
+			{
+				run.length++;
+				return buffer.WriteBitsAt(run.length_bit_offset, run.length, RunLengthMetrics::k_length_size);
+			}
+
+			// Make sure the sample fits before touching anything.  Since the token is never bigger
+			// than the samples it replaces, this also covers swapping them for a token
+			if (buffer.BitsAvailable() < idle_record_size) return false;
+
+			// A full token can't be extended any more, start counting again
+			run.length = 0;
+			if (run.idle_count == 0)
+			{
+				run.idle_start = buffer.BitPosition();
+			}
+			run.idle_count++;
+
+			if (run.idle_count < run.threshold)
+			{
+				// Zero delta of delta followed by a zero for every unchanged value
+				for (int bits_left = idle_record_size; bits_left > 0; bits_left -= 32)
+				{
+					if (!buffer.WriteBits(0, std::min(bits_left, 32))) return false;
+				}
+				return true;
+			}
+
+			buffer.RewindTo(run.idle_start);
+			if (!buffer.WriteBits(RunLengthMetrics::k_token_pattern, RunLengthMetrics::k_token_pattern_size)) return false;
+			if (!buffer.WriteBits(0, RunLengthMetrics::k_token_size - RunLengthMetrics::k_token_pattern_size)) return false;
+			run.length_bit_offset = buffer.BitPosition();
+			if (!buffer.WriteBits(run.idle_count, RunLengthMetrics::k_length_size)) return false;
+			run.length = run.idle_count;
+			run.idle_count = 0;
+			return true;
+		}
+
+		// Bits WriteIdleSample would add ( or take away, when samples are swapped for a token )
+		// for one more idle sample, without writing anything
+		static int64_t CountIdleSample(RunLengthMetrics &run, int idle_record_size)
+		{
+			if (run.length != 0 && run.length < RunLengthMetrics::k_max_length)
+			{
+				run.length++;
+				return 0;
+			}
+
+			run.length = 0;
+			run.idle_count++;
+			if (run.idle_count < run.threshold)
+			{
+				return idle_record_size;
+			}
+
+			int64_t replaced_bits = (int64_t)(run.idle_count - 1) * idle_record_size;
+			run.length = run.idle_count;
+			run.idle_count = 0;
+			return RunLengthMetrics::k_token_size + RunLengthMetrics::k_length_size - replaced_bits;
+		}
+
+		// Put together the control code, sign and magnitude for a non zero delta of delta.
+		// Returns false if it needs a full timestamp instead.  width_class, if given, gets the
+		// index of the width used
+		static bool EncodeDeltaOfDelta(int64_t delta_of_delta, uint64_t *field, int *num_bits, int *width_class = nullptr)
+		{
+			// Zero is written as a single 0 bit, so shift by 1 to fit the rest better
+			delta_of_delta--;
+			int64_t abs_delta_of_delta = std::abs(delta_of_delta);
+			uint64_t sign = (delta_of_delta < 1) ? 1 : 0;
+
+			for (int i = 0; i < 4; i++)
+			{
+				if (abs_delta_of_delta <= timestamp_encoding_info[i].max_delta)
+				{
+					int delta_size = timestamp_encoding_info[i].delta_size;
+					*field = ((uint64_t)timestamp_encoding_info[i].pattern << delta_size) | (sign << (delta_size - 1)) | (uint64_t)abs_delta_of_delta;
+					*num_bits = timestamp_encoding_info[i].pattern_size + delta_size;
+					if (width_class) *width_class = i;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Time field of a point in the plain layout: a single 0 bit if the delta didn't change,
+		// the control code, sign and delta of delta together, or the full timestamp marker.
+		// The full timestamp itself follows the marker.  delta gets the previous delta for the
+		// next point
+		static void EncodePlainTime(uint64_t timestamp, uint64_t previous_timestamp, uint64_t previous_delta, bool first, uint64_t *field, int *num_bits, bool *full_timestamp, uint64_t *delta)
+		{
+			int64_t point_delta = (int64_t)(timestamp - previous_timestamp);
+			int64_t delta_of_delta = point_delta - (int64_t)previous_delta;
+			*delta = (uint64_t)point_delta;
+			*full_timestamp = first;
+			if (!first)
+			{
+				if (delta_of_delta == 0)
+				{
+					*field = 0;
+					*num_bits = 1;
+					return;
+				}
+				if (EncodeDeltaOfDelta(delta_of_delta, field, num_bits)) return;
+				*full_timestamp = true;
+			}
+			*field = SingleTimeSeries::k_full_timestamp;
+			*num_bits = 5;
+			*delta = SingleTimeSeries::k_default_delta;
+		}
+
+		// Symbols of the entropy coded second stage.  Each point is one symbol, its timestamp
+		// class times two plus 1 if the value changed.  The classes are no change in delta,
+		// each delta of delta from -8 to 8 on its own, the four usual widths ( followed by the
+		// sign and magnitude ) and a full timestamp
+		static const int k_entropy_small_delta = 8;
+		static const int k_entropy_width_class = 1 + 2 * k_entropy_small_delta;
+		static const int k_entropy_full_class = k_entropy_width_class + 4;
+		static const int k_entropy_symbol_count = (k_entropy_full_class + 1) * 2;
+
+		static int LeadingZeros(uint64_t value)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return value == 0 ? 64 : __builtin_clzll(value);
+#else
+			int zeros = 0;
+			while (zeros < 64 && !(value & ((uint64_t)1 << (63 - zeros)))) zeros++;
+			return zeros;
+#endif
+		}
+		static int TrailingZeros(uint64_t value)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return value == 0 ? 64 : __builtin_ctzll(value);
+#else
+			int zeros = 0;
+			while (zeros < 64 && !(value & ((uint64_t)1 << zeros))) zeros++;
+			return zeros;
+#endif
+		}
+
+		// Widths of the first three delta codec classes, the last one is the full bit size
+		static const int value_delta_widths[3] = { 6, 12, 20 };
+		static int ValueDeltaWidth(int delta_class, int bit_size)
+		{
+			return (delta_class < 3) ? value_delta_widths[delta_class] : std::min(bit_size + 1, 64);
+		}
+
+		// Widths of the counter codec's delta of delta classes, 10, 110 and 1110.  1111 is a reset
+		static const int value_counter_widths[2] = { 6, 14 };
+		static int ValueCounterWidth(int counter_class, int bit_size)
+		{
+			return (counter_class < 2) ? value_counter_widths[counter_class] : std::min(bit_size + 1, 64);
+		}
+
+		// A changed value as written by a value codec.  The control bits start with the 1
+		// marking the change
+		struct ValueField
+		{
+			uint64_t control;
+			int control_bits;
+			uint64_t payload;
+			int payload_bits;
+		};
+		static void EncodeChangedValue(ValueCodec codec, ValueCodecState &state, ValueDictionary &dictionary, uint64_t last_value, uint64_t value, int bit_size, ValueField *field)
+		{
+			switch (codec)
+			{
+			case k_value_dictionary:
+			{
+				// 1 and the index.  New values get the next free entry, or the escape index
+				// followed by the value once there are none left
+				int index_bits = NumberOfBits(dictionary.capacity, 0);
+				uint32_t index = 0;
+				while (index < state.dictionary_size && dictionary.entries[index] != value)
+				{
+					index++;
+				}
+				if (index == state.dictionary_size && index < dictionary.capacity)
+				{
+					dictionary.entries.resize(index);
+					dictionary.entries.push_back(value);
+					state.dictionary_size++;
+				}
+
+				field->control = ((uint64_t)1 << index_bits) | index;
+				field->control_bits = 1 + index_bits;
+				bool escaped = (index == dictionary.capacity);
+				field->payload = escaped ? value : 0;
+				field->payload_bits = escaped ? bit_size : 0;
+				return;
+			}
+			case k_value_delta:
+			{
+				// 1, a 2 bit width class and the zig-zagged difference
+				int64_t delta = (int64_t)(value - last_value);
+				uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+				int delta_class = 0;
+				while (delta_class < 3 && (zigzag >> value_delta_widths[delta_class]) != 0)
+				{
+					delta_class++;
+				}
+				field->control = 0x4 | (uint64_t)delta_class;
+				field->control_bits = 3;
+				field->payload = zigzag;
+				field->payload_bits = ValueDeltaWidth(delta_class, bit_size);
+				return;
+			}
+			case k_value_counter:
+			{
+				// A counter that went down was reset, store where it restarted from
+				if (value < last_value)
+				{
+					field->control = 0x1F;
+					field->control_bits = 5;
+					field->payload = value;
+					field->payload_bits = bit_size;
+					state.counter_delta = 0;
+					return;
+				}
+
+				int64_t delta = (int64_t)(value - last_value);
+				int64_t delta_of_delta = delta - state.counter_delta;
+				state.counter_delta = delta;
+
+				// 10 when the counter moved as much as last time
+				if (delta_of_delta == 0)
+				{
+					field->control = 0x2;
+					field->control_bits = 2;
+					field->payload = 0;
+					field->payload_bits = 0;
+					return;
+				}
+
+				uint64_t zigzag = ((uint64_t)delta_of_delta << 1) ^ (uint64_t)(delta_of_delta >> 63);
+				int counter_class = 0;
+				while (counter_class < 2 && (zigzag >> value_counter_widths[counter_class]) != 0)
+				{
+					counter_class++;
+				}
+				// 1 for the change, then 10, 110 or 1110
+				field->control_bits = counter_class + 3;
+				field->control = (((uint64_t)1 << (counter_class + 3)) - 1) & ~(uint64_t)1;
+				field->payload = zigzag;
+				field->payload_bits = ValueCounterWidth(counter_class, bit_size);
+				return;
+			}
+			case k_value_xor:
+			{
+				uint64_t xored = value ^ last_value;
+				int leading = LeadingZeros(xored) - (64 - bit_size);
+				int trailing = TrailingZeros(xored);
+
+				// Only the first value can be the same as the last, store a single zero bit
+				if (xored == 0)
+				{
+					leading = bit_size - 1;
+					trailing = 0;
+				}
+
+				// 10 reuses the last window if the meaningful bits fit in it
+				if (state.xor_leading >= 0 && leading >= state.xor_leading && trailing >= bit_size - state.xor_leading - state.xor_meaningful)
+				{
+					field->control = 0x2;
+					field->control_bits = 2;
+					field->payload = xored >> (bit_size - state.xor_leading - state.xor_meaningful);
+					field->payload_bits = state.xor_meaningful;
+					return;
+				}
+
+				// 11, 6 bits of leading zeros and 6 bits of meaningful length less one
+				int meaningful = bit_size - leading - trailing;
+				field->control = ((uint64_t)0x3 << 12) | ((uint64_t)leading << 6) | (uint64_t)(meaningful - 1);
+				field->control_bits = 14;
+				field->payload = xored >> trailing;
+				field->payload_bits = meaningful;
+				state.xor_leading = leading;
+				state.xor_meaningful = meaningful;
+				return;
+			}
+			default:
+				field->control = 1;
+				field->control_bits = 1;
+				field->payload = value;
+				field->payload_bits = bit_size;
+				return;
+			}
+		}
+		// Read a changed value back, the 1 marking the change has already been read
+		static bool ReadChangedValue(ReadByteBuffer &buffer, ValueCodec codec, ValueCodecState &state, const ValueDictionary &dictionary, uint64_t last_value, int bit_size, uint64_t *value)
+		{
+			uint64_t bits_read = 0;
+			switch (codec)
+			{
+			case k_value_dictionary:
+			{
+				if (!buffer.ReadNextBits(&bits_read, NumberOfBits(dictionary.capacity, 0))) return false;
+				if (bits_read == dictionary.capacity) return buffer.ReadNextBits(value, bit_size);
+				if (bits_read >= dictionary.entries.size()) return false;
+				*value = dictionary.entries[bits_read];
+				return true;
+			}
+			case k_value_delta:
+			{
+				if (!buffer.ReadNextBits(&bits_read, 2)) return false;
+				uint64_t zigzag = 0;
+				if (!buffer.ReadNextBits(&zigzag, ValueDeltaWidth((int)bits_read, bit_size))) return false;
+				int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+				*value = last_value + (uint64_t)delta;
+				return true;
+			}
+			case k_value_counter:
+			{
+				// Count the ones after the change bit, up to four
+				int num_ones = 0;
+				while (num_ones < 4)
+				{
+					if (!buffer.ReadNextBits(&bits_read, 1)) return false;
+					if (bits_read == 0) break;
+					num_ones++;
+				}
+
+				if (num_ones == 4)
+				{
+					state.counter_delta = 0;
+					return buffer.ReadNextBits(value, bit_size);
+				}
+				if (num_ones > 0)
+				{
+					uint64_t zigzag = 0;
+					if (!buffer.ReadNextBits(&zigzag, ValueCounterWidth(num_ones - 1, bit_size))) return false;
+					state.counter_delta += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+				}
+				*value = last_value + (uint64_t)state.counter_delta;
+				return true;
+			}
+			case k_value_xor:
+			{
+				if (!buffer.ReadNextBits(&bits_read, 1)) return false;
+				if (bits_read == 1)
+				{
+					if (!buffer.ReadNextBits(&bits_read, 6)) return false;
+					state.xor_leading = (int)bits_read;
+					if (!buffer.ReadNextBits(&bits_read, 6)) return false;
+					state.xor_meaningful = (int)bits_read + 1;
+				}
+				else if (state.xor_leading < 0)
+				{
+					return false;
+				}
+				if (!buffer.ReadNextBits(&bits_read, state.xor_meaningful)) return false;
+				*value = last_value ^ (bits_read << (bit_size - state.xor_leading - state.xor_meaningful));
+				return true;
+			}
+			default:
+				return buffer.ReadNextBits(value, bit_size);
+			}
+		}
+
+		static ValueMetrics MakeValueMetrics(const ValueTypeDefinition &definition, int id)
+		{
+			ValueMetrics metrics;
+			metrics.definition = definition;
+			metrics.first_value = true;
+			metrics.m_last_value = 0;
+			metrics.id = id;
+			metrics.precise_max = (int64_t)((metrics.definition.max)* pow(10, metrics.definition.precision_decimal_places));
+			metrics.precise_min = (int64_t)((metrics.definition.min)* pow(10, metrics.definition.precision_decimal_places));
+			metrics.m_bit_size = NumberOfBits(metrics.precise_max, metrics.precise_min);
+			return metrics;
+		}
+
 		bool ByteBuffer::IncrementByte()
 		{
 			if (m_current_data_index >= m_size)
@@ -121,13 +647,13 @@ namespace oscill {
 			{
 				if (!IncrementByte()) return false;
 			}
+			// Bits that were already read are masked off rather than cleared, so that the data
+			// is left untouched and can be peeked at or read again
 			if (num_bits <= m_remaining_bits_in_byte)
 			{
 
-				to_ret = m_data[m_current_data_index] >> (m_remaining_bits_in_byte - num_bits);
+				to_ret = (ByteAt(m_current_data_index) & ((1 << m_remaining_bits_in_byte) - 1)) >> (m_remaining_bits_in_byte - num_bits);
 				m_remaining_bits_in_byte -= num_bits;
-				m_data[m_current_data_index] = (m_data[m_current_data_index] << (8 - m_remaining_bits_in_byte));
-				m_data[m_current_data_index] = m_data[m_current_data_index] >> (8 - m_remaining_bits_in_byte);
 
 				if (m_remaining_bits_in_byte == 0)
 				{
@@ -139,7 +665,7 @@ namespace oscill {
 				// If there are remaining bits to read, read 'em
 				if (m_remaining_bits_in_byte < 8)
 				{
-					to_ret = m_data[m_current_data_index];
+					to_ret = ByteAt(m_current_data_index) & ((1 << m_remaining_bits_in_byte) - 1);
 					bits_to_read -= m_remaining_bits_in_byte;
 					if (!IncrementByte()) return false;
 				}
@@ -147,7 +673,7 @@ namespace oscill {
 				// While we need to read whole bytes
 				while (bits_to_read > 8)
 				{
-					to_ret = (to_ret << 8) | m_data[m_current_data_index];
+					to_ret = (to_ret << 8) | ByteAt(m_current_data_index);
 					if (!IncrementByte()) return false;
 					bits_to_read -= 8;
 				}
@@ -156,10 +682,8 @@ namespace oscill {
 				if (bits_to_read != 0)
 				{
 					to_ret = to_ret << bits_to_read;
-					to_ret = to_ret | (m_data[m_current_data_index] >> (m_remaining_bits_in_byte - bits_to_read));
+					to_ret = to_ret | ((ByteAt(m_current_data_index) & ((1 << m_remaining_bits_in_byte) - 1)) >> (m_remaining_bits_in_byte - bits_to_read));
 					m_remaining_bits_in_byte -= bits_to_read;
-					m_data[m_current_data_index] = (m_data[m_current_data_index] << (8 - m_remaining_bits_in_byte));
-					m_data[m_current_data_index] = m_data[m_current_data_index] >> (8 - m_remaining_bits_in_byte);
 
 					if (m_remaining_bits_in_byte == 0)
 					{
@@ -171,80 +695,831 @@ namespace oscill {
 			m_num_bits_available -= num_bits;
 			return true;
 		}
-		SingleTimeSeries::SingleTimeSeries(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max)
-			: m_bit_size(0), m_time_precision_nanoseconds_pow(time_precision_nanoseconds_pow), m_full_min(min), m_full_max(max)
+		void WriteByteBuffer::UncheckedWriteBits(uint64_t value, int num_bits)
 		{
-			m_decimal_places = precision_decimal_places;
-			m_max = (int64_t)((max)* pow(10, m_decimal_places));
-			m_min = (int64_t)((min)* pow(10, m_decimal_places));
-			m_bit_size = NumberOfBits(m_max, m_min);
-			
-			// We want to divide the time amount so that we are only storing the bits that
-			// are relevant.  Example is if I ony care about 10th of a second I should be dividing
-			// the time values entered by 10^8 to get a much smaller value than if I cared about 
-			// 10 nanoseconds in which case I would only divide by 10
-			m_time_precision_divisor = (uint64_t)pow(10, m_time_precision_nanoseconds_pow);
+			size_t bit_position = BitPosition();
 
-		}
-		bool SingleTimeSeriesWriteBuffer::AddValue(SingleTimeSeriesValue ts_value)
-		{
-			if (!m_AddTimeStamp(ts_value.time, m_first_value)) return false;
-			if (!m_AddValue(ts_value.value, m_first_value)) return false;
+			// Up to 56 bits always fit in the 8 bytes starting at the current byte, so OR
+			// them into that window and store it back
+			while (num_bits > 0)
+			{
+				int chunk = std::min(num_bits, 56);
+				uint64_t bits = (value >> (num_bits - chunk)) & (((uint64_t)1 << chunk) - 1);
+				size_t byte_index = bit_position / 8;
 
-			// If this is the first time writing, assume the value changed 
-			if (m_first_value)
+				uint64_t word = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					word = (word << 8) | m_data[byte_index + i];
+				}
+				word |= bits << (64 - (bit_position % 8) - chunk);
+				for (int i = 0; i < 8; i++)
+				{
+					m_data[byte_index + i] = (uint8_t)(word >> (56 - 8 * i));
+				}
+
+				bit_position += chunk;
+				num_bits -= chunk;
+				m_num_bits_available -= chunk;
+			}
+
+			// Leave the position where WriteBits would, a full byte isn't moved past until the
+			// next write
+			if (bit_position % 8 == 0 && bit_position > 0)
 			{
-				m_first_value = false;
+				m_current_data_index = bit_position / 8 - 1;
+				m_remaining_bits_in_byte = 0;
+			}
+			else
+			{
+				m_current_data_index = bit_position / 8;
+				m_remaining_bits_in_byte = (uint8_t)(8 - bit_position % 8);
 			}
-			
-			return true;
 		}
-		bool SingleTimeSeriesWriteBuffer::m_AddTimeStamp(uint64_t timestamp, bool first)
+		uint32_t ByteBuffer::ComputeChecksum()
 		{
-			// Slight variation on Facebook's Gorilla method.  Accounts
-			// for timing precision so that we can more effeciently store
-			// different ranges of time deltas ( seconds to nanoseconds )
-			//
-			// 0		= no change in delta of delts
-			// 10		= change with a length of 7 
-			// 110		= change with a length of 9
-			// 1110		= change with a length of 12
-			// 11110	= change with a length of 32
-			// 11111	= full 64-bit timestamp.  Re-generate delta of deltas.  This could be either because the time varied too much, 
-			//			  or because we are starting at the beginning of a file offset index
+			return GetKernels().crc32c(0, m_data.Data(), m_size - m_checksum_bits / 8);
+		}
+		bool ReadByteBuffer::ChecksumMatches()
+		{
+			if (m_checksum_bits == 0 || m_size * 8 < m_checksum_bits) return false;
+			uint64_t stored = 0;
+			if (!ReadBitsAt(m_size * 8 - m_checksum_bits, &stored, (int)m_checksum_bits)) return false;
+			return (uint32_t)stored == ComputeChecksum();
+		}
+		size_t WriteByteBuffer::SealWithTrailer(size_t trailing_bits)
+		{
+			size_t used_bits = BitPosition();
+			if (m_sealed) return used_bits;
 
-			// Return whether or not we succesfully added to value to the buffer
+			// The checksum goes last, after the rest of the trailing data
+			trailing_bits += m_checksum_bits;
 
-			// TODO - Should we add some sort of configuration to round up or down.  For now, always
-			// round to the closest value
+			size_t new_size = (used_bits + trailing_bits + 7) / 8;
 
-			// Convert the time to an appropriate value based upon our specified timestamp precision
-			uint64_t timestamp_to_precision = 0;
-			timestamp_to_precision = timestamp / m_time_precision_divisor;
+			// Trailing data is found from the end of the buffer, so it has to follow the end
+			// down.  It only ever moves towards the front, so copying front to back is safe
+			size_t old_offset = m_size * 8 - trailing_bits;
+			size_t new_offset = new_size * 8 - trailing_bits;
+			for (size_t copied = 0; copied < trailing_bits; copied += 64)
+			{
+				int num_bits = (int)std::min((size_t)64, trailing_bits - copied);
+				uint64_t bits = 0;
+				ReadBitsAt(old_offset + copied, &bits, num_bits);
+				WriteBitsAt(new_offset + copied, bits, num_bits);
+			}
 
-			// Do our own rounding.  Rounding messes up at bounds of an uint64_t.  We also want to ensure that 
-			// we are round up to the nearest second instead of truncating.  If we care about time stamp precision to 
-			// the second, 1.999 is most likey 2 seconds with some jitter than it is 1 seconds with a lot of jitter.  In 
-			// the future we could make this tolerance configurable.
-			if (m_time_precision_nanoseconds_pow != 0)
+			// Hand the space that is no longer needed back to the allocator
+			m_data.ShrinkTo(new_size);
+			m_size = new_size;
+			m_num_bits_available = 0;
+			m_sealed = true;
+
+			if (m_checksum_bits > 0)
 			{
-				uint64_t timestamp_to_more_precision = timestamp / (uint64_t)pow(10, m_time_precision_nanoseconds_pow - 1);
-				if (timestamp_to_precision != 0)
-				{
-					uint64_t time_fraction = timestamp_to_more_precision % timestamp_to_precision;
-					if (time_fraction >= 5)
+				WriteBitsAt(TrailerEnd(), ComputeChecksum(), (int)m_checksum_bits);
+			}
+			return used_bits;
+		}
+		bool ByteBuffer::ReadBitsAt(size_t bit_offset, uint64_t *value, int num_bits)
+		{
+			uint64_t to_ret = 0;
+			*value = 0;
+
+			if (bit_offset + num_bits > m_size * 8) return false;
+
+			// Walk the bytes covering the range, taking as many bits from each as we can
+			int bits_read = 0;
+			while (bits_read < num_bits)
+			{
+				size_t byte_index = (bit_offset + bits_read) / 8;
+				int bit_in_byte = (int)((bit_offset + bits_read) % 8);
+				int bits_in_byte = std::min(8 - bit_in_byte, num_bits - bits_read);
+
+				uint8_t bits = (uint8_t)(ByteAt(byte_index) >> (8 - bit_in_byte - bits_in_byte));
+				bits &= (uint8_t)((1 << bits_in_byte) - 1);
+				to_ret = (to_ret << bits_in_byte) | bits;
+				bits_read += bits_in_byte;
+			}
+			*value = to_ret;
+			return true;
+		}
+		bool WriteByteBuffer::WriteBitsAt(size_t bit_offset, uint64_t value, int num_bits)
+		{
+			if (bit_offset + num_bits > m_size * 8) return false;
+
+			// Clear and set the bits in each byte covering the range.  Unlike WriteBits we can't
+			// assume the destination is zeroed
+			int bits_written = 0;
+			while (bits_written < num_bits)
+			{
+				size_t byte_index = (bit_offset + bits_written) / 8;
+				int bit_in_byte = (int)((bit_offset + bits_written) % 8);
+				int bits_in_byte = std::min(8 - bit_in_byte, num_bits - bits_written);
+				int shift = 8 - bit_in_byte - bits_in_byte;
+
+				uint8_t mask = (uint8_t)(((1 << bits_in_byte) - 1) << shift);
+				uint8_t bits = (uint8_t)((value >> (num_bits - bits_written - bits_in_byte)) << shift);
+				m_data[byte_index] = (uint8_t)((m_data[byte_index] & ~mask) | (bits & mask));
+				bits_written += bits_in_byte;
+			}
+			return true;
+		}
+		void WriteByteBuffer::RewindTo(size_t bit_position)
+		{
+			size_t current_position = BitPosition();
+			if (bit_position >= current_position) return;
+
+			// WriteBits adds into the bytes, so everything after the position has to be zeroed
+			size_t byte_index = bit_position / 8;
+			int bit_in_byte = (int)(bit_position % 8);
+			size_t last_byte_index = (current_position - 1) / 8;
+			m_data[byte_index] &= (uint8_t)~(0xFF >> bit_in_byte);
+			for (size_t i = byte_index + 1; i <= last_byte_index && i < m_size; i++)
+			{
+				m_data[i] = 0;
+			}
+
+			m_current_data_index = byte_index;
+			m_remaining_bits_in_byte = (uint8_t)(8 - bit_in_byte);
+			m_num_bits_available += (int64_t)(current_position - bit_position);
+		}
+		bool ReadByteBuffer::PeekBits(uint64_t *value, int num_bits)
+		{
+			*value = 0;
+			if (num_bits > m_num_bits_available) return false;
+
+			// Most of the time there are a whole 8 bytes to load, so grab them all at once
+			size_t bit_position = BitPosition();
+			size_t byte_index = bit_position / 8;
+			if (num_bits > 0 && num_bits <= 56 && byte_index + 8 <= m_size)
+			{
+				uint64_t word = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					word = (word << 8) | ByteAt(byte_index + i);
+				}
+				*value = (word << (bit_position % 8)) >> (64 - num_bits);
+				return true;
+			}
+			return ReadBitsAt(bit_position, value, num_bits);
+		}
+		bool ReadByteBuffer::SkipBits(int num_bits)
+		{
+			if (num_bits > m_num_bits_available) return false;
+
+			size_t bit_position = BitPosition() + num_bits;
+			m_current_data_index = bit_position / 8;
+			m_remaining_bits_in_byte = (uint8_t)(8 - bit_position % 8);
+			m_num_bits_available -= num_bits;
+			return true;
+		}
+		void RegularIntervalMetrics::GenerateTimes(size_t first, size_t num, uint64_t multiplier, uint64_t *times) const
+		{
+			// Find the last exception at or before the first sample, that's our anchor
+			uint64_t current_anchor_index = 0;
+			uint64_t current_anchor_time = start_time;
+			size_t next_exception = 0;
+			while (next_exception < exceptions.size() && exceptions[next_exception].index <= first)
+			{
+				current_anchor_index = exceptions[next_exception].index;
+				current_anchor_time = exceptions[next_exception].timestamp;
+				next_exception++;
+			}
+
+			size_t index = first;
+			size_t end = first + num;
+			while (index < end)
+			{
+				// Run until the next exception, everything in between is on the grid
+				size_t run_end = end;
+				if (next_exception < exceptions.size() && exceptions[next_exception].index < run_end)
+				{
+					run_end = exceptions[next_exception].index;
+				}
+
+				uint64_t base = current_anchor_time - current_anchor_index * period;
+				for (size_t i = index; i < run_end; i++)
+				{
+					times[i - first] = (base + i * period) * multiplier;
+				}
+				index = run_end;
+
+				if (next_exception < exceptions.size() && exceptions[next_exception].index == index)
+				{
+					current_anchor_index = exceptions[next_exception].index;
+					current_anchor_time = exceptions[next_exception].timestamp;
+					next_exception++;
+				}
+			}
+		}
+		SingleTimeSeries::SingleTimeSeries(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max)
+			: m_bit_size(0), m_time_precision_nanoseconds_pow(time_precision_nanoseconds_pow), m_full_min(min), m_full_max(max)
+		{
+			m_decimal_places = precision_decimal_places;
+			m_max = (int64_t)((max)* pow(10, m_decimal_places));
+			m_min = (int64_t)((min)* pow(10, m_decimal_places));
+			m_bit_size = NumberOfBits(m_max, m_min);
+			
+			// We want to divide the time amount so that we are only storing the bits that
+			// are relevant.  Example is if I ony care about 10th of a second I should be dividing
+			// the time values entered by 10^8 to get a much smaller value than if I cared about 
+			// 10 nanoseconds in which case I would only divide by 10
+			m_time_precision_divisor = (uint64_t)pow(10, m_time_precision_nanoseconds_pow);
+
+		}
+		bool SingleTimeSeriesWriteBuffer::AddValue(SingleTimeSeriesValue ts_value)
+		{
+			int64_t value_to_write = m_QuantizeValue(ts_value.value);
+			bool added = m_AddPoint(ts_value.time, value_to_write, m_first_value || (uint64_t)value_to_write != m_last_value);
+			m_Publish();
+			return added;
+		}
+		bool SingleTimeSeriesWriteBuffer::m_AddPoint(uint64_t timestamp, int64_t value_to_write, bool changed)
+		{
+			if (m_sealed) return false;
+
+			// A point that doesn't fit is taken back out, so the buffer always ends with a
+			// complete point and can be filled right up to the last bit
+			EncoderState state;
+			m_SaveState(&state);
+			if (m_EncodePoint(timestamp, value_to_write, changed)) return true;
+
+			m_RestoreState(state);
+			return false;
+		}
+		void SingleTimeSeriesWriteBuffer::m_SaveState(EncoderState *state)
+		{
+			state->checkpoint = GetCheckpoint();
+			state->previous_timestamp = m_previous_timestamp;
+			state->previous_delta = m_previous_delta;
+			state->last_value = m_last_value;
+			state->first_value = m_first_value;
+			state->regular = m_regular;
+			state->run_length = m_run_length;
+			state->value_state = m_value_state;
+		}
+		void SingleTimeSeriesWriteBuffer::m_RestoreState(const EncoderState &state)
+		{
+			Rollback(state.checkpoint);
+			m_previous_timestamp = state.previous_timestamp;
+			m_previous_delta = state.previous_delta;
+			m_last_value = state.last_value;
+			m_first_value = state.first_value;
+			m_regular = state.regular;
+			m_run_length = state.run_length;
+			m_value_state = state.value_state;
+
+			// The counts in the header are written in place, so they may be ahead
+			if ((m_flags & FormatFlags::k_regular_interval) && !m_first_value)
+			{
+				WriteBitsAt(m_regular.count_bit_offset, m_regular.count, 32);
+				WriteBitsAt(m_regular.count_bit_offset + 32, m_regular.exception_count, 32);
+			}
+			if (m_value_codec == k_value_dictionary && !m_first_value)
+			{
+				m_dictionary.entries.resize(m_value_state.dictionary_size);
+				WriteBitsAt(m_dictionary.bit_offset, m_value_state.dictionary_size, 8);
+			}
+		}
+		size_t SingleTimeSeriesWriteBuffer::Seal()
+		{
+			// Regular interval exceptions live at the end of the buffer
+			size_t trailing_bits = 0;
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				trailing_bits = (size_t)m_regular.exception_count * RegularIntervalMetrics::k_exception_size;
+			}
+			return SealWithTrailer(trailing_bits);
+		}
+		size_t SingleTimeSeriesWriteBuffer::SealEntropyCoded()
+		{
+			// Regular intervals and runs already leave next to nothing per sample
+			if (m_sealed || m_first_value || (m_flags & (FormatFlags::k_regular_interval | FormatFlags::k_run_length))) return Seal();
+
+			// Read the points back out of the plain encoding
+			std::vector<uint64_t> timestamps;
+			std::vector<uint64_t> values;
+			std::vector<uint8_t> changes;
+			{
+				SingleTimeSeriesReadBuffer reader(*this);
+				if (!reader.m_ReadHeader()) return Seal();
+
+				uint64_t time = 0;
+				bool changed = false;
+				while (reader.m_ReadNextTime(&time) && reader.m_ReadNextQuantized(&changed))
+				{
+					timestamps.push_back(reader.m_previous_timestamp);
+					values.push_back(reader.m_last_quantized);
+					changes.push_back(changed ? 1 : 0);
+				}
+			}
+
+			// Turn each of them into a symbol and the bits that follow it, making the same
+			// timestamp and value decisions as the plain encoding
+			struct EntropyPoint
+			{
+				int symbol;
+				uint64_t extra;
+				int extra_bits;
+				ValueField value;
+			};
+			std::vector<EntropyPoint> points(timestamps.size());
+			uint32_t counts[k_entropy_symbol_count] = {};
+			ValueCodecState value_state;
+			ValueDictionary dictionary;
+			dictionary.capacity = m_dictionary.capacity;
+			uint64_t previous_timestamp = 0;
+			uint64_t previous_delta = k_default_delta;
+			uint64_t last_value = 0;
+			for (size_t i = 0; i < points.size(); i++)
+			{
+				EntropyPoint &point = points[i];
+				int time_class = k_entropy_full_class;
+				point.extra = timestamps[i];
+				point.extra_bits = k_timestamp_size;
+				if (i > 0)
+				{
+					int64_t delta = timestamps[i] - previous_timestamp;
+					int64_t delta_of_delta = delta - previous_delta;
+					uint64_t field = 0;
+					int field_bits = 0;
+					int width_class = 0;
+					if (delta_of_delta == 0)
 					{
-						timestamp_to_precision++;
+						time_class = 0;
+						point.extra_bits = 0;
+					}
+					else if (std::abs(delta_of_delta) <= k_entropy_small_delta)
+					{
+						time_class = (int)delta_of_delta + k_entropy_small_delta + (delta_of_delta < 0 ? 1 : 0);
+						point.extra_bits = 0;
+					}
+					else if (EncodeDeltaOfDelta(delta_of_delta, &field, &field_bits, &width_class))
+					{
+						// Keep the sign and magnitude, the symbol replaces the control code
+						time_class = k_entropy_width_class + width_class;
+						point.extra_bits = timestamp_encoding_info[width_class].delta_size;
+						point.extra = field & (((uint64_t)1 << point.extra_bits) - 1);
 					}
+					previous_delta = (time_class == k_entropy_full_class) ? k_default_delta : delta;
 				}
-				else
+				previous_timestamp = timestamps[i];
+
+				point.value = { 0, 0, 0, 0 };
+				if (changes[i])
 				{
-					if (timestamp_to_more_precision >= 5)
+					EncodeChangedValue(m_value_codec, value_state, dictionary, last_value, values[i], (int)m_bit_size, &point.value);
+					last_value = values[i];
+				}
+				point.symbol = time_class * 2 + changes[i];
+				counts[point.symbol]++;
+			}
+
+			HuffmanCode code;
+			if (!code.Build(counts, k_entropy_symbol_count)) return Seal();
+
+			// Only worth it if it comes out smaller.  The 1 marking a changed value is part of
+			// the symbol, so it isn't written again
+			uint16_t plain_flags = m_flags;
+			m_flags |= FormatFlags::k_entropy_coded;
+			int64_t bits = m_HeaderBits();
+			for (auto &&point : points)
+			{
+				bits += code.Length(point.symbol) + point.extra_bits;
+				if (point.value.control_bits > 0) bits += point.value.control_bits - 1 + point.value.payload_bits;
+			}
+			if (bits >= (int64_t)BitPosition())
+			{
+				m_flags = plain_flags;
+				return Seal();
+			}
+
+			// Start over in new storage of exactly the right size.  The plain encoding is kept
+			// until the header is in, so it can still be sealed if anything goes wrong
+			BufferStorage plain_data;
+			plain_data.Swap(m_data);
+			size_t plain_size = m_size;
+			size_t plain_data_index = m_current_data_index;
+			uint8_t plain_remaining_bits = m_remaining_bits_in_byte;
+			int64_t plain_bits_available = m_num_bits_available;
+			ValueDictionary plain_dictionary = m_dictionary;
+
+			m_entropy_code = code;
+			m_size = (size_t)((bits + m_checksum_bits + 7) / 8);
+			Reset();
+			m_num_bits_available = (int64_t)TrailerEnd();
+			if (!m_data.AssignZeroed(m_size) || !m_WriteHeader(timestamps[0] * m_time_precision_divisor))
+			{
+				m_data.Swap(plain_data);
+				m_size = plain_size;
+				m_current_data_index = plain_data_index;
+				m_remaining_bits_in_byte = plain_remaining_bits;
+				m_num_bits_available = plain_bits_available;
+				m_dictionary = plain_dictionary;
+				m_flags = plain_flags;
+				return Seal();
+			}
+
+			m_dictionary.entries = dictionary.entries;
+			m_value_state = value_state;
+			if (m_value_codec == k_value_dictionary)
+			{
+				WriteBitsAt(m_dictionary.bit_offset, m_dictionary.entries.size(), 8);
+				for (size_t i = 0; i < m_dictionary.entries.size(); i++)
+				{
+					WriteBitsAt(m_dictionary.bit_offset + 8 + i * m_bit_size, m_dictionary.entries[i], (int)m_bit_size);
+				}
+			}
+
+			for (auto &&point : points)
+			{
+				m_entropy_code.Write(*this, point.symbol);
+				if (point.extra_bits > 0)
+				{
+					WriteBits(point.extra, point.extra_bits);
+				}
+				if (point.value.control_bits > 1)
+				{
+					int control_bits = point.value.control_bits - 1;
+					WriteBits(point.value.control & (((uint64_t)1 << control_bits) - 1), control_bits);
+				}
+				if (point.value.payload_bits > 0)
+				{
+					WriteBits(point.value.payload, point.value.payload_bits);
+				}
+			}
+			return SealWithTrailer(0);
+		}
+		int64_t SingleTimeSeriesWriteBuffer::EstimateBits(const SingleTimeSeriesValue *values, size_t count)
+		{
+			// Make the same decisions as adding the values would on copies of the encoder state,
+			// but only count the bits
+			uint64_t previous_timestamp = m_previous_timestamp;
+			uint64_t previous_delta = m_previous_delta;
+			uint64_t last_value = m_last_value;
+			bool first = m_first_value;
+			RegularIntervalMetrics regular = m_regular;
+			RunLengthMetrics run_length = m_run_length;
+			ValueCodecState value_state = m_value_state;
+			ValueDictionary dictionary = m_dictionary;
+			int64_t bits = 0;
+
+			const Kernels &kernels = GetKernels();
+			double scale = pow(10, m_decimal_places);
+			double block_values[k_batch_size];
+			int64_t block_quantized[k_batch_size];
+
+			for (size_t block_start = 0; block_start < count; block_start += k_batch_size)
+			{
+				size_t block_size = std::min(count - block_start, (size_t)k_batch_size);
+				const SingleTimeSeriesValue *block = values + block_start;
+				for (size_t i = 0; i < block_size; i++)
+				{
+					block_values[i] = block[i].value;
+				}
+				kernels.quantize(block_values, block_size, m_full_min, m_full_max, scale, m_min, block_quantized);
+
+				for (size_t i = 0; i < block_size; i++)
+				{
+					uint64_t timestamp_to_precision = TimestampToPrecision(block[i].time, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+					bool changed = first || (uint64_t)block_quantized[i] != last_value;
+
+					if (first && m_flags != 0)
 					{
-						timestamp_to_precision++;
+						bits += m_HeaderBits();
+						if (m_flags & FormatFlags::k_regular_interval)
+						{
+							regular.start_time = regular.anchor_time = timestamp_to_precision;
+							regular.anchor_index = 0;
+						}
+					}
+
+					if ((m_flags & FormatFlags::k_run_length) && !first)
+					{
+						if (timestamp_to_precision - previous_timestamp == previous_delta && !changed)
+						{
+							bits += CountIdleSample(run_length, 2);
+							previous_timestamp = timestamp_to_precision;
+							continue;
+						}
+						run_length.idle_count = 0;
+						run_length.length = 0;
+					}
+
+					if (m_flags & FormatFlags::k_regular_interval)
+					{
+						if (!first && timestamp_to_precision != regular.anchor_time + (regular.count - regular.anchor_index) * regular.period)
+						{
+							bits += RegularIntervalMetrics::k_exception_size;
+							regular.anchor_index = regular.count;
+							regular.anchor_time = timestamp_to_precision;
+						}
+						regular.count++;
+					}
+					else
+					{
+						int64_t delta = timestamp_to_precision - previous_timestamp;
+						int64_t delta_of_delta = delta - previous_delta;
+						uint64_t field = 0;
+						int field_bits = 0;
+						if (!first && delta_of_delta == 0)
+						{
+							bits += 1;
+							previous_delta = delta;
+						}
+						else if (!first && EncodeDeltaOfDelta(delta_of_delta, &field, &field_bits))
+						{
+							bits += field_bits;
+							previous_delta = delta;
+						}
+						else
+						{
+							bits += 5 + k_timestamp_size;
+							previous_delta = k_default_delta;
+						}
 					}
+					previous_timestamp = timestamp_to_precision;
+
+					if (changed)
+					{
+						ValueField field;
+						EncodeChangedValue(m_value_codec, value_state, dictionary, last_value, (uint64_t)block_quantized[i], (int)m_bit_size, &field);
+						bits += field.control_bits + field.payload_bits;
+						last_value = block_quantized[i];
+					}
+					else
+					{
+						bits += 1;
+					}
+					first = false;
 				}
 			}
+			return bits;
+		}
+		bool SingleTimeSeriesWriteBuffer::m_EncodePoint(uint64_t timestamp, int64_t value_to_write, bool changed)
+		{
+			// Buffers using any of the optional encodings describe them up front
+			if (m_first_value && m_flags != 0)
+			{
+				if (!m_WriteHeader(timestamp)) return false;
+			}
+
+			if ((m_flags & FormatFlags::k_run_length) && !m_first_value)
+			{
+				uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+				if (timestamp_to_precision - m_previous_timestamp == m_previous_delta && !changed)
+				{
+					if (!WriteIdleSample(*this, m_run_length, 2)) return false;
+					m_previous_timestamp = timestamp_to_precision;
+					return true;
+				}
+
+				// Anything else ends the run
+				m_run_length.idle_count = 0;
+				m_run_length.length = 0;
+			}
+
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				if (!m_AddRegularTimeStamp(timestamp, m_first_value)) return false;
+			}
+			else
+			{
+				if (!m_AddTimeStamp(timestamp, m_first_value)) return false;
+			}
+			if (!m_AddValue(value_to_write, changed)) return false;
+
+			// Keep the sample count in the header current so the buffer can be read at any time
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				m_regular.count++;
+				if (!WriteBitsAt(m_regular.count_bit_offset, m_regular.count, 32)) return false;
+			}
+
+			// If this is the first time writing, assume the value changed 
+			if (m_first_value)
+			{
+				m_first_value = false;
+			}
+			
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::SetRegularInterval(uint64_t period_nanoseconds)
+		{
+			// The layout can't change once values are in the buffer
+			if (!m_first_value) return false;
+
+			// Runs rely on the per sample timestamp bits, and swing door samples are never on a grid
+			if (m_flags & (FormatFlags::k_run_length | FormatFlags::k_swing_door)) return false;
+			if (m_concurrent_reads) return false;
+
+			uint64_t period = period_nanoseconds / m_time_precision_divisor;
+			if (period == 0) return false;
+
+			m_flags |= FormatFlags::k_regular_interval;
+			m_regular.period = period;
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::SetRunLengthEncoding()
+		{
+			if (!m_first_value) return false;
+			if (m_flags & (FormatFlags::k_regular_interval | FormatFlags::k_swing_door)) return false;
+			if (m_concurrent_reads) return false;
+
+			m_flags |= FormatFlags::k_run_length;
+			m_run_length.threshold = RunLengthThreshold(2);
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::SetValueCodec(ValueCodec codec)
+		{
+			if (!m_first_value) return false;
+			if (codec < k_value_raw || codec >= k_value_codec_count) return false;
+			// Dictionary entries are filled in to the header as they are found
+			if (codec == k_value_dictionary && m_concurrent_reads) return false;
+
+			// Raw values don't need the codec in the header, which keeps the plain layout
+			m_value_codec = codec;
+			if (codec == k_value_raw)
+			{
+				m_flags &= ~FormatFlags::k_value_codec;
+			}
+			else
+			{
+				m_flags |= FormatFlags::k_value_codec;
+			}
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::SetDictionary(uint32_t max_entries)
+		{
+			if (max_entries < 1 || max_entries > ValueDictionary::k_max_capacity) return false;
+			if (!SetValueCodec(k_value_dictionary)) return false;
+			m_dictionary.capacity = max_entries;
+			return true;
+		}
+		ValueCodec SingleTimeSeriesWriteBuffer::SelectValueCodec(const SingleTimeSeriesValue *sample, size_t count, double size_tolerance)
+		{
+			if (!m_first_value) return m_value_codec;
+
+			int64_t codec_bits[k_value_codec_count];
+			int64_t smallest_bits = 0;
+			for (int codec = k_value_raw; codec < k_value_codec_count; codec++)
+			{
+				if (!SetValueCodec((ValueCodec)codec))
+				{
+					codec_bits[codec] = INT64_MAX;
+					continue;
+				}
+				codec_bits[codec] = EstimateBits(sample, count);
+				if (codec == k_value_raw || codec_bits[codec] < smallest_bits)
+				{
+					smallest_bits = codec_bits[codec];
+				}
+			}
+
+			// The codecs are listed from quickest to slowest to decode, take the first one that
+			// is small enough
+			ValueCodec selected = k_value_raw;
+			for (int codec = k_value_raw; codec < k_value_codec_count; codec++)
+			{
+				if ((double)codec_bits[codec] <= (double)smallest_bits * size_tolerance)
+				{
+					selected = (ValueCodec)codec;
+					break;
+				}
+			}
+			SetValueCodec(selected);
+			return selected;
+		}
+		bool SingleTimeSeriesWriteBuffer::SetConcurrentReads()
+		{
+			if (!m_first_value || m_sealed) return false;
+			if (m_flags & (FormatFlags::k_regular_interval | FormatFlags::k_run_length | FormatFlags::k_swing_door | FormatFlags::k_checksum)) return false;
+			if (m_value_codec == k_value_dictionary) return false;
+
+			m_concurrent_reads = true;
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::SetChecksum()
+		{
+			// A live reader can't tell where the end of the buffer will be
+			if (!m_first_value || m_sealed || m_concurrent_reads) return false;
+			if (!ReserveChecksum()) return false;
+			m_flags |= FormatFlags::k_checksum;
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::m_WriteHeader(uint64_t timestamp)
+		{
+			// 11110 marks the header, followed by 3 reserved bits and the format flags
+			if (!WriteBits(k_extended_header, 5)) return false;
+			if (!WriteBits(0, 3)) return false;
+			if (!WriteBits(m_flags, 16)) return false;
+
+			if (m_flags & FormatFlags::k_value_codec)
+			{
+				if (!WriteBits(m_value_codec, 8)) return false;
+			}
+			if (m_value_codec == k_value_dictionary)
+			{
+				// Capacity, then the entry count and the space for the entries which are
+				// filled in as they are found
+				if (!WriteBits(m_dictionary.capacity, 8)) return false;
+				m_dictionary.bit_offset = BitPosition();
+				if (!WriteBits(0, 8)) return false;
+				for (uint32_t i = 0; i < m_dictionary.capacity; i++)
+				{
+					if (!WriteBits(0, (int)m_bit_size)) return false;
+				}
+			}
+			if (m_flags & FormatFlags::k_swing_door)
+			{
+				if (!WriteBits(DoubleToBits(m_error_bound), 64)) return false;
+			}
+			if (m_flags & FormatFlags::k_entropy_coded)
+			{
+				// The length of every symbol's code is enough to rebuild the code
+				for (int symbol = 0; symbol < k_entropy_symbol_count; symbol++)
+				{
+					if (!WriteBits(m_entropy_code.Length(symbol), HuffmanCode::k_length_size)) return false;
+				}
+			}
+
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				// Start time and period, followed by the sample and exception counts which
+				// are updated in place as values are added
+				m_regular.start_time = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+				m_regular.anchor_time = m_regular.start_time;
+				m_regular.anchor_index = 0;
+				if (!WriteBits(m_regular.start_time, 64)) return false;
+				if (!WriteBits(m_regular.period, 64)) return false;
+				m_regular.count_bit_offset = BitPosition();
+				if (!WriteBits(0, 32)) return false;
+				if (!WriteBits(0, 32)) return false;
+			}
+			return true;
+		}
+		int64_t SingleTimeSeriesWriteBuffer::m_HeaderBits()
+		{
+			if (m_flags == 0) return 0;
+
+			// Marker, reserved bits and flags, then each optional field in the order written
+			int64_t bits = 5 + 3 + 16;
+			if (m_flags & FormatFlags::k_value_codec) bits += 8;
+			if (m_value_codec == k_value_dictionary) bits += 8 + 8 + (int64_t)m_dictionary.capacity * m_bit_size;
+			if (m_flags & FormatFlags::k_swing_door) bits += 64;
+			if (m_flags & FormatFlags::k_entropy_coded) bits += k_entropy_symbol_count * HuffmanCode::k_length_size;
+			if (m_flags & FormatFlags::k_regular_interval) bits += 64 + 64 + 32 + 32;
+			return bits;
+		}
+		bool SingleTimeSeriesWriteBuffer::m_AddRegularTimeStamp(uint64_t timestamp, bool first)
+		{
+			uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+
+			// The first sample is the start time stored in the header
+			if (!first)
+			{
+				uint64_t expected = m_regular.anchor_time + (m_regular.count - m_regular.anchor_index) * m_regular.period;
+				if (timestamp_to_precision != expected)
+				{
+					// Missed or late sample.  Record it at the end of the buffer and move the grid
+					// so that the following samples are relative to it
+					if (!ReserveTrailingBits(RegularIntervalMetrics::k_exception_size)) return false;
+					size_t exception_offset = TrailerEnd() - (size_t)(m_regular.exception_count + 1) * RegularIntervalMetrics::k_exception_size;
+					if (!WriteBitsAt(exception_offset, m_regular.count, 32)) return false;
+					if (!WriteBitsAt(exception_offset + 32, timestamp_to_precision, 64)) return false;
+
+					m_regular.exception_count++;
+					if (!WriteBitsAt(m_regular.count_bit_offset + 32, m_regular.exception_count, 32)) return false;
+
+					m_regular.anchor_index = m_regular.count;
+					m_regular.anchor_time = timestamp_to_precision;
+				}
+			}
+			m_previous_timestamp = timestamp_to_precision;
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::m_AddTimeStamp(uint64_t timestamp, bool first)
+		{
+			// Slight variation on Facebook's Gorilla method.  Accounts
+			// for timing precision so that we can more effeciently store
+			// different ranges of time deltas ( seconds to nanoseconds )
+			//
+			// 0		= no change in delta of delts
+			// 10		= change with a length of 7 
+			// 110		= change with a length of 9
+			// 1110		= change with a length of 12
+			// 11110	= change with a length of 32
+			// 11111	= full 64-bit timestamp.  Re-generate delta of deltas.  This could be either because the time varied too much, 
+			//			  or because we are starting at the beginning of a file offset index
+
+			// Return whether or not we succesfully added to value to the buffer
+
+			// TODO - Should we add some sort of configuration to round up or down.  For now, always
+			// round to the closest value
+
+			// Convert the time to an appropriate value based upon our specified timestamp precision
+			uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
 
 			if (first)
 			{	
@@ -271,123 +1546,304 @@ namespace oscill {
 			}
 			else
 			{
-				// Since we can never get 0 here ( which would imply no change), shifrt the abs value by
-				// 1 to better fit in the bits we want to store
-				delta_of_delta--;
-				int64_t abs_delta_of_delta = std::abs(delta_of_delta);
+				// Since we can never get 0 here ( which would imply no change), shifrt the abs value by
+				// 1 to better fit in the bits we want to store
+				delta_of_delta--;
+				int64_t abs_delta_of_delta = std::abs(delta_of_delta);
+
+				for ( int i = 0; i < 5; i++)
+				{
+					// Pretty big time change, just indicate and write out the whole value
+					if ( i >= 4)
+					{
+						if (!WriteBits(k_full_timestamp, 5)) return false;
+						// Write the full 64-bit timestamp
+						if (!WriteBits(timestamp_to_precision, k_timestamp_size)) return false;
+
+						// The reader goes back to the default delta after a full timestamp
+						m_previous_timestamp = timestamp_to_precision;
+						m_previous_delta = k_default_delta;
+						return true;
+					}
+					if (abs_delta_of_delta <= timestamp_encoding_info[i].max_delta)
+					{
+						if ( !WriteBits(timestamp_encoding_info[i].pattern, timestamp_encoding_info[i].pattern_size)) return false;
+						
+						// Write the sign bit
+						if ( delta_of_delta < 1)
+						{
+							if (!WriteBits(1, 1)) return false;
+						}
+						else
+						{
+							if (!WriteBits(0, 1)) return false;
+						}
+						// Write the absolute value
+						if ( !WriteBits(abs_delta_of_delta, timestamp_encoding_info[i].delta_size - 1)) return false;
+						break;
+					}
+				}
+				
+			}
+
+			// Set our values for the next add
+			m_previous_timestamp = timestamp_to_precision;
+			m_previous_delta = delta;
+			return true;
+		}
+		int64_t SingleTimeSeriesWriteBuffer::m_QuantizeValue(double value)
+		{
+			// If we are above the maximum, set it to the maximum.
+			if (value > m_full_max)
+			{
+				value = m_full_max;
+			}
+			// If we are below the minimum, set it to the minimum. 
+			if (value < m_full_min)
+			{
+				value = m_full_min;
+			}
+			// Get binary representation with the designated precision / precsion
+			int64_t value_to_write = (int64_t)((value) * pow(10,m_decimal_places));
+			return value_to_write - m_min;
+		}
+		bool SingleTimeSeriesWriteBuffer::m_AddValue(int64_t value_to_write, bool changed)
+		{
+			// If the value didn't change, write a 0 bit.  Otherwise write a 1 bit and the value.
+			// The first value of a buffer always counts as changed
+			if (!changed)
+			{
+				if (!WriteBits(0, 1)) return false;
+			}
+			else
+			{
+				// The value codec picks how the changed value is stored, raw by default
+				ValueField field;
+				uint32_t dictionary_size = m_value_state.dictionary_size;
+				EncodeChangedValue(m_value_codec, m_value_state, m_dictionary, m_last_value, (uint64_t)value_to_write, (int)m_bit_size, &field);
+				m_last_value = value_to_write;
+
+				// A new dictionary entry goes into the space saved for it in the header
+				if (m_value_state.dictionary_size != dictionary_size)
+				{
+					if (!WriteBitsAt(m_dictionary.bit_offset, m_value_state.dictionary_size, 8)) return false;
+					if (!WriteBitsAt(m_dictionary.bit_offset + 8 + dictionary_size * m_bit_size, (uint64_t)value_to_write, (int)m_bit_size)) return false;
+				}
+
+				if (!WriteBits(field.control, field.control_bits)) return false;
+				if (field.payload_bits > 0)
+				{
+					if (!WriteBits(field.payload, field.payload_bits)) return false;
+				}
+			}
+			return true;
+		}
+		bool SingleTimeSeriesWriteBuffer::AddValues(const std::vector<SingleTimeSeriesValue> &values, size_t *values_added)
+		{
+			return AddValues(values.data(), values.size(), values_added);
+		}
+		bool SingleTimeSeriesWriteBuffer::AddValues(const SingleTimeSeriesValue *values, size_t count, size_t *values_added)
+		{
+			if (!values_added)
+			{
+				return false;
+			}
+
+			*values_added = 0;
+
+			// Two passes per block.  The first clamps, scales and offsets every value and works out
+			// which ones changed using the vector kernels, the second only has to emit bits.  Blocks
+			// keep the scratch space on the stack and in cache
+			const Kernels &kernels = GetKernels();
+			double scale = pow(10, m_decimal_places);
+			double block_values[k_batch_size];
+			int64_t block_quantized[k_batch_size];
+			uint8_t block_changed[k_batch_size];
+
+			for (size_t block_start = 0; block_start < count; block_start += k_batch_size)
+			{
+				size_t block_size = std::min(count - block_start, (size_t)k_batch_size);
+				const SingleTimeSeriesValue *block = values + block_start;
+				for (size_t i = 0; i < block_size; i++)
+				{
+					block_values[i] = block[i].value;
+				}
+				kernels.quantize(block_values, block_size, m_full_min, m_full_max, scale, m_min, block_quantized);
+				kernels.mark_changes(block_quantized, block_size, (int64_t)m_last_value, block_changed);
 
-				for ( int i = 0; i < 5; i++)
+				size_t i = 0;
+				if (m_flags == 0)
 				{
-					// Pretty big time change, just indicate and write out the whole value
-					if ( i >= 4)
-					{
-						if (!WriteBits(k_full_timestamp, 5)) return false;
-						// Write the full 64-bit timestamp
-						if (!WriteBits(timestamp_to_precision, k_timestamp_size)) return false;
-						break;
-					}
-					if (abs_delta_of_delta <= timestamp_encoding_info[i].max_delta)
+					// The first point carries the full timestamp, leave it to the checked path
+					if (m_first_value)
 					{
-						if ( !WriteBits(timestamp_encoding_info[i].pattern, timestamp_encoding_info[i].pattern_size)) return false;
-						
-						// Write the sign bit
-						if ( delta_of_delta < 1)
+						if (!m_AddPoint(block[0].time, block_quantized[0], true))
 						{
-							if (!WriteBits(1, 1)) return false;
+							m_Publish();
+							return false;
 						}
-						else
+						*values_added += 1;
+						i = 1;
+					}
+
+					// If even the worst case for the rest of the block fits, skip the space checks
+					int64_t budget = (int64_t)(block_size - i) * m_WorstCasePointBits() + k_unchecked_slack;
+					if (budget <= m_num_bits_available)
+					{
+						*values_added += block_size - i;
+						for (; i < block_size; i++)
 						{
-							if (!WriteBits(0, 1)) return false;
+							m_UncheckedAddPoint(block[i].time, block_quantized[i], block_changed[i] != 0);
 						}
-						// Write the absolute value
-						if ( !WriteBits(abs_delta_of_delta, timestamp_encoding_info[i].delta_size - 1)) return false;
-						break;
 					}
 				}
-				
-			}
 
-			// Set our values for the next add
-			m_previous_timestamp = timestamp_to_precision;
-			m_previous_delta = delta;
+				// Optional encodings and the end of the buffer go through the checked path
+				for (; i < block_size; i++)
+				{
+					if (!m_AddPoint(block[i].time, block_quantized[i], m_first_value || block_changed[i] != 0))
+					{
+						m_Publish();
+						return false;
+					}
+					*values_added += 1;
+				}
+			}
+			m_Publish();
 			return true;
 		}
-		bool SingleTimeSeriesWriteBuffer::m_AddValue(double value, bool first)
+		void SingleTimeSeriesWriteBuffer::m_UncheckedAddPoint(uint64_t timestamp, int64_t value_to_write, bool changed)
 		{
-			// If we are above the maximum, set it to the maximum.
-			if (value > m_full_max)
+			// Same bits as m_AddTimeStamp and m_AddValue, with the control code, sign and delta of
+			// delta put together into one field
+			uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+			uint64_t field = 0;
+			int field_bits = 0;
+			bool full_timestamp = false;
+			EncodePlainTime(timestamp_to_precision, m_previous_timestamp, m_previous_delta, false, &field, &field_bits, &full_timestamp, &m_previous_delta);
+			UncheckedWriteBits(field, field_bits);
+			if (full_timestamp)
 			{
-				value = m_full_max;
+				UncheckedWriteBits(timestamp_to_precision, k_timestamp_size);
 			}
-			// If we are below the minimum, set it to the minimum. 
-			if (value < m_full_min)
+			m_previous_timestamp = timestamp_to_precision;
+
+			if (!changed)
 			{
-				value = m_full_min;
+				UncheckedWriteBits(0, 1);
+				return;
 			}
-			// Get binary representation with the designated precision / precsion
-			int64_t value_to_write = (int64_t)((value) * pow(10,m_decimal_places));
-			value_to_write -= m_min;
+			UncheckedWriteBits(1, 1);
+			UncheckedWriteBits((uint64_t)value_to_write, (int)m_bit_size);
+			m_last_value = value_to_write;
+		}
 
-			if (first)
-			{
-				m_last_value = value_to_write;
+				
+		SwingDoorWriteBuffer::SwingDoorWriteBuffer(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max, const double error_bound, size_t size) :
+			SingleTimeSeriesWriteBuffer(precision_decimal_places, time_precision_nanoseconds_pow, min, max, size)
+		{
+			m_flags |= FormatFlags::k_swing_door;
+			m_error_bound = error_bound;
+			m_quantized_error_bound = error_bound * pow(10, m_decimal_places);
+		}
+		bool SwingDoorWriteBuffer::AddValue(SingleTimeSeriesValue ts_value)
+		{
+			if (m_sealed) return false;
 
-				// Write a single 1 bit indicating that the value changed
-				if (!WriteBits(1, 1)) return false;
-				return WriteBits(value_to_write, m_bit_size);
-			}
-		
-			
-			// If the value didn't change, write a 0 bit.  Otherwise write a 1 bit and the value
-			if (m_last_value == value_to_write)
+			int64_t value_to_write = m_QuantizeValue(ts_value.value);
+			uint64_t timestamp_to_precision = TimestampToPrecision(ts_value.time, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+
+			if (!m_have_anchor)
 			{
-				if (!WriteBits(0, 1)) return false;
+				if (!m_AddPoint(ts_value.time, value_to_write, true)) return false;
+				m_have_anchor = true;
+				m_anchor_time = timestamp_to_precision;
+				m_anchor_value = value_to_write;
+				return true;
 			}
-			else
-			{
-				/****** Placeholder to see if we need to do Facebook's compression algorithm ******/
-				// Now do Facebook's Gorilla compression on the value
-				// Convert current and last value to uint64_t for the XOR comparison
-				//uint64_t* u_value = (uint64_t*)&value_to_write;
-  				//uint64_t xored = *(uint64_t *)&m_last_value ^ *u_value;
 
-				// If the section of changed bits is the same as the last values 
-				// changed bits, just store the XORed value.
-				/**********************************************************************************/
+			if (m_have_provisional && timestamp_to_precision > m_anchor_time)
+			{
+				double elapsed = (double)(timestamp_to_precision - m_anchor_time);
+				double slope = (double)(value_to_write - m_anchor_value) / elapsed;
+				if (slope >= m_lower_slope && slope <= m_upper_slope)
+				{
+					// The line from the anchor to this sample passes close enough to everything in
+					// between, so it replaces the provisional sample
+					m_RestoreState(m_provisional_state);
+					if (!m_AddPoint(ts_value.time, value_to_write, m_first_value || (uint64_t)value_to_write != m_last_value))
+					{
+						// It always fit before
+						m_AddPoint(m_provisional_timestamp, m_provisional_value, m_first_value || (uint64_t)m_provisional_value != m_last_value);
+						return false;
+					}
+					m_provisional_timestamp = ts_value.time;
+					m_provisional_value = value_to_write;
 
-				m_last_value = value_to_write;
-				// Write 1 bit signifiying that the value did change
-				if (!WriteBits(1, 1)) return false;
-				
+					m_lower_slope = std::max(m_lower_slope, (value_to_write - m_quantized_error_bound - m_anchor_value) / elapsed);
+					m_upper_slope = std::min(m_upper_slope, (value_to_write + m_quantized_error_bound - m_anchor_value) / elapsed);
+					return true;
+				}
+			}
 
+			// The door closed, so the provisional sample stays and starts the next segment
+			if (m_have_provisional)
+			{
+				m_have_provisional = false;
+				m_anchor_time = TimestampToPrecision(m_provisional_timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+				m_anchor_value = m_provisional_value;
+			}
 
-				if (!WriteBits(value_to_write, m_bit_size)) return false;
+			// Nothing can be drawn to a sample that isn't after the anchor, it starts a new segment
+			if (timestamp_to_precision <= m_anchor_time)
+			{
+				if (!m_AddPoint(ts_value.time, value_to_write, (uint64_t)value_to_write != m_last_value)) return false;
+				m_anchor_time = timestamp_to_precision;
+				m_anchor_value = value_to_write;
+				return true;
 			}
+			return m_AddProvisional(ts_value.time, value_to_write);
+		}
+		bool SwingDoorWriteBuffer::m_AddProvisional(uint64_t timestamp, int64_t value_to_write)
+		{
+			m_SaveState(&m_provisional_state);
+			if (!m_AddPoint(timestamp, value_to_write, (uint64_t)value_to_write != m_last_value)) return false;
+
+			m_have_provisional = true;
+			m_provisional_timestamp = timestamp;
+			m_provisional_value = value_to_write;
+
+			// The door starts out as wide as the bound around this one sample
+			uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+			double elapsed = (double)(timestamp_to_precision - m_anchor_time);
+			m_lower_slope = (value_to_write - m_quantized_error_bound - m_anchor_value) / elapsed;
+			m_upper_slope = (value_to_write + m_quantized_error_bound - m_anchor_value) / elapsed;
 			return true;
 		}
-		bool SingleTimeSeriesWriteBuffer::AddValues(std::vector<SingleTimeSeriesValue> values, size_t *values_added)
+		bool SwingDoorWriteBuffer::AddValues(const std::vector<SingleTimeSeriesValue> &values, size_t *values_added)
+		{
+			return AddValues(values.data(), values.size(), values_added);
+		}
+		bool SwingDoorWriteBuffer::AddValues(const SingleTimeSeriesValue *values, size_t count, size_t *values_added)
 		{
 			if (!values_added)
 			{
 				return false;
 			}
 
+			// Every sample depends on the ones before it, so there is no batch path
 			*values_added = 0;
-			for (auto &&value : values)
+			for (size_t i = 0; i < count; i++)
 			{
-				if (!AddValue(value))
+				if (!AddValue(values[i]))
 				{
 					return false;
 				}
-				else
-				{
-					*values_added += 1;
-				}
+				*values_added += 1;
 			}
 			return true;
 		}
 
-				
 		MultipleTimeSeriesWriteBuffer::MultipleTimeSeriesWriteBuffer(const int time_precision_nanoseconds_pow, std::vector<ValueTypeDefinition> definitions,  size_t size) :
 			WriteByteBuffer(size), m_last_data_type_id(0), m_first_time(true), m_definitions(definitions), m_time_precision_nanoseconds_pow(time_precision_nanoseconds_pow)
 		{
@@ -397,18 +1853,46 @@ namespace oscill {
 			// 10 nanoseconds in which case I would only divide by 10
 			m_time_precision_divisor = (uint64_t)pow(10, m_time_precision_nanoseconds_pow);
 		}
-		bool MultipleTimeSeriesWriteBuffer::mInit()
+		bool MultipleTimeSeriesWriteBuffer::SetSchemaRegistry(SchemaRegistry &registry)
 		{
-			// Write out the version used, major first then minor ( each 4 bits )
-			if (!WriteBits((uint64_t)OSCILLIO_TIME_COMPRESS_MAJOR_VERISON, 4)) return false;
-			if (!WriteBits((uint64_t)OSCILLIO_TIME_COMPRESS_MINOR_VERSION, 4)) return false;
-		
-			// Write out our time precision 
-			if (!WriteBits((uint64_t)m_time_precision_nanoseconds_pow, 8)) return false;
+			if (!m_first_time || m_definitions.empty()) return false;
+			if (!registry.Register(m_definitions, &m_schema_id)) return false;
+			m_flags |= FormatFlags::k_schema_reference;
+			return true;
+		}
+		bool MultipleTimeSeriesWriteBuffer::SetChecksum()
+		{
+			if (!m_first_time) return false;
+			if (!ReserveChecksum()) return false;
+			m_flags |= FormatFlags::k_checksum;
+			return true;
+		}
+		bool MultipleTimeSeriesWriteBuffer::SetRegularInterval(uint64_t period_nanoseconds)
+		{
+			// The layout can't change once the header has been written
+			if (!m_first_time) return false;
 
-			// Write out the nature of the data in the fule ( periodic vs aperiodic )
-			if (!WriteBits((uint64_t)0, 16)) return false;
+			// Runs rely on the per row timestamp bits
+			if (m_flags & FormatFlags::k_run_length) return false;
+
+			uint64_t period = period_nanoseconds / m_time_precision_divisor;
+			if (period == 0) return false;
+
+			m_flags |= FormatFlags::k_regular_interval;
+			m_regular.period = period;
+			return true;
+		}
+		bool MultipleTimeSeriesWriteBuffer::SetRunLengthEncoding()
+		{
+			if (!m_first_time) return false;
+			if (m_flags & FormatFlags::k_regular_interval) return false;
 
+			m_flags |= FormatFlags::k_run_length;
+			m_run_length.threshold = RunLengthThreshold(1 + (int)m_definitions.size());
+			return true;
+		}
+		bool MultipleTimeSeriesWriteBuffer::mWriteDefinitions()
+		{
 			// See how many bits our label ID needs to be
 			int label_bit_size = NumberOfBits(m_definitions.size() - 1, 0);
 
@@ -421,12 +1905,7 @@ namespace oscill {
 			// Write the information for each value type out in the header
 			for ( auto &&value_def : m_definitions)
 			{
-				ValueMetrics to_add;
-				to_add.definition = value_def;
-				to_add.id = m_last_data_type_id;
-				to_add.precise_max = (int64_t)((to_add.definition.max)* pow(10, to_add.definition.precision_decimal_places));
-				to_add.precise_min = (int64_t)((to_add.definition.min)* pow(10, to_add.definition.precision_decimal_places));
-				to_add.m_bit_size = NumberOfBits(to_add.precise_max, to_add.precise_min);
+				const ValueMetrics &to_add = mAddMetrics(value_def);
 
 				//TODO - Scrub the label of any newline characters. 
 				//TODO - Support not just UTF_8
@@ -437,9 +1916,9 @@ namespace oscill {
 				{
 					// TODO - Use a standard string encoding such that we never have to rely
 					// on cross systems having the same char size ( shoudl always be 8 )
-					if (!WriteBits((uint64_t)current_label[i], sizeof(char))) return false;
+					if (!WriteBits((uint64_t)(uint8_t)current_label[i], sizeof(char) * 8)) return false;
 				}
-				if (!WriteBits((uint64_t)'\n', sizeof(char))) return false;
+				if (!WriteBits((uint64_t)'\n', sizeof(char) * 8)) return false;
 
 				// Pad out to 32-bits
 				int mod_32 = (value_def.label.size()+1) % 4;
@@ -450,17 +1929,87 @@ namespace oscill {
 
 				// Write out the definition into the buffer header
 				if (!WriteBits((uint64_t)to_add.definition.precision_decimal_places, 32)) return false;
-				if (!WriteBits((uint64_t)to_add.definition.max, 64)) return false;
-				if (!WriteBits((uint64_t)to_add.definition.min, 64)) return false;
-				
-				// Update the next ID
-				m_last_data_type_id++;
+				if (!WriteBits(DoubleToBits(to_add.definition.max), 64)) return false;
+				if (!WriteBits(DoubleToBits(to_add.definition.min), 64)) return false;
+			}
+			return true;
+		}
+		const ValueMetrics &MultipleTimeSeriesWriteBuffer::mAddMetrics(const ValueTypeDefinition &value_def)
+		{
+			ValueMetrics to_add = MakeValueMetrics(value_def, m_last_data_type_id);
+
+			// Update the next ID
+			m_last_data_type_id++;
+
+			m_metrics.push_back(to_add);
+			m_label_to_metrics[to_add.definition.label] = to_add;
+			return m_metrics.back();
+		}
+		bool MultipleTimeSeriesWriteBuffer::mInit(uint64_t timestamp)
+		{
+			// Write out the version used, major first then minor ( each 4 bits )
+			if (!WriteBits((uint64_t)OSCILLIO_TIME_COMPRESS_MAJOR_VERISON, 4)) return false;
+			if (!WriteBits((uint64_t)OSCILLIO_TIME_COMPRESS_MINOR_VERSION, 4)) return false;
+		
+			// Write out our time precision 
+			if (!WriteBits((uint64_t)m_time_precision_nanoseconds_pow, 8)) return false;
+
+			// Write out the nature of the data in the fule ( periodic vs aperiodic )
+			if (!WriteBits((uint64_t)m_flags, 16)) return false;
+
+			// Registered definitions are just referred to, everything else is the same
+			if (m_flags & FormatFlags::k_schema_reference)
+			{
+				if (!WriteBits(m_schema_id, 32)) return false;
+				for (auto &&value_def : m_definitions) mAddMetrics(value_def);
+			}
+			else
+			{
+				if (!mWriteDefinitions()) return false;
+			}
+
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				// Start time and period, followed by the row and exception counts which
+				// are updated in place as rows are added
+				m_regular.start_time = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+				m_regular.anchor_time = m_regular.start_time;
+				m_regular.anchor_index = 0;
+				if (!WriteBits(m_regular.start_time, 64)) return false;
+				if (!WriteBits(m_regular.period, 64)) return false;
+				m_regular.count_bit_offset = BitPosition();
+				if (!WriteBits(0, 32)) return false;
+				if (!WriteBits(0, 32)) return false;
+			}
+			return true;
+		}
+		bool MultipleTimeSeriesWriteBuffer::mAddRegularTimeStamp(uint64_t timestamp, bool first)
+		{
+			uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
 
-				m_metrics.push_back(to_add);
-				m_label_to_metrics[to_add.definition.label] = to_add;
+			// The first row is the start time stored in the header
+			if (!first)
+			{
+				uint64_t expected = m_regular.anchor_time + (m_regular.count - m_regular.anchor_index) * m_regular.period;
+				if (timestamp_to_precision != expected)
+				{
+					// Missed or late row.  Record it at the end of the buffer and move the grid
+					// so that the following rows are relative to it
+					if (!ReserveTrailingBits(RegularIntervalMetrics::k_exception_size)) return false;
+					size_t exception_offset = TrailerEnd() - (size_t)(m_regular.exception_count + 1) * RegularIntervalMetrics::k_exception_size;
+					if (!WriteBitsAt(exception_offset, m_regular.count, 32)) return false;
+					if (!WriteBitsAt(exception_offset + 32, timestamp_to_precision, 64)) return false;
+
+					m_regular.exception_count++;
+					if (!WriteBitsAt(m_regular.count_bit_offset + 32, m_regular.exception_count, 32)) return false;
+
+					m_regular.anchor_index = m_regular.count;
+					m_regular.anchor_time = timestamp_to_precision;
+				}
 			}
+			m_previous_timestamp = timestamp_to_precision;
 			return true;
-		}	
+		}
 		bool MultipleTimeSeriesWriteBuffer::mAddTimeStamp(uint64_t timestamp, bool first)
 		{
 			// Slight variation on Facebook's Gorilla method.  Accounts
@@ -481,32 +2030,7 @@ namespace oscill {
 			// round to the closest value
 
 			// Convert the time to an appropriate value based upon our specified timestamp precision
-			uint64_t timestamp_to_precision = 0;
-			timestamp_to_precision = timestamp / m_time_precision_divisor;
-
-			// Do our own rounding.  Rounding messes up at bounds of an uint64_t.  We also want to ensure that 
-			// we are round up to the nearest second instead of truncating.  If we care about time stamp precision to 
-			// the second, 1.999 is most likey 2 seconds with some jitter than it is 1 seconds with a lot of jitter.  In 
-			// the future we could make this tolerance configurable.
-			if (m_time_precision_nanoseconds_pow != 0)
-			{
-				uint64_t timestamp_to_more_precision = timestamp / (uint64_t)pow(10, m_time_precision_nanoseconds_pow - 1);
-				if (timestamp_to_precision != 0)
-				{
-					uint64_t time_fraction = timestamp_to_more_precision % timestamp_to_precision;
-					if (time_fraction >= 5)
-					{
-						timestamp_to_precision++;
-					}
-				}
-				else
-				{
-					if (timestamp_to_more_precision >= 5)
-					{
-						timestamp_to_precision++;
-					}
-				}
-			}
+			uint64_t timestamp_to_precision = TimestampToPrecision(timestamp, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
 
 			if (first)
 			{	
@@ -546,7 +2070,11 @@ namespace oscill {
 						if (!WriteBits(k_full_timestamp, 5)) return false;
 						// Write the full 64-bit timestamp
 						if (!WriteBits(timestamp_to_precision, k_timestamp_size)) return false;
-						break;
+
+						// The reader goes back to the default delta after a full timestamp
+						m_previous_timestamp = timestamp_to_precision;
+						m_previous_delta = k_default_delta;
+						return true;
 					}
 					if (abs_delta_of_delta <= timestamp_encoding_info[i].max_delta)
 					{
@@ -574,9 +2102,9 @@ namespace oscill {
 			m_previous_delta = delta;
 			return true;
 		}
-		bool MultipleTimeSeriesWriteBuffer::mAddValue(ValueMetrics metrics, double value)
+		int64_t MultipleTimeSeriesWriteBuffer::mQuantizeValue(const ValueMetrics &metrics, double value)
 		{
-						// If we are above the maximum, set it to the maximum.
+			// If we are above the maximum, set it to the maximum.
 			if (value > metrics.definition.max)
 			{
 				value = metrics.definition.max;
@@ -588,7 +2116,11 @@ namespace oscill {
 			}
 			// Get binary representation with the designated precision / precsion
 			int64_t value_to_write = (int64_t)((value) * pow(10,metrics.definition.precision_decimal_places));
-			value_to_write -= metrics.precise_min;
+			return value_to_write - metrics.precise_min;
+		}
+		bool MultipleTimeSeriesWriteBuffer::mAddValue(ValueMetrics &metrics, double value)
+		{
+			int64_t value_to_write = mQuantizeValue(metrics, value);
 
 			if (metrics.first_value)
 			{
@@ -624,25 +2156,235 @@ namespace oscill {
 				
 
 
-				if (!WriteBits(value_to_write, metrics.m_bit_size)) return false;
+				if (!WriteBits(value_to_write, metrics.m_bit_size)) return false;
+			}
+			return true;
+			return true;
+		}
+		bool MultipleTimeSeriesWriteBuffer::AddValue(LabeledTimeSeriesValues ts_value)
+		{
+			// If this is periodic, check to make sure we have a full row
+			if ( ts_value.labeled_values.size() != m_definitions.size())
+			{
+				return false;
+			}
+			if (m_sealed) return false;
+
+			// A row that doesn't fit is taken back out, so the buffer always ends with a
+			// complete row
+			EncoderState state;
+			mSaveState(&state);
+			if (mEncodeRow(ts_value)) return true;
+
+			mRestoreState(state);
+			return false;
+		}
+		void MultipleTimeSeriesWriteBuffer::mSaveState(EncoderState *state)
+		{
+			state->checkpoint = GetCheckpoint();
+			state->previous_timestamp = m_previous_timestamp;
+			state->previous_delta = m_previous_delta;
+			state->first_time = m_first_time;
+			state->regular = m_regular;
+			state->run_length = m_run_length;
+
+			m_saved_last_values.resize(m_metrics.size());
+			for (size_t i = 0; i < m_metrics.size(); i++)
+			{
+				m_saved_last_values[i] = m_metrics[i].m_last_value;
+			}
+		}
+		void MultipleTimeSeriesWriteBuffer::mRestoreState(const EncoderState &state)
+		{
+			Rollback(state.checkpoint);
+			m_previous_timestamp = state.previous_timestamp;
+			m_previous_delta = state.previous_delta;
+			m_first_time = state.first_time;
+			m_regular = state.regular;
+			m_run_length = state.run_length;
+
+			if (m_first_time)
+			{
+				// The header went too, so start the columns over
+				m_metrics.clear();
+				m_label_to_metrics.clear();
+				m_last_data_type_id = 0;
+				return;
+			}
+
+			for (size_t i = 0; i < m_metrics.size(); i++)
+			{
+				m_metrics[i].m_last_value = m_saved_last_values[i];
+			}
+
+			// The counts in the header are written in place, so they may be ahead
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				WriteBitsAt(m_regular.count_bit_offset, m_regular.count, 32);
+				WriteBitsAt(m_regular.count_bit_offset + 32, m_regular.exception_count, 32);
+			}
+		}
+		size_t MultipleTimeSeriesWriteBuffer::Seal()
+		{
+			// Regular interval exceptions live at the end of the buffer
+			size_t trailing_bits = 0;
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				trailing_bits = (size_t)m_regular.exception_count * RegularIntervalMetrics::k_exception_size;
+			}
+			return SealWithTrailer(trailing_bits);
+		}
+		int64_t MultipleTimeSeriesWriteBuffer::EstimateBits(const std::vector<LabeledTimeSeriesValues> &values)
+		{
+			// Make the same decisions as adding the rows would on copies of the encoder state,
+			// but only count the bits
+			uint64_t previous_timestamp = m_previous_timestamp;
+			uint64_t previous_delta = m_previous_delta;
+			bool first = m_first_time;
+			RegularIntervalMetrics regular = m_regular;
+			RunLengthMetrics run_length = m_run_length;
+			std::vector<ValueMetrics> metrics = m_metrics;
+			int64_t bits = 0;
+
+			if (first)
+			{
+				metrics.clear();
+				for (size_t i = 0; i < m_definitions.size(); i++)
+				{
+					metrics.push_back(MakeValueMetrics(m_definitions[i], (int)i));
+				}
+			}
+
+			std::vector<int64_t> row_values(metrics.size());
+			for (auto &&row : values)
+			{
+				if (row.labeled_values.size() != metrics.size()) break;
+
+				uint64_t timestamp_to_precision = TimestampToPrecision(row.time, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+				bool changed = first;
+				for (size_t i = 0; i < metrics.size(); i++)
+				{
+					row_values[i] = mQuantizeValue(metrics[i], row.labeled_values[i].second);
+					changed = changed || (uint64_t)row_values[i] != metrics[i].m_last_value;
+				}
+
+				if (first && (m_flags & FormatFlags::k_schema_reference))
+				{
+					// Version, precision, flags and the schema id
+					bits += 4 + 4 + 8 + 16 + 32;
+				}
+				else if (first)
+				{
+					// Version, precision, flags, label size and column count, then each column
+					bits += 4 + 4 + 8 + 16 + 32 + 32;
+					for (auto &&definition : m_definitions)
+					{
+						size_t label_bytes = definition.label.size() + 1;
+						bits += (label_bytes + label_bytes % 4) * 8 + 32 + 64 + 64;
+					}
+				}
+				if (first && (m_flags & FormatFlags::k_regular_interval))
+				{
+					// Either header layout ends with the start time, period and counts
+					bits += 64 + 64 + 32 + 32;
+					regular.start_time = regular.anchor_time = timestamp_to_precision;
+					regular.anchor_index = 0;
+				}
+
+				if ((m_flags & FormatFlags::k_run_length) && !first)
+				{
+					if (timestamp_to_precision - previous_timestamp == previous_delta && !changed)
+					{
+						bits += CountIdleSample(run_length, 1 + (int)metrics.size());
+						previous_timestamp = timestamp_to_precision;
+						continue;
+					}
+					run_length.idle_count = 0;
+					run_length.length = 0;
+				}
+
+				if (m_flags & FormatFlags::k_regular_interval)
+				{
+					if (!first && timestamp_to_precision != regular.anchor_time + (regular.count - regular.anchor_index) * regular.period)
+					{
+						bits += RegularIntervalMetrics::k_exception_size;
+						regular.anchor_index = regular.count;
+						regular.anchor_time = timestamp_to_precision;
+					}
+					regular.count++;
+				}
+				else
+				{
+					int64_t delta = timestamp_to_precision - previous_timestamp;
+					int64_t delta_of_delta = delta - previous_delta;
+					uint64_t field = 0;
+					int field_bits = 0;
+					if (!first && delta_of_delta == 0)
+					{
+						bits += 1;
+						previous_delta = delta;
+					}
+					else if (!first && EncodeDeltaOfDelta(delta_of_delta, &field, &field_bits))
+					{
+						bits += field_bits;
+						previous_delta = delta;
+					}
+					else
+					{
+						bits += 5 + k_timestamp_size;
+						previous_delta = k_default_delta;
+					}
+				}
+				previous_timestamp = timestamp_to_precision;
+
+				for (size_t i = 0; i < metrics.size(); i++)
+				{
+					bits += 1;
+					if (first || (uint64_t)row_values[i] != metrics[i].m_last_value)
+					{
+						bits += metrics[i].m_bit_size;
+						metrics[i].m_last_value = row_values[i];
+					}
+				}
+				first = false;
 			}
-			return true;
-			return true;
+			return bits;
 		}
-		bool MultipleTimeSeriesWriteBuffer::AddValue(LabeledTimeSeriesValues ts_value)
+		bool MultipleTimeSeriesWriteBuffer::mEncodeRow(const LabeledTimeSeriesValues &ts_value)
 		{
-			// If this is periodic, check to make sure we have a full row
-			if ( ts_value.labeled_values.size() != m_definitions.size())
+			if (m_first_time) 
 			{
-				return false;
+				if (!mInit(ts_value.time)) return false;
 			}
 
-			if (m_first_time) 
+			if ((m_flags & FormatFlags::k_run_length) && !m_first_time)
 			{
-				if (!mInit()) return false;
+				uint64_t timestamp_to_precision = TimestampToPrecision(ts_value.time, m_time_precision_nanoseconds_pow, m_time_precision_divisor);
+				bool idle = (timestamp_to_precision - m_previous_timestamp == m_previous_delta);
+				for (size_t i = 0; idle && i < m_metrics.size(); i++)
+				{
+					idle = ((uint64_t)mQuantizeValue(m_metrics[i], ts_value.labeled_values[i].second) == m_metrics[i].m_last_value);
+				}
+				if (idle)
+				{
+					if (!WriteIdleSample(*this, m_run_length, 1 + (int)m_metrics.size())) return false;
+					m_previous_timestamp = timestamp_to_precision;
+					return true;
+				}
+
+				// Anything else ends the run
+				m_run_length.idle_count = 0;
+				m_run_length.length = 0;
 			}
 
-			if (!mAddTimeStamp(ts_value.time, m_first_time)) return false;
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				if (!mAddRegularTimeStamp(ts_value.time, m_first_time)) return false;
+			}
+			else
+			{
+				if (!mAddTimeStamp(ts_value.time, m_first_time)) return false;
+			}
 
 			// Write each value
 			for (int i = 0; i < ts_value.labeled_values.size(); i++)
@@ -650,10 +2392,17 @@ namespace oscill {
 				// Write the value
 				if (!mAddValue(m_metrics[i], ts_value.labeled_values[i].second)) return false;
 			}
+
+			// Keep the row count in the header current so the buffer can be read at any time
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				m_regular.count++;
+				if (!WriteBitsAt(m_regular.count_bit_offset, m_regular.count, 32)) return false;
+			}
 			m_first_time = false;
 			return true;
 		}
-		bool MultipleTimeSeriesWriteBuffer::AddValues(std::vector<LabeledTimeSeriesValues> values, size_t *values_added)
+		bool MultipleTimeSeriesWriteBuffer::AddValues(const std::vector<LabeledTimeSeriesValues> &values, size_t *values_added)
 		{
 			if (!values_added)
 			{
@@ -676,6 +2425,22 @@ namespace oscill {
 		}
 
 
+		std::unique_ptr<MultipleTimeSeriesReadBuffer> MultipleTimeSeriesReadBuffer::NewCursor()
+		{
+			std::unique_ptr<MultipleTimeSeriesReadBuffer> cursor(new MultipleTimeSeriesReadBuffer());
+			cursor->ViewOf(*this);
+			cursor->m_registry = m_registry;
+			return cursor;
+		}
+		bool MultipleTimeSeriesReadBuffer::VerifyChecksum()
+		{
+			if (m_first_time)
+			{
+				if (!mInit()) return false;
+				m_first_time = false;
+			}
+			return ChecksumMatches();
+		}
 		bool MultipleTimeSeriesReadBuffer::ReadNext(LabeledTimeSeriesValues *ts_value)
 		{
 			if ( m_first_time )
@@ -684,9 +2449,52 @@ namespace oscill {
 			}
 			m_first_time = false;
 
+			// Inside of a run there is nothing to read, the delta and values stay the same
+			if (m_run_length.remaining > 0)
+			{
+				m_run_length.remaining--;
+				m_time_metrics.previous_timestamp = m_time_metrics.previous_timestamp + m_time_metrics.previous_delta;
+				ts_value->time = m_time_metrics.previous_timestamp * m_time_metrics.time_precision_divisor;
+				m_RepeatLastValue(&ts_value->labeled_values);
+				m_index++;
+				return true;
+			}
+
 			if (!m_ReadNextTime(&ts_value->time)) return false;
-			if (!m_ReadNextValue(&ts_value->labeled_values)) return false;
+			if (m_run_length.remaining > 0)
+			{
+				// This row started a run
+				m_run_length.remaining--;
+				m_RepeatLastValue(&ts_value->labeled_values);
+			}
+			else
+			{
+				if (!m_ReadNextValue(&ts_value->labeled_values)) return false;
+			}
+			m_index++;
+
+			return true;
+		}
+		void MultipleTimeSeriesReadBuffer::m_RepeatLastValue(std::vector<labeled_value> *value)
+		{
+			value->resize(m_metrics.size());
+			for (size_t i = 0; i < m_metrics.size(); i++)
+			{
+				(*value)[i].first = m_metrics[i].definition.label;
+				(*value)[i].second = ((((int64_t)m_metrics[i].m_last_value + m_metrics[i].precise_min)) / pow(10,m_metrics[i].definition.precision_decimal_places));
+			}
+		}
+		bool MultipleTimeSeriesReadBuffer::GenerateTimes(size_t first, size_t num, uint64_t *times)
+		{
+			if (m_first_time)
+			{
+				if (!mInit()) return false;
+				m_first_time = false;
+			}
+			if (!(m_flags & FormatFlags::k_regular_interval)) return false;
+			if (first + num > m_regular.count) return false;
 
+			m_regular.GenerateTimes(first, num, m_time_metrics.time_precision_divisor, times);
 			return true;
 		}
 		bool MultipleTimeSeriesReadBuffer::m_ReadNextValue(std::vector<labeled_value> *value)
@@ -694,6 +2502,7 @@ namespace oscill {
 			if (!value) return false;
 
 			uint64_t bit_value = 0;
+			value->resize(m_metrics.size());
 
 			// We are making the assumption here that the file is not corrupt and that 
 			// we will be reading in N values where N is the number of data types specified
@@ -715,9 +2524,9 @@ namespace oscill {
 				{
 					if (!ReadNextBits(&bit_value, m_metrics[i].m_bit_size)) return false;
 					
-					m_metrics[i].m_last_value = ((((int64_t)bit_value + m_metrics[i].precise_min)) / pow(10,m_metrics[i].definition.precision_decimal_places));
+					m_metrics[i].m_last_value = bit_value;
 				}
-				(*value)[i].second = m_metrics[i].m_last_value;
+				(*value)[i].second = ((((int64_t)m_metrics[i].m_last_value + m_metrics[i].precise_min)) / pow(10,m_metrics[i].definition.precision_decimal_places));
 			}
 
 			return true;
@@ -726,27 +2535,23 @@ namespace oscill {
 		{
 			uint64_t bit_value = 0;
 
-			// Read number of ones to determine the size of the delta of the 
-			// time delta
-			int num_ones = 0;
-		
-			if (!ReadNextBits(&bit_value, 1)) return false;
-
-			// If the next bit is 0, then 
-			if ( bit_value == 0)
+			// Regular interval buffers have no per row timestamp bits at all
+			if (m_flags & FormatFlags::k_regular_interval)
 			{
-				m_time_metrics.previous_timestamp = m_time_metrics.previous_timestamp + m_time_metrics.previous_delta;
+				if (m_index >= m_regular.count) return false;
+				m_regular.GenerateTimes(m_index, 1, m_time_metrics.time_precision_divisor, time);
+				return true;
 			}
-			else
+
+			// Resolve the control code along with its sign and magnitude in one step
+			TimestampCode code;
+			if (!ReadTimestampCode(*this, &code)) return false;
+			int num_ones = code.num_ones;
+
+			// A single 0 means the delta didn't change
+			if ( num_ones == 0)
 			{
-				num_ones = 1;
-				while (num_ones < 5) {
-					if (!ReadNextBits(&bit_value, 1)) return false;
-					if (bit_value == 0) {
-						break;
-					}
-					num_ones++;
-				}
+				m_time_metrics.previous_timestamp = m_time_metrics.previous_timestamp + m_time_metrics.previous_delta;
 			}
 
 			// Get the bits to read and the 
@@ -765,16 +2570,20 @@ namespace oscill {
 					return true;
 				}
 
-				// Read the number of bits based off of the pattern
-				bool sign_bit = false;
-				// Read the sign bit
-				if (!ReadNextBits(&bit_value, 1)) return false;
-				if (bit_value == 1)
-					sign_bit = true;
+				bool sign_bit = code.sign;
+				int index = num_ones - 1;
+				bit_value = code.magnitude;
 
+				// A positive zero can only be a run token.  The run starts with this row
+				if ((m_flags & FormatFlags::k_run_length) && index == 0 && !sign_bit && bit_value == 0)
+				{
+					if (!ReadNextBits(&bit_value, RunLengthMetrics::k_length_size)) return false;
+					m_run_length.remaining = (uint32_t)bit_value;
+					m_time_metrics.previous_timestamp = m_time_metrics.previous_timestamp + m_time_metrics.previous_delta;
+					*time = m_time_metrics.previous_timestamp * m_time_metrics.time_precision_divisor;
+					return true;
+				}
 
-				int index = num_ones - 1;
-				if (!ReadNextBits(&bit_value, timestamp_encoding_info[index].delta_size - 1)) return false;
 				// [0,255] becomes [-128,127]
 				int64_t encoded_delta_of_delta = (int64_t)bit_value;// -((int64_t)1 << (timestamp_encoding_info[index].delta_size - 1));
 				
@@ -782,125 +2591,414 @@ namespace oscill {
 				{
 					encoded_delta_of_delta = encoded_delta_of_delta * -1;
 				}
-
-				// [-128,127] becomes [-128,128] without the middle zero ( remembmer when we added it?)			
-				encoded_delta_of_delta++;
-				m_time_metrics.previous_delta = m_time_metrics.previous_delta + encoded_delta_of_delta;
-				m_time_metrics.previous_timestamp = m_time_metrics.previous_timestamp + m_time_metrics.previous_delta;
+
+				// [-128,127] becomes [-128,128] without the middle zero ( remembmer when we added it?)			
+				encoded_delta_of_delta++;
+				m_time_metrics.previous_delta = m_time_metrics.previous_delta + encoded_delta_of_delta;
+				m_time_metrics.previous_timestamp = m_time_metrics.previous_timestamp + m_time_metrics.previous_delta;
+			}
+
+			// Convert to the full time stamp using the specified time resolution
+			*time = m_time_metrics.previous_timestamp * m_time_metrics.time_precision_divisor;
+
+			return true;
+		}
+		uint32_t SchemaRegistry::SchemaId(const std::vector<ValueTypeDefinition> &definitions)
+		{
+			// FNV-1a over everything the header would have had
+			uint32_t hash = 2166136261u;
+			auto add_bytes = [&hash](const void *data, size_t size)
+			{
+				const uint8_t *bytes = (const uint8_t *)data;
+				for (size_t i = 0; i < size; i++)
+				{
+					hash = (hash ^ bytes[i]) * 16777619u;
+				}
+			};
+			for (auto &&definition : definitions)
+			{
+				add_bytes(definition.label.c_str(), definition.label.size() + 1);
+				uint32_t precision = (uint32_t)definition.precision_decimal_places;
+				uint64_t max = DoubleToBits(definition.max);
+				uint64_t min = DoubleToBits(definition.min);
+				add_bytes(&precision, sizeof(precision));
+				add_bytes(&max, sizeof(max));
+				add_bytes(&min, sizeof(min));
+			}
+			return hash;
+		}
+		static bool SameDefinitions(const std::vector<ValueTypeDefinition> &a, const std::vector<ValueTypeDefinition> &b)
+		{
+			if (a.size() != b.size()) return false;
+			for (size_t i = 0; i < a.size(); i++)
+			{
+				if (a[i].label != b[i].label || a[i].precision_decimal_places != b[i].precision_decimal_places) return false;
+				if (DoubleToBits(a[i].max) != DoubleToBits(b[i].max) || DoubleToBits(a[i].min) != DoubleToBits(b[i].min)) return false;
+			}
+			return true;
+		}
+		bool SchemaRegistry::Register(const std::vector<ValueTypeDefinition> &definitions, uint32_t *schema_id)
+		{
+			if (!schema_id) return false;
+			uint32_t id = SchemaId(definitions);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto found = m_schemas.find(id);
+			if (found != m_schemas.end())
+			{
+				if (!SameDefinitions(found->second, definitions)) return false;
+			}
+			else
+			{
+				m_schemas[id] = definitions;
+			}
+			*schema_id = id;
+			return true;
+		}
+		bool SchemaRegistry::Find(uint32_t schema_id, std::vector<ValueTypeDefinition> *definitions)
+		{
+			if (!definitions) return false;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto found = m_schemas.find(schema_id);
+			if (found == m_schemas.end()) return false;
+			*definitions = found->second;
+			return true;
+		}
+		size_t SchemaRegistry::Count()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_schemas.size();
+		}
+
+		bool MultipleTimeSeriesReadBuffer::mReadDefinitions()
+		{
+			uint64_t bits_read = 0;
+
+			// Read in the size of our data type label
+			if (!ReadNextBits(&bits_read, 32)) return false;
+			m_data_type_label_size = (int)bits_read;
+
+			// Read in the number of data types
+			if (!ReadNextBits(&bits_read, 32)) return false;
+			m_metrics = std::vector<ValueMetrics>(bits_read);
+
+			for ( int i = 0; i < m_metrics.size(); i++)
+			{
+				ValueMetrics to_add;
+				to_add.m_bit_size = to_add.m_last_value = to_add.precise_max = to_add.precise_min = 0;
+				to_add.first_value = true;
+				
+				// Give the next char read a default value that's not '\n';
+				char next_read = 'A';
+
+				// Read in the label.  This will be terminated by a newline.
+				while ( next_read != '\n')
+				{
+					// Read in the next character of the label
+					if (!ReadNextBits(&bits_read, sizeof(char) * 8)) return false;
+					next_read = (char)bits_read;
+					if (next_read != '\n')
+					{
+						to_add.definition.label.push_back(next_read);
+					}
+				}
+
+				// Read in the remaining padding to 32-bit boundary
+				// Pad out to 32-bits
+				int mod_32 = (to_add.definition.label.size() + 1) % 4;
+				if ( mod_32 != 0 )
+				{
+					if (!ReadNextBits(&bits_read, mod_32 * 8)) return false;
+					if ( bits_read != 0)
+					{
+						// TODO - Report an error
+						return false;
+					}
+				}
+
+				// The ID will always be the index of the 
+				to_add.id = m_last_data_type_id;
+				m_last_data_type_id++;
+
+				// Read in the metadata about this data value
+				if (!ReadNextBits(&bits_read, 32)) return false;
+				to_add.definition.precision_decimal_places = (int)bits_read;
+
+				if (!ReadNextBits(&bits_read, 64)) return false;
+				to_add.definition.max = BitsToDouble(bits_read);
+
+				if (!ReadNextBits(&bits_read, 64)) return false;
+				to_add.definition.min = BitsToDouble(bits_read);
+
+				// Compute the internally used information from the read metadata
+				to_add.precise_max = (int64_t)((to_add.definition.max)* pow(10, to_add.definition.precision_decimal_places));
+				to_add.precise_min = (int64_t)((to_add.definition.min)* pow(10, to_add.definition.precision_decimal_places));
+				to_add.m_bit_size = NumberOfBits(to_add.precise_max, to_add.precise_min);
+				m_metrics[i] = to_add;
+			}
+			return true;
+		}
+		bool MultipleTimeSeriesReadBuffer::mInit()
+		{
+			// Placeholder for whenever we read
+			uint64_t bits_read = 0;
+
+			// Read the major and minor version, validate that they are as expected
+			if (!ReadNextBits(&bits_read, 4)) return false;
+			if ( bits_read != OSCILLIO_TIME_COMPRESS_MAJOR_VERISON) return false;
+
+			if (!ReadNextBits(&bits_read, 4)) return false;
+			if ( bits_read != OSCILLIO_TIME_COMPRESS_MINOR_VERSION) return false;
+
+			// Read in our time precision
+			if (!ReadNextBits(&bits_read, 8)) return false;
+			m_time_metrics.time_precision_nanoseconds_pow = (int)bits_read;
+			m_time_metrics.time_precision_divisor = (uint64_t)pow(10, m_time_metrics.time_precision_nanoseconds_pow);
+			
+			// Read in whether or not we 
+			if (!ReadNextBits(&bits_read, 16)) return false;
+			m_flags = (uint16_t)bits_read;
+			if (m_flags & FormatFlags::k_checksum)
+			{
+				HasChecksum();
+				if (m_verify_checksum && !ChecksumMatches())
+				{
+					m_num_bits_available = 0;
+					return false;
+				}
+			}
+
+			// The definitions may be in a registry instead
+			if (m_flags & FormatFlags::k_schema_reference)
+			{
+				if (!ReadNextBits(&bits_read, 32)) return false;
+				std::vector<ValueTypeDefinition> definitions;
+				if (!m_registry || !m_registry->Find((uint32_t)bits_read, &definitions)) return false;
+				if (definitions.empty()) return false;
+
+				m_data_type_label_size = NumberOfBits(definitions.size() - 1, 0);
+				m_metrics.clear();
+				for (auto &&definition : definitions)
+				{
+					m_metrics.push_back(MakeValueMetrics(definition, m_last_data_type_id));
+					m_last_data_type_id++;
+				}
+			}
+			else
+			{
+				if (!mReadDefinitions()) return false;
+			}
+
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				if (!ReadNextBits(&m_regular.start_time, 64)) return false;
+				if (!ReadNextBits(&m_regular.period, 64)) return false;
+				if (!ReadNextBits(&bits_read, 32)) return false;
+				m_regular.count = (uint32_t)bits_read;
+				if (!ReadNextBits(&bits_read, 32)) return false;
+				m_regular.exception_count = (uint32_t)bits_read;
+
+				// Exceptions are stored from the end of the buffer backwards in index order
+				m_regular.exceptions.resize(m_regular.exception_count);
+				for (uint32_t i = 0; i < m_regular.exception_count; i++)
+				{
+					size_t exception_offset = TrailerEnd() - (size_t)(i + 1) * RegularIntervalMetrics::k_exception_size;
+					if (!ReadBitsAt(exception_offset, &bits_read, 32)) return false;
+					m_regular.exceptions[i].index = (uint32_t)bits_read;
+					if (!ReadBitsAt(exception_offset + 32, &m_regular.exceptions[i].timestamp, 64)) return false;
+				}
+				// Don't read into them, unless the reader has already been limited to less
+				int64_t exception_start = (int64_t)TrailerEnd() - (int64_t)m_regular.exception_count * RegularIntervalMetrics::k_exception_size;
+				m_num_bits_available = std::min(m_num_bits_available, exception_start - (int64_t)BitPosition());
+			}
+			return true;
+		}
+
+		
+		bool SingleTimeSeriesReadBuffer::m_ReadHeader()
+		{
+			uint64_t bits_read = 0;
+			// A live buffer may not have anything published yet, leave the header for later
+			if (m_num_bits_available == 0) return false;
+			m_first_read = false;
+
+			// Buffers without a header start straight away with a full timestamp
+			if (!PeekBits(&bits_read, 5)) return false;
+			if (bits_read != k_extended_header) return true;
+
+			if (!ReadNextBits(&bits_read, 5)) return false;
+			if (!ReadNextBits(&bits_read, 3)) return false;
+			if (!ReadNextBits(&bits_read, 16)) return false;
+			m_flags = (uint16_t)bits_read;
+			if (m_flags & FormatFlags::k_checksum)
+			{
+				// Nothing can be read from a buffer that fails, m_first_read is already off
+				HasChecksum();
+				if (m_verify_checksum && !ChecksumMatches())
+				{
+					m_num_bits_available = 0;
+					return false;
+				}
+			}
+
+			if (m_flags & FormatFlags::k_value_codec)
+			{
+				if (!ReadNextBits(&bits_read, 8)) return false;
+				if (bits_read >= k_value_codec_count) return false;
+				m_value_codec = (ValueCodec)bits_read;
+			}
+			if (m_value_codec == k_value_dictionary)
+			{
+				if (!ReadNextBits(&bits_read, 8)) return false;
+				m_dictionary.capacity = (uint32_t)bits_read;
+				if (!ReadNextBits(&bits_read, 8)) return false;
+				if (bits_read > m_dictionary.capacity) return false;
+				m_dictionary.entries.resize(bits_read);
+				for (uint32_t i = 0; i < m_dictionary.capacity; i++)
+				{
+					if (!ReadNextBits(&bits_read, (int)m_bit_size)) return false;
+					if (i < m_dictionary.entries.size()) m_dictionary.entries[i] = bits_read;
+				}
+			}
+			if (m_flags & FormatFlags::k_swing_door)
+			{
+				if (!ReadNextBits(&bits_read, 64)) return false;
+				m_error_bound = BitsToDouble(bits_read);
+			}
+			if (m_flags & FormatFlags::k_entropy_coded)
+			{
+				uint8_t lengths[k_entropy_symbol_count];
+				for (int symbol = 0; symbol < k_entropy_symbol_count; symbol++)
+				{
+					if (!ReadNextBits(&bits_read, HuffmanCode::k_length_size)) return false;
+					lengths[symbol] = (uint8_t)bits_read;
+				}
+				if (!m_entropy_code.SetLengths(lengths, k_entropy_symbol_count)) return false;
 			}
 
-			// Convert to the full time stamp using the specified time resolution
-			*time = m_time_metrics.previous_timestamp * m_time_metrics.time_precision_divisor;
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				if (!ReadNextBits(&m_regular.start_time, 64)) return false;
+				if (!ReadNextBits(&m_regular.period, 64)) return false;
+				if (!ReadNextBits(&bits_read, 32)) return false;
+				m_regular.count = (uint32_t)bits_read;
+				if (!ReadNextBits(&bits_read, 32)) return false;
+				m_regular.exception_count = (uint32_t)bits_read;
 
+				// Exceptions are stored from the end of the buffer backwards in index order
+				m_regular.exceptions.resize(m_regular.exception_count);
+				for (uint32_t i = 0; i < m_regular.exception_count; i++)
+				{
+					size_t exception_offset = TrailerEnd() - (size_t)(i + 1) * RegularIntervalMetrics::k_exception_size;
+					if (!ReadBitsAt(exception_offset, &bits_read, 32)) return false;
+					m_regular.exceptions[i].index = (uint32_t)bits_read;
+					if (!ReadBitsAt(exception_offset + 32, &m_regular.exceptions[i].timestamp, 64)) return false;
+				}
+				// Don't read into them, unless the reader has already been limited to less
+				int64_t exception_start = (int64_t)TrailerEnd() - (int64_t)m_regular.exception_count * RegularIntervalMetrics::k_exception_size;
+				m_num_bits_available = std::min(m_num_bits_available, exception_start - (int64_t)BitPosition());
+			}
 			return true;
 		}
-		bool MultipleTimeSeriesReadBuffer::mInit()
+		bool SingleTimeSeriesReadBuffer::VerifyChecksum()
 		{
-			// Placeholder for whenever we read
-			uint64_t bits_read = 0;
-
-			// Read the major and minor version, validate that they are as expected
-			if (!ReadNextBits(&bits_read, 4)) return false;
-			if ( bits_read != OSCILLIO_TIME_COMPRESS_MAJOR_VERISON) return false;
-
-			if (!ReadNextBits(&bits_read, 4)) return false;
-			if ( bits_read != OSCILLIO_TIME_COMPRESS_MINOR_VERSION) return false;
-
-			// Read in our time precision
-			if (!ReadNextBits(&bits_read, 8)) return false;
-			m_time_metrics.time_precision_nanoseconds_pow = (int)bits_read;
-			
-			// Read in whether or not we 
-			if (!ReadNextBits(&bits_read, 16)) return false;
-
-			// Read in the size of our data type label
-			if (!ReadNextBits(&bits_read, 32)) return false;
-			m_data_type_label_size = (int)bits_read;
-
-			// Read in the number of data types
-			if (!ReadNextBits(&bits_read, 32)) return false;
-			m_metrics = std::vector<ValueMetrics>(bits_read);
-
-			for ( int i = 0; i < m_metrics.size(); i++)
+			if (m_first_read)
 			{
-				ValueMetrics to_add;
-				to_add.m_bit_size = to_add.m_last_value = to_add.precise_max = to_add.precise_min = 0;
-				to_add.first_value = true;
-				
-				// Give the next char read a default value that's not '\n';
-				char next_read = 'A';
-
-				// Read in the label.  This will be terminated by a newline.
-				while ( next_read != '\n')
+				if (!m_ReadHeader()) return false;
+			}
+			return ChecksumMatches();
+		}
+		double SingleTimeSeriesReadBuffer::ErrorBound()
+		{
+			if (m_first_read)
+			{
+				if (!m_ReadHeader()) return 0.0;
+			}
+			return m_error_bound;
+		}
+		bool SingleTimeSeriesReadBuffer::Interpolate(const uint64_t *times, size_t num, double *values)
+		{
+			if (!m_have_interpolation_points)
+			{
+				if (!ReadNext(&m_interpolation_before)) return false;
+				m_interpolation_done = !ReadNext(&m_interpolation_after);
+				if (m_interpolation_done)
 				{
-					// Read in the next character of the label
-					if (!ReadNextBits(&bits_read, sizeof(char))) return false;
-					next_read = (char)bits_read;
-					to_add.definition.label.push_back(next_read);
+					m_interpolation_after = m_interpolation_before;
 				}
+				m_have_interpolation_points = true;
+			}
 
-				// Read in the remaining padding to 32-bit boundary
-				// Pad out to 32-bits
-				int mod_32 = to_add.definition.label.size() % 4;
-				if ( mod_32 != 0 )
+			for (size_t i = 0; i < num; i++)
+			{
+				// Move forward until the time is between the two samples
+				while (!m_interpolation_done && times[i] > m_interpolation_after.time)
 				{
-					if (!ReadNextBits(&bits_read, mod_32 * 8)) return false;
-					if ( bits_read != 0)
+					SingleTimeSeriesValue next;
+					if (!ReadNext(&next))
 					{
-						// TODO - Report an error
-						return false;
+						m_interpolation_done = true;
+						break;
 					}
+					m_interpolation_before = m_interpolation_after;
+					m_interpolation_after = next;
 				}
 
-				// The ID will always be the index of the 
-				to_add.id = m_last_data_type_id;
-				m_last_data_type_id++;
-
-				// Read in the metadata about this data value
-				if (!ReadNextBits(&bits_read, 32)) return false;
-				to_add.definition.precision_decimal_places = (int)bits_read;
-
-				if (!ReadNextBits(&bits_read, 64)) return false;
-				to_add.definition.max = (double)bits_read;
-
-				if (!ReadNextBits(&bits_read, 64)) return false;
-				to_add.definition.min = (double)bits_read;
-
-				// Compute the internally used information from the read metadata
-				to_add.precise_max = (int64_t)((to_add.definition.max)* pow(10, to_add.definition.precision_decimal_places));
-				to_add.precise_min = (int64_t)((to_add.definition.min)* pow(10, to_add.definition.precision_decimal_places));
-				to_add.m_bit_size = NumberOfBits(to_add.precise_max, to_add.precise_min);
-				m_metrics[i] = to_add;
+				const SingleTimeSeriesValue &before = m_interpolation_before;
+				const SingleTimeSeriesValue &after = m_interpolation_after;
+				if (times[i] <= before.time)
+				{
+					values[i] = before.value;
+				}
+				else if (times[i] >= after.time)
+				{
+					values[i] = after.value;
+				}
+				else
+				{
+					double fraction = (double)(times[i] - before.time) / (double)(after.time - before.time);
+					values[i] = before.value + (after.value - before.value) * fraction;
+				}
 			}
 			return true;
 		}
+		bool SingleTimeSeriesReadBuffer::GenerateTimes(size_t first, size_t num, uint64_t *times)
+		{
+			if (m_first_read)
+			{
+				if (!m_ReadHeader()) return false;
+			}
+			if (!(m_flags & FormatFlags::k_regular_interval)) return false;
+			if (first + num > m_regular.count) return false;
 
-		
+			m_regular.GenerateTimes(first, num, m_time_precision_divisor, times);
+			return true;
+		}
 		bool SingleTimeSeriesReadBuffer::m_ReadNextTime(uint64_t *time)
 		{
 			uint64_t bit_value = 0;
 
-			// Read number of ones to determine the size of the delta of the 
-			// time delta
-			int num_ones = 0;
-		
-			if (!ReadNextBits(&bit_value, 1)) return false;
-
-			// If the next bit is 0, then 
-			if ( bit_value == 0)
+			// Regular interval buffers have no per sample timestamp bits at all
+			if (m_flags & FormatFlags::k_regular_interval)
 			{
-				m_previous_timestamp = m_previous_timestamp + m_previous_delta;
+				if (m_index >= m_regular.count) return false;
+				m_regular.GenerateTimes(m_index, 1, m_time_precision_divisor, time);
+				return true;
 			}
-			else
+			if (m_flags & FormatFlags::k_entropy_coded)
 			{
-				num_ones = 1;
-				while (num_ones < 5) {
-					if (!ReadNextBits(&bit_value, 1)) return false;
-					if (bit_value == 0) {
-						break;
-					}
-					num_ones++;
-				}
+				return m_ReadNextEntropyTime(time);
+			}
+
+			// Resolve the control code along with its sign and magnitude in one step
+			TimestampCode code;
+			if (!ReadTimestampCode(*this, &code)) return false;
+			int num_ones = code.num_ones;
+
+			// A single 0 means the delta didn't change
+			if ( num_ones == 0)
+			{
+				m_previous_timestamp = m_previous_timestamp + m_previous_delta;
 			}
 
 			// Get the bits to read and the 
@@ -919,16 +3017,20 @@ namespace oscill {
 					return true;
 				}
 
-				// Read the number of bits based off of the pattern
-				bool sign_bit = false;
-				// Read the sign bit
-				if (!ReadNextBits(&bit_value, 1)) return false;
-				if (bit_value == 1)
-					sign_bit = true;
+				bool sign_bit = code.sign;
+				int index = num_ones - 1;
+				bit_value = code.magnitude;
 
+				// A positive zero can only be a run token.  The run starts with this sample
+				if ((m_flags & FormatFlags::k_run_length) && index == 0 && !sign_bit && bit_value == 0)
+				{
+					if (!ReadNextBits(&bit_value, RunLengthMetrics::k_length_size)) return false;
+					m_run_length.remaining = (uint32_t)bit_value;
+					m_previous_timestamp = m_previous_timestamp + m_previous_delta;
+					*time = m_previous_timestamp * m_time_precision_divisor;
+					return true;
+				}
 
-				int index = num_ones - 1;
-				if (!ReadNextBits(&bit_value, timestamp_encoding_info[index].delta_size - 1)) return false;
 				// [0,255] becomes [-128,127]
 				int64_t encoded_delta_of_delta = (int64_t)bit_value;// -((int64_t)1 << (timestamp_encoding_info[index].delta_size - 1));
 				
@@ -948,52 +3050,393 @@ namespace oscill {
 
 			return true;
 		}
+		bool SingleTimeSeriesReadBuffer::m_ReadNextEntropyTime(uint64_t *time)
+		{
+			int symbol = 0;
+			if (!m_entropy_code.Read(*this, &symbol)) return false;
+			m_entropy_changed = (symbol & 1) != 0;
+			int time_class = symbol / 2;
+
+			if (time_class == k_entropy_full_class)
+			{
+				if (!ReadNextBits(&m_previous_timestamp, k_timestamp_size)) return false;
+				m_previous_delta = k_default_delta;
+				*time = m_previous_timestamp * m_time_precision_divisor;
+				return true;
+			}
+
+			int64_t delta_of_delta = 0;
+			if (time_class >= k_entropy_width_class)
+			{
+				// Sign and magnitude, shifted by one like the plain encoding
+				int delta_size = timestamp_encoding_info[time_class - k_entropy_width_class].delta_size;
+				uint64_t bits_read = 0;
+				if (!ReadNextBits(&bits_read, delta_size)) return false;
+				int64_t magnitude = (int64_t)(bits_read & (((uint64_t)1 << (delta_size - 1)) - 1));
+				delta_of_delta = ((bits_read >> (delta_size - 1)) ? -magnitude : magnitude) + 1;
+			}
+			else if (time_class > k_entropy_small_delta)
+			{
+				delta_of_delta = time_class - k_entropy_small_delta;
+			}
+			else if (time_class > 0)
+			{
+				delta_of_delta = time_class - k_entropy_small_delta - 1;
+			}
+
+			m_previous_delta = m_previous_delta + delta_of_delta;
+			m_previous_timestamp = m_previous_timestamp + m_previous_delta;
+			*time = m_previous_timestamp * m_time_precision_divisor;
+			return true;
+		}
 		bool SingleTimeSeriesReadBuffer::m_ReadNextValue(double *value)
 		{
 			if (!value) return false;
 
+			bool changed = false;
+			if (!m_ReadNextQuantized(&changed)) return false;
+
+			if (changed)
+			{
+				m_last_value = ((((int64_t)m_last_quantized + m_min)) / pow(10,m_decimal_places));
+			}
+			*value = m_last_value;
+			return true;
+			
+		}
+		bool SingleTimeSeriesReadBuffer::m_ReadNextQuantized(bool *changed)
+		{
 			uint64_t bit_value = 0;
 
-			// Read one bit to let us know if the value changed or not
-			if (!ReadNextBits(&bit_value, 1)) return false;
+			// Read one bit to let us know if the value changed or not.  Entropy coded buffers
+			// already had it in the symbol
+			if (m_flags & FormatFlags::k_entropy_coded)
+			{
+				*changed = m_entropy_changed;
+			}
+			else
+			{
+				if (!ReadNextBits(&bit_value, 1)) return false;
+				*changed = (bit_value != 0);
+			}
+			if (!*changed) return true;
+
+			if (!ReadChangedValue(*this, m_value_codec, m_value_state, m_dictionary, m_last_quantized, (int)m_bit_size, &bit_value)) return false;
+			m_last_quantized = bit_value;
+			return true;
+		}
+		bool SingleTimeSeriesReadBuffer::FindEqual(double value, std::vector<uint64_t> *times)
+		{
+			if (!times) return false;
+			if (m_first_read)
+			{
+				if (!m_ReadHeader()) return false;
+			}
+
+			// Quantize the value the way the writer does once, then only compare integers
+			if (value > m_full_max || value < m_full_min) return true;
+			uint64_t target = (uint64_t)((int64_t)(value * pow(10, m_decimal_places)) - m_min);
+
+			uint64_t time = 0;
+			while (m_ReadNextQuantizedPoint(&time))
+			{
+				if (m_last_quantized == target)
+				{
+					times->push_back(time);
+				}
+			}
+			return true;
+		}
+		bool SingleTimeSeriesReadBuffer::SkipTo(uint64_t time, SingleTimeSeriesValue *ts_value)
+		{
+			if (!ts_value) return false;
+			if (m_first_read)
+			{
+				if (!m_ReadHeader()) return false;
+			}
+
+			uint64_t point_time = 0;
+			do
+			{
+				if (!m_ReadNextQuantizedPoint(&point_time)) return false;
+			} while (point_time < time);
 
-			if (bit_value == 0)
+			m_last_value = (((int64_t)m_last_quantized + m_min)) / pow(10, m_decimal_places);
+			ts_value->time = point_time;
+			ts_value->value = m_last_value;
+			return true;
+		}
+		bool SingleTimeSeriesReadBuffer::m_ReadNextQuantizedPoint(uint64_t *time)
+		{
+			if (m_run_length.remaining > 0)
 			{
-				*value = m_last_value;
+				m_run_length.remaining--;
+				m_previous_timestamp = m_previous_timestamp + m_previous_delta;
+				*time = m_previous_timestamp * m_time_precision_divisor;
 			}
 			else
 			{
-				if (!ReadNextBits(&bit_value, m_bit_size)) return false;
-				
-				m_last_value = ((((int64_t)bit_value + m_min)) / pow(10,m_decimal_places));
-				*value = m_last_value;
+				if (!m_ReadNextTime(time)) return false;
+				if (m_run_length.remaining > 0)
+				{
+					m_run_length.remaining--;
+				}
+				else
+				{
+					bool changed = false;
+					if (!m_ReadNextQuantized(&changed)) return false;
+				}
 			}
+			m_index++;
+			return true;
+		}
+		std::unique_ptr<SingleTimeSeriesReadBuffer> SingleTimeSeriesReadBuffer::NewCursor()
+		{
+			std::unique_ptr<SingleTimeSeriesReadBuffer> cursor(new SingleTimeSeriesReadBuffer(m_decimal_places, m_time_precision_nanoseconds_pow, m_full_min, m_full_max));
+			cursor->ViewOf(*this);
+			return cursor;
+		}
+		SingleTimeSeriesReadBuffer::SingleTimeSeriesReadBuffer(SingleTimeSeriesWriteBuffer &write_buffer, bool in_place) :
+			SingleTimeSeries(write_buffer.m_decimal_places, write_buffer.m_time_precision_nanoseconds_pow, write_buffer.m_full_min, write_buffer.m_full_max)
+		{
+			if (in_place && write_buffer.ConcurrentReads())
+			{
+				m_live = &write_buffer;
+				m_data.AssignView((uint8_t *)write_buffer.RawData(), write_buffer.Size());
+				Refresh();
+				return;
+			}
+
+			m_size = write_buffer.Size();
+			m_num_bits_available = m_size * 8;
+			m_data.AssignZeroed(m_size);
+			memcpy(m_data.Data(), write_buffer.RawData(), m_size);
+			LimitToBits(write_buffer.BitPosition());
+		}
+		bool SingleTimeSeriesReadBuffer::Refresh()
+		{
+			if (!m_live) return false;
+
+			// Acquire pairs with the writer's release, so every byte before the last one is
+			// already there.  The last one may still be changing, so its copy is used
+			uint64_t published = m_live->m_published.load(std::memory_order_acquire);
+			size_t bits = (size_t)(published >> 8);
+			m_tail_index = bits / 8;
+			m_tail_byte = (uint8_t)published;
+			m_size = (bits + 7) / 8;
+			m_num_bits_available = (int64_t)(bits - BitPosition());
 			return true;
-			
 		}
 		bool SingleTimeSeriesReadBuffer::ReadNext(SingleTimeSeriesValue *ts_value)
 		{
+			if (m_first_read)
+			{
+				if (!m_ReadHeader()) return false;
+			}
+
+			// Inside of a run there is nothing to read, the delta and value stay the same
+			if (m_run_length.remaining > 0)
+			{
+				m_run_length.remaining--;
+				m_previous_timestamp = m_previous_timestamp + m_previous_delta;
+				ts_value->time = m_previous_timestamp * m_time_precision_divisor;
+				ts_value->value = m_last_value;
+				m_index++;
+				return true;
+			}
+
 			if (!m_ReadNextTime(&ts_value->time)) return false;
-			if (!m_ReadNextValue(&ts_value->value)) return false;
+			if (m_run_length.remaining > 0)
+			{
+				// This sample started a run
+				m_run_length.remaining--;
+				ts_value->value = m_last_value;
+			}
+			else
+			{
+				if (!m_ReadNextValue(&ts_value->value)) return false;
+			}
+			m_index++;
 			return true;
 		}
 		std::vector<SingleTimeSeriesValue> SingleTimeSeriesReadBuffer::ReadAll()
 		{
 			std::vector<SingleTimeSeriesValue> to_ret;
-			SingleTimeSeriesValue to_add;
-			while (ReadNext(&to_add))
-			{
-				to_ret.push_back(to_add);
-			}
+			ReadAll(&to_ret);
 			return to_ret;
 		}
 		void SingleTimeSeriesReadBuffer::ReadAll(std::vector<SingleTimeSeriesValue> *buffer)
 		{
+			if (m_first_read)
+			{
+				if (!m_ReadHeader()) return;
+			}
+
+			// With a regular interval we know exactly how many samples remain, so generate
+			// all of the timestamps in one go and only walk the bit stream for the values
+			if (m_flags & FormatFlags::k_regular_interval)
+			{
+				size_t remaining = m_regular.count - m_index;
+				std::vector<uint64_t> times(remaining);
+				m_regular.GenerateTimes(m_index, remaining, m_time_precision_divisor, times.data());
+
+				buffer->reserve(buffer->size() + remaining);
+				for (size_t i = 0; i < remaining; i++)
+				{
+					SingleTimeSeriesValue to_add;
+					to_add.time = times[i];
+					if (!m_ReadNextValue(&to_add.value)) return;
+					m_index++;
+					buffer->push_back(to_add);
+				}
+				return;
+			}
+
 			SingleTimeSeriesValue to_add;
 			while (ReadNext(&to_add))
 			{
 				buffer->push_back(to_add);
+
+				// Expand the rest of a run in one go
+				if (m_run_length.remaining > 0)
+				{
+					size_t run_start = buffer->size();
+					size_t run_size = m_run_length.remaining;
+					buffer->resize(run_start + run_size);
+					SingleTimeSeriesValue *run = buffer->data() + run_start;
+					for (size_t i = 0; i < run_size; i++)
+					{
+						run[i].time = (m_previous_timestamp + (i + 1) * m_previous_delta) * m_time_precision_divisor;
+						run[i].value = m_last_value;
+					}
+					m_previous_timestamp = m_previous_timestamp + run_size * m_previous_delta;
+					m_index += (uint32_t)run_size;
+					m_run_length.remaining = 0;
+				}
+			}
+		}
+
+		HeadBlock::HeadBlock(size_t chunk_size) : m_chunk_size(chunk_size)
+		{
+		}
+		bool HeadBlock::AddSchema(const SeriesSchema &schema, uint32_t *schema_id)
+		{
+			if (!schema_id || m_schemas.size() > 0xFFFF) return false;
+			if (schema.max < schema.min) return false;
+
+			// Same conversions a single series buffer makes
+			SchemaMetrics metrics;
+			metrics.definition = schema;
+			metrics.scale = pow(10, schema.precision_decimal_places);
+			metrics.precise_min = (int64_t)(schema.min * metrics.scale);
+			metrics.bit_size = NumberOfBits((int64_t)(schema.max * metrics.scale), metrics.precise_min);
+			metrics.time_precision_divisor = (uint64_t)pow(10, schema.time_precision_nanoseconds_pow);
+
+			*schema_id = (uint32_t)m_schemas.size();
+			m_schemas.push_back(metrics);
+			return true;
+		}
+		bool HeadBlock::AddSeries(uint32_t schema_id, uint32_t *series_id)
+		{
+			if (!series_id || schema_id >= m_schemas.size()) return false;
+			if (m_bit_position.size() >= 0xFFFFFFFF) return false;
+
+			// Series fill pages in order, a new page is needed every k_chunks_per_page of them
+			size_t index = m_bit_position.size();
+			if (index % k_chunks_per_page == 0)
+			{
+				std::unique_ptr<BufferStorage> page(new BufferStorage());
+				if (!page->AssignZeroed(m_chunk_size * k_chunks_per_page)) return false;
+				m_pages.push_back(std::move(page));
+			}
+
+			m_series_schema.push_back((uint16_t)schema_id);
+			m_bit_position.push_back(0);
+			m_previous_timestamp.push_back(0);
+			m_previous_delta.push_back(0);
+			m_last_value.push_back(0);
+			*series_id = (uint32_t)index;
+			return true;
+		}
+		uint8_t *HeadBlock::m_Chunk(uint32_t series_id)
+		{
+			return m_pages[series_id / k_chunks_per_page]->Data() + (series_id % k_chunks_per_page) * m_chunk_size;
+		}
+		const uint8_t *HeadBlock::SeriesData(uint32_t series_id)
+		{
+			return m_Chunk(series_id);
+		}
+		bool HeadBlock::AddValue(uint32_t series_id, SingleTimeSeriesValue ts_value)
+		{
+			if (series_id >= m_bit_position.size()) return false;
+			const SchemaMetrics &schema = m_schemas[m_series_schema[series_id]];
+
+			double value = std::min(std::max(ts_value.value, schema.definition.min), schema.definition.max);
+			uint64_t quantized = (uint64_t)((int64_t)(value * schema.scale) - schema.precise_min);
+			uint64_t timestamp = TimestampToPrecision(ts_value.time, schema.definition.time_precision_nanoseconds_pow, schema.time_precision_divisor);
+			bool first = (m_bit_position[series_id] == 0);
+
+			// Work out the whole point before writing any of it, so a point that doesn't fit
+			// leaves nothing behind.  Same choices as the plain single series encoding
+			uint64_t time_field = 0;
+			int time_bits = 0;
+			uint64_t delta = 0;
+			bool full_timestamp = false;
+			EncodePlainTime(timestamp, m_previous_timestamp[series_id], m_previous_delta[series_id], first, &time_field, &time_bits, &full_timestamp, &delta);
+
+			bool changed = first || quantized != m_last_value[series_id];
+			int value_bits = changed ? 1 + schema.bit_size : 1;
+			size_t point_bits = time_bits + (full_timestamp ? SingleTimeSeries::k_timestamp_size : 0) + value_bits;
+			if (m_bit_position[series_id] + point_bits > m_chunk_size * 8) return false;
+
+			uint8_t *chunk = m_Chunk(series_id);
+			size_t bit_position = m_bit_position[series_id];
+			const Kernels &kernels = GetKernels();
+			kernels.pack_bits(&time_field, 1, time_bits, chunk, bit_position);
+			bit_position += time_bits;
+			if (full_timestamp)
+			{
+				kernels.pack_bits(&timestamp, 1, SingleTimeSeries::k_timestamp_size, chunk, bit_position);
+				bit_position += SingleTimeSeries::k_timestamp_size;
+			}
+			uint64_t value_field = changed ? (((uint64_t)1 << schema.bit_size) | quantized) : 0;
+			if (changed && schema.bit_size == 64)
+			{
+				// The change bit doesn't fit in front of a full width value
+				uint64_t change_bit = 1;
+				kernels.pack_bits(&change_bit, 1, 1, chunk, bit_position);
+				kernels.pack_bits(&quantized, 1, 64, chunk, bit_position + 1);
+			}
+			else
+			{
+				kernels.pack_bits(&value_field, 1, value_bits, chunk, bit_position);
 			}
+			bit_position += value_bits;
+
+			m_bit_position[series_id] = (uint32_t)bit_position;
+			m_previous_timestamp[series_id] = timestamp;
+			m_previous_delta[series_id] = delta;
+			if (changed) m_last_value[series_id] = quantized;
+			return true;
+		}
+		bool HeadBlock::ReadSeries(uint32_t series_id, std::vector<SingleTimeSeriesValue> *values)
+		{
+			if (!values || series_id >= m_bit_position.size()) return false;
+			const SeriesSchema &schema = Schema(series_id);
+
+			SingleTimeSeriesReadBuffer reader(schema.precision_decimal_places, schema.time_precision_nanoseconds_pow, schema.min, schema.max, m_Chunk(series_id), m_chunk_size);
+			if (!reader.LimitToBits(m_bit_position[series_id])) return false;
+			reader.ReadAll(values);
+			return true;
+		}
+		void HeadBlock::ResetSeries(uint32_t series_id)
+		{
+			if (series_id >= m_bit_position.size()) return;
+			memset(m_Chunk(series_id), 0, m_chunk_size);
+			m_bit_position[series_id] = 0;
+			m_previous_timestamp[series_id] = 0;
+			m_previous_delta[series_id] = 0;
+			m_last_value[series_id] = 0;
 		}
 	}
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,10 +1,16 @@
 #pragma once
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <iterator>
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include "TimeSeriesEntropy.h"
+#include "TimeSeriesAllocator.h"
 
 namespace oscill {
 	namespace io {
@@ -44,6 +50,137 @@ namespace oscill {
 			uint64_t previous_delta;
 		};
 
+		// Flags describing the optional encodings used by a buffer.  They are written
+		// into the header so that the reader can decode the buffer correctly
+		struct FormatFlags
+		{
+			// Timestamps are stored as a start time and a period instead of per sample
+			static constexpr uint16_t k_regular_interval = 0x0001;
+			// Runs of samples with no change in delta and no change in value are collapsed
+			static constexpr uint16_t k_run_length = 0x0002;
+			// A byte in the header says how changed values are stored ( see ValueCodec )
+			static constexpr uint16_t k_value_codec = 0x0004;
+			// Only the end points of line segments are stored, within an error bound kept in
+			// the header.  Values in between are interpolated
+			static constexpr uint16_t k_swing_door = 0x0008;
+			// Each point starts with a Huffman coded symbol for its timestamp class and whether
+			// the value changed.  The code lengths follow the other header fields
+			static constexpr uint16_t k_entropy_coded = 0x0010;
+			// Multiple series only.  The column definitions are in a SchemaRegistry, and the
+			// header only has the id they are registered under
+			static constexpr uint16_t k_schema_reference = 0x0020;
+			// The last 4 bytes of a sealed buffer are the CRC-32C of everything in front of them.
+			// Trailing data such as regular interval exceptions ends just before them
+			static constexpr uint16_t k_checksum = 0x0040;
+		};
+
+		// Ways of storing a value that changed.  Unchanged values are always a single 0 bit
+		enum ValueCodec
+		{
+			// The value itself at the full bit size
+			k_value_raw = 0,
+			// Zig-zagged difference from the last value in one of four widths
+			k_value_delta,
+			// Meaningful bits of the XOR with the last value, Gorilla style
+			k_value_xor,
+			// Zig-zagged delta of delta for counters, with explicit resets whenever the
+			// value goes down
+			k_value_counter,
+			// Index into a dictionary of distinct values kept in the header.  Values that
+			// don't fit once it is full follow an escape index at the full bit size
+			k_value_dictionary,
+			k_value_codec_count
+		};
+
+		// What the value codecs carry from one value to the next, besides the last value
+		struct ValueCodecState
+		{
+			// Window of meaningful XOR bits used by the last value, leading is -1 until
+			// there is one
+			int xor_leading = -1;
+			int xor_meaningful = 0;
+
+			// Difference between the last two changed values of a counter
+			int64_t counter_delta = 0;
+
+			// Number of dictionary entries in use
+			uint32_t dictionary_size = 0;
+		};
+
+		// Distinct values seen by the dictionary codec, in index order.  The header has room
+		// for capacity entries, index capacity is the escape
+		struct ValueDictionary
+		{
+			static constexpr uint32_t k_default_capacity = 15;
+			static constexpr uint32_t k_max_capacity = 255;
+
+			uint32_t capacity = k_default_capacity;
+			std::vector<uint64_t> entries;
+			// Where the entry count starts in the header, followed by the entries
+			size_t bit_offset = 0;
+		};
+
+		// Metrics about a regular interval time series.  Every timestamp is implied by its
+		// index, the start time and the period.  Samples that fall off of that grid are
+		// stored as exceptions, each of which re-anchors the grid at its index.  The
+		// exception list lives at the end of the buffer and grows towards the front
+		struct RegularIntervalMetrics
+		{
+			struct Exception
+			{
+				uint32_t index;
+				uint64_t timestamp;
+			};
+			// Size of a single exception, 32-bit index followed by a 64-bit timestamp
+			static constexpr uint32_t k_exception_size = 96;
+
+			// All times are stored in units of the time precision
+			uint64_t start_time = 0;
+			uint64_t period = 0;
+			uint32_t count = 0;
+			uint32_t exception_count = 0;
+
+			// Writer side bookkeeping.  The index and time the grid is currently anchored to
+			// and where the counts live in the header so they can be updated in place
+			uint32_t anchor_index = 0;
+			uint64_t anchor_time = 0;
+			size_t count_bit_offset = 0;
+
+			// Reader side copy of the exception list, sorted by index
+			std::vector<Exception> exceptions;
+
+			// Generate the timestamps for samples [first, first + num) into times.  Each run
+			// between exceptions is pure arithmetic so the loops can be vectorized
+			void GenerateTimes(size_t first, size_t num, uint64_t multiplier, uint64_t *times) const;
+		};
+
+		// Metrics about run length encoding.  A run token stands in for a number of samples in
+		// a row that have a delta of delta of zero and unchanged values.  The token reuses the
+		// 7-bit delta of delta code with a positive sign and a zero magnitude, which the
+		// timestamp encoding can never produce, followed by the length of the run
+		struct RunLengthMetrics
+		{
+			static constexpr uint32_t k_token_pattern = 0x2;
+			static constexpr uint32_t k_token_pattern_size = 2;
+			static constexpr uint32_t k_token_size = 9;
+			static constexpr uint32_t k_length_size = 16;
+			static constexpr uint32_t k_max_length = 0xFFFF;
+
+			// Number of idle samples in a row before they are swapped for a token.  Picked so
+			// that the token is never bigger than the samples it replaces
+			uint32_t threshold = 0;
+
+			// Writer side bookkeeping.  Idle samples written out one by one so far and where
+			// the first of them starts, then the length and location of the token being extended
+			uint32_t idle_count = 0;
+			size_t idle_start = 0;
+			uint32_t length = 0;
+			size_t length_bit_offset = 0;
+
+			// Reader side count of samples left in the current run
+			uint32_t remaining = 0;
+		};
+
 
 		struct SingleTimeSeriesValue
 		{
@@ -65,26 +202,43 @@ namespace oscill {
 		{
 		
 		typedef uint8_t byte_t;
-		typedef std::vector<byte_t> bytes_t;
+		// Comes from the default BufferAllocator, and goes back to it when the buffer does
+		typedef BufferStorage bytes_t;
 
 
 		public:
 			ByteBuffer(void *data, size_t size) :
 				m_size(size), m_current_data_index(0), m_num_bits_available(size * 8)
 			{
-				m_data = bytes_t(size);
-				memcpy(m_data.data(), data, size);
+				// Nothing can be read or written if there is no storage
+				if (!m_data.AssignZeroed(size))
+				{
+					m_size = 0;
+					m_num_bits_available = 0;
+					return;
+				}
+				memcpy(m_data.Data(), data, size);
 			}
 			ByteBuffer(size_t size) :
 				m_size(size), m_current_data_index(0), m_num_bits_available(size * 8)
 			{
-				m_data = bytes_t(size);
+				if (!m_data.AssignZeroed(size))
+				{
+					m_size = 0;
+					m_num_bits_available = 0;
+				}
 			}
 			virtual ~ByteBuffer() {}
 			int64_t ByteCount() { return (uint64_t)(m_current_data_index + 1); }
-			void *RawData() { return m_data.data(); }
+			void *RawData() { return m_data.Data(); }
 			size_t Size() { return m_size; }
+			// Number of bits that can still be written to or read from the buffer
+			int64_t BitsAvailable() { return m_num_bits_available; }
 			void Reset() { m_current_data_index = 0; m_remaining_bits_in_byte = 8; }
+			// Number of bits consumed from the front of the buffer so far
+			size_t BitPosition() { return m_current_data_index * 8 + (8 - m_remaining_bits_in_byte); }
+			// Random access read that does not move the current position
+			bool ReadBitsAt(size_t bit_offset, uint64_t *value, int num_bits);
 		protected:
 			// Make default, copy constructor, and assignment always private, to prevent problems
 			ByteBuffer() {}
@@ -92,13 +246,26 @@ namespace oscill {
 			ByteBuffer(const ByteBuffer & other) {/* do nothing */ }
 
 			bool IncrementByte();
+			// Byte of the data being read.  A reader over a live buffer keeps its own copy of
+			// the last byte, the writer may still be adding bits to it
+			uint8_t ByteAt(size_t index) { return (index == m_tail_index) ? m_tail_byte : m_data[index]; }
+			// End of the trailing data, in bits.  Only a checksum comes after it
+			size_t TrailerEnd() { return m_size * 8 - m_checksum_bits; }
+			// CRC-32C of the bytes in front of the checksum
+			uint32_t ComputeChecksum();
 
 			size_t m_current_data_index = 0;
 			int64_t m_num_bits_available = 0;
 			uint8_t m_remaining_bits_in_byte = 8;
 
 			bytes_t m_data;
-			const size_t m_size = 0;
+			size_t m_size = 0;
+
+			size_t m_tail_index = SIZE_MAX;
+			uint8_t m_tail_byte = 0;
+
+			// Bits at the very end taken up by a checksum ( see FormatFlags::k_checksum )
+			size_t m_checksum_bits = 0;
 		};
 
 		class WriteByteBuffer : public ByteBuffer
@@ -112,7 +279,58 @@ namespace oscill {
 			{
 				return WriteBits((uint64_t)value, 1);
 			}
+			// Overwrite bits that have already been written ( or reserved ) without moving
+			// the current position.  Used to keep counts in the header up to date
+			bool WriteBitsAt(size_t bit_offset, uint64_t value, int num_bits);
+			// Throw away everything written after the given bit position
+			void RewindTo(size_t bit_position);
+			// Take bits off of the end of the buffer so that the front can never grow into
+			// them.  Returns false if the space isn't available
+			bool ReserveTrailingBits(int num_bits)
+			{
+				if (num_bits > m_num_bits_available) return false;
+				m_num_bits_available -= num_bits;
+				return true;
+			}
+			// Same as WriteBits without any of the checks.  The caller has to make sure that at
+			// least num_bits plus k_unchecked_slack bits are available
+			void UncheckedWriteBits(uint64_t value, int num_bits);
+
+			// Extra room UncheckedWriteBits needs past the end of what it writes, it works a
+			// whole 8 bytes at a time
+			static constexpr int64_t k_unchecked_slack = 64;
+
+			// Everything needed to take back the bits written after a point in time
+			struct Checkpoint
+			{
+				size_t bit_position;
+				int64_t bits_available;
+			};
+			Checkpoint GetCheckpoint() { return { BitPosition(), m_num_bits_available }; }
+			// Throw away everything written since the checkpoint, including trailing reservations
+			void Rollback(const Checkpoint &checkpoint)
+			{
+				RewindTo(checkpoint.bit_position);
+				m_num_bits_available = checkpoint.bits_available;
+			}
+			bool IsSealed() { return m_sealed; }
 		protected:
+			// Shrink the storage to exactly what has been written plus trailing_bits of data kept
+			// at the end of the buffer, which is moved down to the new end.  Nothing can be
+			// written afterwards.  Fills in the checksum if there is one.  Returns the number of
+			// bits written from the front
+			size_t SealWithTrailer(size_t trailing_bits);
+			// Take the last 32 bits for a checksum.  Must be done before anything is written
+			bool ReserveChecksum()
+			{
+				if (m_checksum_bits != 0) return true;
+				if (!ReserveTrailingBits(32)) return false;
+				m_checksum_bits = 32;
+				return true;
+			}
+
+			bool m_sealed = false;
+
 			// Make default, copy constructor, and assignment always private, to prevent problems
 			WriteByteBuffer() {}
 			WriteByteBuffer& operator = (const ByteBuffer& other) {return *this;}
@@ -143,11 +361,44 @@ namespace oscill {
 				}
 			}
 			bool ReadNextBits(uint64_t *value, int num_bits);
+			// Read the next bits without consuming them
+			bool PeekBits(uint64_t *value, int num_bits);
+			// Move past bits that have already been looked at with PeekBits
+			bool SkipBits(int num_bits);
 			bool ReadNextBit(uint8_t *value)
 			{
 				return ReadNextBits((uint64_t *)value, 1);
 			}
+			// Stop reading after the first num_bits, for example the count returned when the
+			// buffer was sealed, so that padding isn't read as samples
+			bool LimitToBits(size_t num_bits)
+			{
+				if (num_bits > m_size * 8 || num_bits < BitPosition()) return false;
+				m_num_bits_available = (int64_t)(num_bits - BitPosition());
+				return true;
+			}
 		protected:
+			// Read the same data as source from the beginning, without a copy.  source has to
+			// outlive this buffer
+			void ViewOf(ReadByteBuffer &source)
+			{
+				size_t total_bits = source.BitPosition() + (size_t)source.m_num_bits_available;
+				m_data.AssignView(source.m_data.Data(), source.m_data.Size());
+				m_size = source.m_size;
+				m_tail_index = source.m_tail_index;
+				m_tail_byte = source.m_tail_byte;
+				Reset();
+				m_num_bits_available = (int64_t)total_bits;
+			}
+			// The header says there is a checksum, stop reading in front of it
+			void HasChecksum()
+			{
+				m_checksum_bits = 32;
+				m_num_bits_available = std::min(m_num_bits_available, (int64_t)TrailerEnd() - (int64_t)BitPosition());
+			}
+			// Whether the stored checksum is right.  False if there isn't one
+			bool ChecksumMatches();
+
 			// Make default, copy constructor, and assignment always private, to prevent problems
 			ReadByteBuffer() {}
 			ReadByteBuffer& operator = (const ByteBuffer& other) {return *this;}
@@ -159,6 +410,11 @@ namespace oscill {
 			public:
 				SingleTimeSeries(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max);
 				virtual ~SingleTimeSeries() {}
+
+				// Fields of the plain layout, HeadBlock writes it too
+				static constexpr uint32_t k_full_timestamp = 0x1F;
+				static constexpr uint32_t k_timestamp_size = 64;
+				static constexpr uint32_t k_default_delta = 10;
 			protected:
 				int m_decimal_places;
 				int64_t m_min;
@@ -168,13 +424,27 @@ namespace oscill {
 				uint64_t m_time_precision_divisor;
 				int m_time_precision_nanoseconds_pow;
 
-				static constexpr uint32_t k_full_timestamp = 0x1F;
-				static constexpr uint32_t k_timestamp_size = 64;
-				static constexpr uint32_t k_default_delta = 10;
+				// A buffer can never start with a 32-bit delta of delta, so this pattern at
+				// the very front marks a header describing optional encodings
+				static constexpr uint32_t k_extended_header = 0x1E;
 
 				size_t m_bit_size;
 				uint64_t m_previous_timestamp;
 				uint64_t m_previous_delta;
+
+				uint16_t m_flags = 0;
+				RegularIntervalMetrics m_regular;
+				RunLengthMetrics m_run_length;
+				ValueCodec m_value_codec = k_value_raw;
+				ValueCodecState m_value_state;
+				ValueDictionary m_dictionary;
+
+				// Largest difference allowed between a sample and the line through the stored
+				// points of a swing door buffer
+				double m_error_bound = 0.0;
+
+				// Code for the point symbols of an entropy coded buffer
+				HuffmanCode m_entropy_code;
 		};
 		class SingleTimeSeriesWriteBuffer : public SingleTimeSeries, public WriteByteBuffer
 		{
@@ -185,16 +455,136 @@ namespace oscill {
 			{}
 			virtual ~SingleTimeSeriesWriteBuffer() {}
 			virtual bool AddValue(SingleTimeSeriesValue ts_value);
-			virtual bool AddValues(std::vector<SingleTimeSeriesValue> values, size_t *values_added);
+			virtual bool AddValues(const std::vector<SingleTimeSeriesValue> &values, size_t *values_added);
+			// Add count values straight from an array
+			virtual bool AddValues(const SingleTimeSeriesValue *values, size_t count, size_t *values_added);
+			// Store timestamps as a start time and a fixed period ( in nanoseconds ) instead of
+			// per sample.  Must be called before the first value is added
+			bool SetRegularInterval(uint64_t period_nanoseconds);
+			// Collapse runs of samples with a constant delta and an unchanged value into a
+			// single token.  Must be called before the first value is added
+			bool SetRunLengthEncoding();
+			// Store changed values with the given codec.  Must be called before the first value
+			// is added
+			bool SetValueCodec(ValueCodec codec);
+			// Use the dictionary codec with room for max_entries distinct values ( 1 - 255 ) in
+			// the header.  Must be called before the first value is added
+			bool SetDictionary(uint32_t max_entries);
+			// Estimate the sample with every codec and use the smallest, or the quickest to
+			// decode of the ones within size_tolerance ( e.g. 1.1 for 10% ) of the smallest.
+			// Must be called before the first value is added
+			ValueCodec SelectValueCodec(const SingleTimeSeriesValue *sample, size_t count, double size_tolerance = 1.0);
+			// Shrink the buffer to fit what has been added so far.  No more values can be added
+			// afterwards.  Returns the number of bits used by the samples, Size() gives the
+			// number of bytes including any trailing data
+			size_t Seal();
+			// Number of bits adding the values would take from where the buffer is now,
+			// including the header and any trailing data, without adding them
+			int64_t EstimateBits(const SingleTimeSeriesValue *values, size_t count);
+			// Same as Seal, but first re-encode the points with a Huffman code built for this
+			// buffer, for when size matters more than the time it takes.  Keeps the plain
+			// encoding if that isn't any bigger, or if regular intervals or runs are in use
+			size_t SealEntropyCoded();
+			// Let SingleTimeSeriesReadBuffer read the buffer in place while values are still
+			// being added from another thread ( one writer, any number of readers ).  Every
+			// AddValue(s) call publishes what it wrote.  Must be called before the first value is
+			// added, and doesn't go with regular intervals, runs, the dictionary codec or swing
+			// door, which all rewrite bits that were already written
+			bool SetConcurrentReads();
+			bool ConcurrentReads() { return m_concurrent_reads; }
+			// End the buffer with a CRC-32C of its contents, filled in when it is sealed.  Costs
+			// 4 bytes.  Must be called before the first value is added, and doesn't go with
+			// concurrent reads
+			bool SetChecksum();
 		protected:
+			// Encoder state saved before each point so that a point that doesn't fit can be
+			// taken back out completely
+			struct EncoderState
+			{
+				Checkpoint checkpoint;
+				uint64_t previous_timestamp;
+				uint64_t previous_delta;
+				uint64_t last_value;
+				bool first_value;
+				RegularIntervalMetrics regular;
+				RunLengthMetrics run_length;
+				ValueCodecState value_state;
+			};
+			void m_SaveState(EncoderState *state);
+			void m_RestoreState(const EncoderState &state);
+			bool m_EncodePoint(uint64_t timestamp, int64_t value_to_write, bool changed);
+
+			bool m_WriteHeader(uint64_t timestamp);
+			// Number of bits m_WriteHeader writes
+			int64_t m_HeaderBits();
 			bool m_AddTimeStamp(uint64_t timestamp, bool first);
-			bool m_AddValue(double value, bool first);
+			bool m_AddRegularTimeStamp(uint64_t timestamp, bool first);
+			bool m_AddValue(int64_t value_to_write, bool changed);
+			int64_t m_QuantizeValue(double value);
+			bool m_AddPoint(uint64_t timestamp, int64_t value_to_write, bool changed);
+			// Plain encoding of anything but the first point, without any space checks
+			void m_UncheckedAddPoint(uint64_t timestamp, int64_t value_to_write, bool changed);
+			// Most bits a single point can take up in the plain encoding
+			int64_t m_WorstCasePointBits() { return 5 + k_timestamp_size + 1 + (int64_t)m_bit_size; }
+
+			// Number of values AddValues quantizes in one go before writing them out
+			static constexpr uint32_t k_batch_size = 256;
+
+			// Make everything written so far visible to concurrent readers
+			void m_Publish()
+			{
+				if (!m_concurrent_reads) return;
+				size_t bits = BitPosition();
+				uint8_t tail = (bits % 8 == 0) ? 0 : m_data[bits / 8];
+				m_published.store(((uint64_t)bits << 8) | tail, std::memory_order_release);
+			}
+			bool m_concurrent_reads = false;
+			// Bits written shifted up by 8, with a copy of the byte holding the last of them in
+			// the bottom 8 bits.  One store, so readers always see the two together
+			std::atomic<uint64_t> m_published{ 0 };
 
 
 			bool m_first_value = true;
 			uint64_t m_last_value = 0;
 			friend class SingleTimeSeriesReadBuffer;
 		};
+
+		// Lossy writer that drops every sample a straight line between the samples around it
+		// gets within error_bound of ( swing door compression ).  The newest sample is always
+		// stored, and is replaced if the next one continues the same line, so the buffer can
+		// be read at any time.  Use SingleTimeSeriesReadBuffer::Interpolate to get values back
+		// at any time.  Regular interval and run length encoding don't apply
+		class SwingDoorWriteBuffer : public SingleTimeSeriesWriteBuffer
+		{
+		public:
+			SwingDoorWriteBuffer(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max, const double error_bound, size_t size);
+			virtual ~SwingDoorWriteBuffer() {}
+			virtual bool AddValue(SingleTimeSeriesValue ts_value);
+			virtual bool AddValues(const std::vector<SingleTimeSeriesValue> &values, size_t *values_added);
+			virtual bool AddValues(const SingleTimeSeriesValue *values, size_t count, size_t *values_added);
+		protected:
+			bool m_AddProvisional(uint64_t timestamp, int64_t value_to_write);
+
+			// Quantized error bound
+			double m_quantized_error_bound;
+
+			// Start of the current segment, in time precision units and quantized
+			bool m_have_anchor = false;
+			uint64_t m_anchor_time = 0;
+			int64_t m_anchor_value = 0;
+
+			// Newest sample, written out but replaced if the segment goes on, along with the
+			// state from before it was written
+			bool m_have_provisional = false;
+			uint64_t m_provisional_timestamp = 0;
+			int64_t m_provisional_value = 0;
+			EncoderState m_provisional_state;
+
+			// Range of slopes from the anchor that stay within the bound of every sample since
+			double m_lower_slope = 0.0;
+			double m_upper_slope = 0.0;
+		};
+
 		class SingleTimeSeriesReadBuffer : public SingleTimeSeries, public ReadByteBuffer
 		{
 		public:
@@ -204,17 +594,172 @@ namespace oscill {
 			SingleTimeSeriesReadBuffer(SingleTimeSeriesWriteBuffer& write_buffer) : ReadByteBuffer(write_buffer.RawData(), write_buffer.Size()), 
 				SingleTimeSeries(write_buffer.m_decimal_places, write_buffer.m_time_precision_nanoseconds_pow, write_buffer.m_full_min, write_buffer.m_full_max)
 			{
-
+				// Only what has been written so far, never the zeroed space after it
+				LimitToBits(write_buffer.BitPosition());
 			}
+			// Reads the writer in place when it has concurrent reads on ( see SetConcurrentReads ),
+			// from any thread and without a copy or a lock.  Sees everything published when it
+			// is made, Refresh picks up what was published since.  The writer must outlive the
+			// reader and can't be sealed while it is being read.  Copies the writer like the
+			// constructor above if concurrent reads aren't on
+			SingleTimeSeriesReadBuffer(SingleTimeSeriesWriteBuffer &write_buffer, bool in_place);
 			virtual ~SingleTimeSeriesReadBuffer() {}
+			// Extend an in place reader to what the writer has published since.  Reading carries
+			// on where it left off.  Returns false for any other reader
+			bool Refresh();
+			// Another reader of the same samples with a position of its own, starting from the
+			// first sample.  Shares the data rather than copying it, so this reader has to
+			// outlive it
+			std::unique_ptr<SingleTimeSeriesReadBuffer> NewCursor();
 			bool ReadNext(SingleTimeSeriesValue *ts_value);
 			std::vector<SingleTimeSeriesValue> ReadAll();
 			void ReadAll(std::vector<SingleTimeSeriesValue> *buffer);
+			// Generate the timestamps of samples [first, first + num) of a regular interval
+			// buffer without touching the bit stream.  Returns false for any other buffer
+			bool GenerateTimes(size_t first, size_t num, uint64_t *times);
+			// Values at the given times ( ascending, starting from the current position ),
+			// linearly interpolated between the stored samples.  Times before the first or after
+			// the last stored sample get its value.  Meant for swing door buffers, but works on
+			// any.  Returns false if there are no samples
+			bool Interpolate(const uint64_t *times, size_t num, double *values);
+			// Error bound of a swing door buffer, 0 for any other buffer
+			double ErrorBound();
+			// Check the checksum of a sealed buffer against its contents.  Returns false if it is
+			// wrong or the buffer doesn't have one
+			bool VerifyChecksum();
+			// Check the checksum when the header is read, before the first sample, and read
+			// nothing if it is wrong.  Buffers without a checksum read as usual.  Must be set
+			// before the first sample is read
+			void SetVerifyChecksum(bool verify) { m_verify_checksum = verify; }
+			// Times of the remaining samples equal to value.  Compares quantized values ( the
+			// dictionary entries for dictionary buffers ) without converting anything back to
+			// doubles.  Reads the rest of the buffer
+			bool FindEqual(double value, std::vector<uint64_t> *times);
+			// Move past every sample before time without converting their values, and read the
+			// first one at or after it.  Returns false if there isn't one
+			bool SkipTo(uint64_t time, SingleTimeSeriesValue *ts_value);
 		protected:
+			SingleTimeSeriesReadBuffer(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max) :
+				SingleTimeSeries(precision_decimal_places, time_precision_nanoseconds_pow, min, max)
+			{}
+			bool m_ReadHeader();
 			bool m_ReadNextValue(double *value);
+			bool m_ReadNextQuantized(bool *changed);
+			// Next sample leaving its value quantized in m_last_quantized
+			bool m_ReadNextQuantizedPoint(uint64_t *time);
 			bool m_ReadNextTime(uint64_t *time);
+			bool m_ReadNextEntropyTime(uint64_t *time);
 			double m_last_value;
+			uint64_t m_last_quantized = 0;
+
+			// Whether the value changed, from the last symbol of an entropy coded buffer
+			bool m_entropy_changed = false;
 
+			// Samples either side of the last interpolated time
+			bool m_have_interpolation_points = false;
+			bool m_interpolation_done = false;
+			SingleTimeSeriesValue m_interpolation_before;
+			SingleTimeSeriesValue m_interpolation_after;
+
+			bool m_first_read = true;
+			bool m_verify_checksum = false;
+			uint32_t m_index = 0;
+
+			// Writer being read in place
+			SingleTimeSeriesWriteBuffer *m_live = nullptr;
+			friend class SingleTimeSeriesWriteBuffer;
+		};
+
+		// Quantization shared by a group of series in a HeadBlock, the same settings a single
+		// series buffer takes
+		struct SeriesSchema
+		{
+			int precision_decimal_places;
+			int time_precision_nanoseconds_pow;
+			double min;
+			double max;
+		};
+
+		// Open series kept in packed arrays rather than a buffer object each, for when there
+		// are millions of them.  Precision settings are stored once per schema, and each series
+		// only has its encoder state plus a fixed size chunk of a shared page.  Chunks use the
+		// plain single series encoding, so they read back with SingleTimeSeriesReadBuffer.  A
+		// full chunk has to be moved out ( see SeriesData ) and reset before it takes more
+		class HeadBlock
+		{
+		public:
+			static constexpr size_t k_default_chunk_size = 256;
+			static constexpr size_t k_chunks_per_page = 256;
+
+			HeadBlock(size_t chunk_size = k_default_chunk_size);
+			bool AddSchema(const SeriesSchema &schema, uint32_t *schema_id);
+			bool AddSeries(uint32_t schema_id, uint32_t *series_id);
+			// Returns false, leaving the series as it was, if the value doesn't fit in its chunk
+			bool AddValue(uint32_t series_id, SingleTimeSeriesValue ts_value);
+			// Read everything in the series so far
+			bool ReadSeries(uint32_t series_id, std::vector<SingleTimeSeriesValue> *values);
+			// The chunk of a series, and how many bits of it are used
+			const uint8_t *SeriesData(uint32_t series_id);
+			size_t SeriesBits(uint32_t series_id) const { return m_bit_position[series_id]; }
+			const SeriesSchema &Schema(uint32_t series_id) const { return m_schemas[m_series_schema[series_id]].definition; }
+			// Empty the series' chunk so it starts over with a full timestamp
+			void ResetSeries(uint32_t series_id);
+
+			size_t SeriesCount() const { return m_bit_position.size(); }
+			size_t ChunkSize() const { return m_chunk_size; }
+			// Bytes of encoder state kept for each series, on top of its chunk
+			static constexpr size_t k_state_bytes_per_series = sizeof(uint16_t) + sizeof(uint32_t) + 3 * sizeof(uint64_t);
+
+		private:
+			HeadBlock(const HeadBlock &) = delete;
+			HeadBlock &operator = (const HeadBlock &) = delete;
+
+			struct SchemaMetrics
+			{
+				SeriesSchema definition;
+				int64_t precise_min;
+				double scale;
+				uint64_t time_precision_divisor;
+				int bit_size;
+			};
+			uint8_t *m_Chunk(uint32_t series_id);
+
+			size_t m_chunk_size;
+			std::vector<SchemaMetrics> m_schemas;
+			std::vector<std::unique_ptr<BufferStorage>> m_pages;
+
+			// Encoder state, one entry per series.  A bit position of 0 means no samples yet
+			std::vector<uint16_t> m_series_schema;
+			std::vector<uint32_t> m_bit_position;
+			std::vector<uint64_t> m_previous_timestamp;
+			std::vector<uint64_t> m_previous_delta;
+			std::vector<uint64_t> m_last_value;
+		};
+
+		// Column definitions of multiple series buffers, stored once rather than in the header
+		// of every buffer.  The id is a hash of the definitions, so it is the same in every
+		// registry and every process, and a buffer can be read with any registry that has its
+		// schema.  Safe to share between threads
+		class SchemaRegistry
+		{
+		public:
+			SchemaRegistry() {}
+			virtual ~SchemaRegistry() {}
+
+			// Id of the definitions, adding them if they are new.  Returns false in the unlikely
+			// case that different definitions already have the same id
+			bool Register(const std::vector<ValueTypeDefinition> &definitions, uint32_t *schema_id);
+			bool Find(uint32_t schema_id, std::vector<ValueTypeDefinition> *definitions);
+			size_t Count();
+			static uint32_t SchemaId(const std::vector<ValueTypeDefinition> &definitions);
+
+		protected:
+			std::mutex m_mutex;
+			std::unordered_map<uint32_t, std::vector<ValueTypeDefinition>> m_schemas;
+
+		private:
+			SchemaRegistry(const SchemaRegistry &) = delete;
+			SchemaRegistry &operator = (const SchemaRegistry &) = delete;
 		};
 
 		class MultipleTimeSeriesWriteBuffer : public WriteByteBuffer
@@ -223,11 +768,52 @@ namespace oscill {
 				MultipleTimeSeriesWriteBuffer(const int time_precision_nanoseconds_pow, std::vector<ValueTypeDefinition> definitions, size_t size);
 				virtual ~MultipleTimeSeriesWriteBuffer(){}
 				virtual bool AddValue(LabeledTimeSeriesValues ts_value);
-				virtual bool AddValues(std::vector<LabeledTimeSeriesValues> values, size_t *values_added);
+				virtual bool AddValues(const std::vector<LabeledTimeSeriesValues> &values, size_t *values_added);
+				// Store timestamps as a start time and a fixed period ( in nanoseconds ) instead of
+				// per row.  Must be called before the first row is added
+				bool SetRegularInterval(uint64_t period_nanoseconds);
+				// Collapse runs of rows with a constant delta and no changed values into a
+				// single token.  Must be called before the first row is added
+				bool SetRunLengthEncoding();
+				// Register the definitions and only write their id to the header.  Readers need a
+				// registry with the same definitions ( see SchemaRegistry ).  Must be called
+				// before the first row is added
+				bool SetSchemaRegistry(SchemaRegistry &registry);
+				// End the buffer with a CRC-32C of its contents, filled in when it is sealed.  Must
+				// be called before the first row is added
+				bool SetChecksum();
+				// Shrink the buffer to fit the rows added so far.  No more rows can be added
+				// afterwards.  Returns the number of bits used by the rows, Size() gives the
+				// number of bytes including any trailing data
+				size_t Seal();
+				// Number of bits adding the rows would take from where the buffer is now,
+				// including the header and any trailing data, without adding them
+				int64_t EstimateBits(const std::vector<LabeledTimeSeriesValues> &values);
 			protected:
+				// Encoder state saved before each row so that a row that doesn't fit can be
+				// taken back out completely.  The last value of each column goes into
+				// m_saved_last_values
+				struct EncoderState
+				{
+					Checkpoint checkpoint;
+					uint64_t previous_timestamp;
+					uint64_t previous_delta;
+					bool first_time;
+					RegularIntervalMetrics regular;
+					RunLengthMetrics run_length;
+				};
+				void mSaveState(EncoderState *state);
+				void mRestoreState(const EncoderState &state);
+				bool mEncodeRow(const LabeledTimeSeriesValues &ts_value);
 				bool mAddTimeStamp(uint64_t timestamp, bool first);
-				bool mAddValue(ValueMetrics metrics, double value);
-				bool mInit();
+				bool mAddRegularTimeStamp(uint64_t timestamp, bool first);
+				bool mAddValue(ValueMetrics &metrics, double value);
+				int64_t mQuantizeValue(const ValueMetrics &metrics, double value);
+				bool mInit(uint64_t timestamp);
+				// Column definitions written out in the header
+				bool mWriteDefinitions();
+				// Metrics for the next column, both header layouts set them up the same way
+				const ValueMetrics &mAddMetrics(const ValueTypeDefinition &value_def);
 			private:	
 				/***** 		TIME METRIC INFORMATION    ******/
 				int m_time_precision_nanoseconds_pow;
@@ -239,11 +825,19 @@ namespace oscill {
 				uint64_t m_previous_delta;
 				/****** END TIME METRIC INFORMATION *********/
 
+				uint16_t m_flags = 0;
+				RegularIntervalMetrics m_regular;
+				RunLengthMetrics m_run_length;
+
 				bool m_first_time = true;
 				int m_last_data_type_id;
 				std::vector<ValueTypeDefinition> m_definitions;
 				std::vector<ValueMetrics> m_metrics;
 				std::unordered_map<std::string, ValueMetrics> m_label_to_metrics;
+				uint32_t m_schema_id = 0;
+
+				// Last values of each column from before the row being added
+				std::vector<uint64_t> m_saved_last_values;
 		};
 
 
@@ -257,18 +851,46 @@ namespace oscill {
 			}
 			virtual ~MultipleTimeSeriesReadBuffer() {}
 			bool ReadNext(LabeledTimeSeriesValues *ts_value);
+			// Another reader of the same rows with a position of its own, starting from the first
+			// row.  Shares the data rather than copying it, so this reader has to outlive it
+			std::unique_ptr<MultipleTimeSeriesReadBuffer> NewCursor();
+			// Where to look up the column definitions of buffers that only have a schema id.
+			// Must be given before the first row is read
+			void SetSchemaRegistry(SchemaRegistry *registry) { m_registry = registry; }
+			// Check the checksum of a sealed buffer against its contents.  Returns false if it is
+			// wrong or the buffer doesn't have one
+			bool VerifyChecksum();
+			// Check the checksum when the header is read, and read nothing if it is wrong.  Must
+			// be set before the first row is read
+			void SetVerifyChecksum(bool verify) { m_verify_checksum = verify; }
+			// Generate the timestamps of rows [first, first + num) of a regular interval
+			// buffer without touching the bit stream.  Returns false for any other buffer
+			bool GenerateTimes(size_t first, size_t num, uint64_t *times);
 		protected:
+			MultipleTimeSeriesReadBuffer() : m_last_data_type_id(0)
+			{
+				m_time_metrics.previous_delta = m_time_metrics.previous_timestamp = m_time_metrics.time_precision_divisor = m_time_metrics.time_precision_nanoseconds_pow = 0;
+			}
 			bool mInit();
+			// Column definitions written out in the header
+			bool mReadDefinitions();
 			bool m_ReadNextValue(std::vector<labeled_value> *value);
+			void m_RepeatLastValue(std::vector<labeled_value> *value);
 			bool m_ReadNextTime(uint64_t *time);
 
 		private:
 			bool m_first_time = true;
 			int m_last_data_type_id;
 			TimeMetrics m_time_metrics;
+			uint16_t m_flags = 0;
+			RegularIntervalMetrics m_regular;
+			RunLengthMetrics m_run_length;
+			uint32_t m_index = 0;
 			int m_data_type_label_size = 0;
 			std::vector<ValueMetrics> m_metrics;
 			std::unordered_map<std::string, ValueMetrics> m_label_to_metrics;
+			SchemaRegistry *m_registry = nullptr;
+			bool m_verify_checksum = false;
 
 		};
 
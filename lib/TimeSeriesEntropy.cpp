@@ -0,0 +1,149 @@
+#include "TimeSeriesEntropy.h"
+#include "TimeSeriesCompression.h"
+#include <algorithm>
+
+namespace oscill {
+	namespace io {
+
+		// Work out Huffman code lengths for the symbols with a non zero count.  Alphabets are
+		// small, so just repeatedly merge the two lightest trees
+		static void HuffmanLengths(const std::vector<uint64_t> &counts, std::vector<uint8_t> *lengths)
+		{
+			struct Node
+			{
+				uint64_t weight;
+				std::vector<int> symbols;
+			};
+			std::vector<Node> nodes;
+			lengths->assign(counts.size(), 0);
+			for (size_t i = 0; i < counts.size(); i++)
+			{
+				if (counts[i] != 0)
+				{
+					nodes.push_back({ counts[i], { (int)i } });
+				}
+			}
+
+			// A lone symbol still needs a bit to be written
+			if (nodes.size() == 1)
+			{
+				(*lengths)[nodes[0].symbols[0]] = 1;
+				return;
+			}
+
+			while (nodes.size() > 1)
+			{
+				std::sort(nodes.begin(), nodes.end(), [](const Node &a, const Node &b) { return a.weight > b.weight; });
+				Node lightest = nodes.back();
+				nodes.pop_back();
+				Node &next = nodes.back();
+
+				// Every symbol under the merged trees moves one level deeper
+				for (int symbol : lightest.symbols)
+				{
+					(*lengths)[symbol]++;
+				}
+				for (int symbol : next.symbols)
+				{
+					(*lengths)[symbol]++;
+				}
+				next.weight += lightest.weight;
+				next.symbols.insert(next.symbols.end(), lightest.symbols.begin(), lightest.symbols.end());
+			}
+		}
+
+		bool HuffmanCode::Build(const uint32_t *counts, int num_symbols)
+		{
+			if (num_symbols <= 0) return false;
+
+			std::vector<uint64_t> scaled(counts, counts + num_symbols);
+			std::vector<uint8_t> lengths;
+			while (true)
+			{
+				HuffmanLengths(scaled, &lengths);
+				if (*std::max_element(lengths.begin(), lengths.end()) <= k_max_length) break;
+
+				// Too deep, flatten the distribution and try again.  Used symbols stay used
+				for (auto &&count : scaled)
+				{
+					if (count != 0) count = (count + 1) / 2;
+				}
+			}
+			return SetLengths(lengths.data(), num_symbols);
+		}
+		bool HuffmanCode::SetLengths(const uint8_t *lengths, int num_symbols)
+		{
+			if (num_symbols <= 0) return false;
+			m_lengths.assign(lengths, lengths + num_symbols);
+			return m_AssignCodes();
+		}
+		bool HuffmanCode::m_AssignCodes()
+		{
+			for (int length = 0; length <= k_max_length; length++)
+			{
+				m_length_count[length] = 0;
+			}
+			for (auto &&length : m_lengths)
+			{
+				if (length > k_max_length) return false;
+				m_length_count[length]++;
+			}
+			m_length_count[0] = 0;
+
+			// Codes of each length follow on from the ones of the length before, in symbol order
+			uint32_t code = 0;
+			uint32_t start = 0;
+			for (int length = 1; length <= k_max_length; length++)
+			{
+				code = (code + (length > 1 ? m_length_count[length - 1] : 0)) << (length > 1 ? 1 : 0);
+				m_first_code[length] = code;
+				m_length_start[length] = start;
+				start += m_length_count[length];
+
+				// More codes than fit in this many bits means the lengths are broken
+				if (m_length_count[length] > 0 && code + m_length_count[length] > ((uint32_t)1 << length)) return false;
+			}
+
+			m_sorted_symbols.assign(start, 0);
+			m_codes.assign(m_lengths.size(), 0);
+			uint32_t next_index[k_max_length + 1];
+			for (int length = 1; length <= k_max_length; length++)
+			{
+				next_index[length] = 0;
+			}
+			for (size_t symbol = 0; symbol < m_lengths.size(); symbol++)
+			{
+				int length = m_lengths[symbol];
+				if (length == 0) continue;
+				m_codes[symbol] = m_first_code[length] + next_index[length];
+				m_sorted_symbols[m_length_start[length] + next_index[length]] = (uint16_t)symbol;
+				next_index[length]++;
+			}
+			return true;
+		}
+		bool HuffmanCode::Write(WriteByteBuffer &buffer, int symbol) const
+		{
+			if (symbol < 0 || symbol >= (int)m_lengths.size() || m_lengths[symbol] == 0) return false;
+			return buffer.WriteBits(m_codes[symbol], m_lengths[symbol]);
+		}
+		bool HuffmanCode::Read(ReadByteBuffer &buffer, int *symbol) const
+		{
+			// Canonical codes of each length are consecutive, so walk down one bit at a time
+			// until the code falls in the range of its length
+			uint32_t code = 0;
+			for (int length = 1; length <= k_max_length; length++)
+			{
+				uint64_t bit = 0;
+				if (!buffer.ReadNextBits(&bit, 1)) return false;
+				code = (code << 1) | (uint32_t)bit;
+
+				if (code - m_first_code[length] < m_length_count[length])
+				{
+					*symbol = m_sorted_symbols[m_length_start[length] + code - m_first_code[length]];
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		class ReadByteBuffer;
+		class WriteByteBuffer;
+
+		// Canonical Huffman code over a small alphabet.  Code lengths are limited so that each
+		// one fits in 4 bits, which is all that has to be stored to rebuild the code
+		class HuffmanCode
+		{
+		public:
+			static constexpr int k_max_length = 15;
+			static constexpr int k_length_size = 4;
+
+			// Build the code from how often each symbol occurs.  Symbols that never occur get
+			// no code
+			bool Build(const uint32_t *counts, int num_symbols);
+			// Rebuild the code from the lengths of a code built earlier
+			bool SetLengths(const uint8_t *lengths, int num_symbols);
+
+			int NumSymbols() const { return (int)m_lengths.size(); }
+			// Length of a symbol's code in bits, 0 if it has none
+			int Length(int symbol) const { return m_lengths[symbol]; }
+			uint32_t Code(int symbol) const { return m_codes[symbol]; }
+
+			bool Write(WriteByteBuffer &buffer, int symbol) const;
+			bool Read(ReadByteBuffer &buffer, int *symbol) const;
+
+		private:
+			bool m_AssignCodes();
+
+			std::vector<uint8_t> m_lengths;
+			std::vector<uint32_t> m_codes;
+
+			// For decoding, the first code of each length, how many codes there are of that
+			// length, and the symbols in code order
+			uint32_t m_first_code[k_max_length + 1];
+			uint32_t m_length_count[k_max_length + 1];
+			uint32_t m_length_start[k_max_length + 1];
+			std::vector<uint16_t> m_sorted_symbols;
+		};
+	}
+}
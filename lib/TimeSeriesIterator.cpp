@@ -0,0 +1,68 @@
+#include "TimeSeriesIterator.h"
+
+namespace oscill {
+	namespace io {
+
+		SingleTimeSeriesIterator::SingleTimeSeriesIterator(std::unique_ptr<SingleTimeSeriesReadBuffer> reader)
+		{
+			if (!reader) return;
+			m_cursor.reset(new Cursor());
+			m_cursor->reader = std::move(reader);
+			++(*this);
+		}
+		SingleTimeSeriesIterator &SingleTimeSeriesIterator::operator++()
+		{
+			// Running out turns this into the end iterator
+			if (m_cursor && !m_cursor->reader->ReadNext(&m_cursor->current))
+			{
+				m_cursor.reset();
+			}
+			return *this;
+		}
+		SingleTimeSeriesIterator::PostIncrement SingleTimeSeriesIterator::operator++(int)
+		{
+			PostIncrement previous = { m_cursor->current };
+			++(*this);
+			return previous;
+		}
+		SingleTimeSeriesIterator &SingleTimeSeriesIterator::AdvanceTo(uint64_t time)
+		{
+			if (!m_cursor || m_cursor->current.time >= time) return *this;
+			if (!m_cursor->reader->SkipTo(time, &m_cursor->current))
+			{
+				m_cursor.reset();
+			}
+			return *this;
+		}
+
+		MultipleTimeSeriesIterator::MultipleTimeSeriesIterator(std::unique_ptr<MultipleTimeSeriesReadBuffer> reader)
+		{
+			if (!reader) return;
+			m_cursor.reset(new Cursor());
+			m_cursor->reader = std::move(reader);
+			++(*this);
+		}
+		MultipleTimeSeriesIterator &MultipleTimeSeriesIterator::operator++()
+		{
+			if (m_cursor && !m_cursor->reader->ReadNext(&m_cursor->current))
+			{
+				m_cursor.reset();
+			}
+			return *this;
+		}
+		MultipleTimeSeriesIterator::PostIncrement MultipleTimeSeriesIterator::operator++(int)
+		{
+			PostIncrement previous = { m_cursor->current };
+			++(*this);
+			return previous;
+		}
+		MultipleTimeSeriesIterator &MultipleTimeSeriesIterator::AdvanceTo(uint64_t time)
+		{
+			while (m_cursor && m_cursor->current.time < time)
+			{
+				++(*this);
+			}
+			return *this;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "TimeSeriesCompression.h"
+#include <stddef.h>
+#include <iterator>
+#include <memory>
+
+namespace oscill {
+	namespace io {
+		// Input iterator that decodes one sample of a single series buffer per increment.
+		// Copies share a position, like any input iterator.  A default constructed one is the end
+		class SingleTimeSeriesIterator
+		{
+		public:
+			typedef std::input_iterator_tag iterator_category;
+			typedef SingleTimeSeriesValue value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const SingleTimeSeriesValue *pointer;
+			typedef const SingleTimeSeriesValue &reference;
+
+			// What it++ hands back, the sample from before the increment
+			struct PostIncrement
+			{
+				SingleTimeSeriesValue value;
+				const SingleTimeSeriesValue &operator*() const { return value; }
+			};
+
+			SingleTimeSeriesIterator() {}
+			// Takes the reader over and reads its first sample
+			explicit SingleTimeSeriesIterator(std::unique_ptr<SingleTimeSeriesReadBuffer> reader);
+
+			reference operator*() const { return m_cursor->current; }
+			pointer operator->() const { return &m_cursor->current; }
+			SingleTimeSeriesIterator &operator++();
+			PostIncrement operator++(int);
+			// Move to the first sample at or after time.  Samples skipped over are decoded
+			// without converting their values.  Stays put if already there
+			SingleTimeSeriesIterator &AdvanceTo(uint64_t time);
+
+			bool operator==(const SingleTimeSeriesIterator &other) const { return m_cursor == other.m_cursor; }
+			bool operator!=(const SingleTimeSeriesIterator &other) const { return m_cursor != other.m_cursor; }
+
+		protected:
+			struct Cursor
+			{
+				std::unique_ptr<SingleTimeSeriesReadBuffer> reader;
+				SingleTimeSeriesValue current;
+			};
+			std::shared_ptr<Cursor> m_cursor;
+		};
+
+		// Samples of a read buffer, for range based for loops and the standard algorithms.  Every
+		// begin() starts a new cursor at the first sample, independent of the buffer's own
+		// position and of any other cursor.  Nothing is copied, the buffer has to outlive them
+		class SingleTimeSeriesRange
+		{
+		public:
+			explicit SingleTimeSeriesRange(SingleTimeSeriesReadBuffer &buffer) : m_buffer(buffer) {}
+			SingleTimeSeriesIterator begin() { return SingleTimeSeriesIterator(m_buffer.NewCursor()); }
+			SingleTimeSeriesIterator end() { return SingleTimeSeriesIterator(); }
+
+		protected:
+			SingleTimeSeriesReadBuffer &m_buffer;
+		};
+
+		// Same as SingleTimeSeriesIterator for the rows of a multiple series buffer
+		class MultipleTimeSeriesIterator
+		{
+		public:
+			typedef std::input_iterator_tag iterator_category;
+			typedef LabeledTimeSeriesValues value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const LabeledTimeSeriesValues *pointer;
+			typedef const LabeledTimeSeriesValues &reference;
+
+			struct PostIncrement
+			{
+				LabeledTimeSeriesValues value;
+				const LabeledTimeSeriesValues &operator*() const { return value; }
+			};
+
+			MultipleTimeSeriesIterator() {}
+			explicit MultipleTimeSeriesIterator(std::unique_ptr<MultipleTimeSeriesReadBuffer> reader);
+
+			reference operator*() const { return m_cursor->current; }
+			pointer operator->() const { return &m_cursor->current; }
+			MultipleTimeSeriesIterator &operator++();
+			PostIncrement operator++(int);
+			// Move to the first row at or after time.  Every value depends on the rows before
+			// it, so rows skipped over are still decoded in full
+			MultipleTimeSeriesIterator &AdvanceTo(uint64_t time);
+
+			bool operator==(const MultipleTimeSeriesIterator &other) const { return m_cursor == other.m_cursor; }
+			bool operator!=(const MultipleTimeSeriesIterator &other) const { return m_cursor != other.m_cursor; }
+
+		protected:
+			struct Cursor
+			{
+				std::unique_ptr<MultipleTimeSeriesReadBuffer> reader;
+				LabeledTimeSeriesValues current;
+			};
+			std::shared_ptr<Cursor> m_cursor;
+		};
+
+		class MultipleTimeSeriesRange
+		{
+		public:
+			explicit MultipleTimeSeriesRange(MultipleTimeSeriesReadBuffer &buffer) : m_buffer(buffer) {}
+			MultipleTimeSeriesIterator begin() { return MultipleTimeSeriesIterator(m_buffer.NewCursor()); }
+			MultipleTimeSeriesIterator end() { return MultipleTimeSeriesIterator(); }
+
+		protected:
+			MultipleTimeSeriesReadBuffer &m_buffer;
+		};
+	}
+}
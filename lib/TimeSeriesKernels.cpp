@@ -0,0 +1,490 @@
+#include "TimeSeriesKernels.h"
+#include <atomic>
+#include <string.h>
+
+// Vector variants are only built for x86 with compilers that let us target individual
+// functions at an instruction set, so one binary can carry all of them
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OSCILLIO_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// The CRC instructions are optional in ARMv8.0, so they are checked for at run time like
+// the x86 variants
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define OSCILLIO_ARM_CRC32 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace oscill {
+	namespace io {
+
+		// Appends bit fields most significant bit first, flushing whole bytes as they fill up
+		struct BitPacker
+		{
+			uint8_t *out;
+			size_t byte_index;
+			uint64_t pending;
+			int pending_bits;
+
+			BitPacker(uint8_t *data, size_t bit_offset) : out(data), byte_index(bit_offset / 8), pending(0), pending_bits((int)(bit_offset % 8))
+			{
+				// Pick up whatever is already in front of us in a partial byte
+				if (pending_bits != 0)
+				{
+					pending = out[byte_index] >> (8 - pending_bits);
+				}
+			}
+			void Append(uint64_t value, int num_bits)
+			{
+				// Split anything that could overflow the accumulator
+				if (num_bits > 56)
+				{
+					Append(value >> 32, num_bits - 32);
+					Append(value & 0xFFFFFFFF, 32);
+					return;
+				}
+				pending = (pending << num_bits) | (value & (((uint64_t)1 << num_bits) - 1));
+				pending_bits += num_bits;
+				while (pending_bits >= 8)
+				{
+					out[byte_index++] = (uint8_t)(pending >> (pending_bits - 8));
+					pending_bits -= 8;
+				}
+			}
+			void Finish()
+			{
+				if (pending_bits > 0)
+				{
+					out[byte_index] |= (uint8_t)(pending << (8 - pending_bits));
+				}
+			}
+		};
+
+		/****************************** Scalar ******************************/
+
+		static void PackBitsScalar(const uint64_t *values, size_t count, int num_bits, uint8_t *out, size_t bit_offset)
+		{
+			BitPacker packer(out, bit_offset);
+			for (size_t i = 0; i < count; i++)
+			{
+				packer.Append(values[i], num_bits);
+			}
+			packer.Finish();
+		}
+		static void QuantizeScalar(const double *values, size_t count, double min, double max, double scale, int64_t offset, int64_t *out)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				double value = values[i];
+				if (value > max)
+				{
+					value = max;
+				}
+				if (value < min)
+				{
+					value = min;
+				}
+				out[i] = (int64_t)(value * scale) - offset;
+			}
+		}
+		static void MarkChangesScalar(const int64_t *values, size_t count, int64_t previous, uint8_t *changed)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				changed[i] = (values[i] != previous) ? 1 : 0;
+				previous = values[i];
+			}
+		}
+
+		// Slicing by 8: table[k][b] is the CRC of byte b followed by k zero bytes
+		struct Crc32cTables
+		{
+			static constexpr uint32_t k_polynomial = 0x82F63B78;
+			uint32_t table[8][256];
+
+			Crc32cTables()
+			{
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					uint32_t crc = i;
+					for (int bit = 0; bit < 8; bit++)
+					{
+						crc = (crc & 1) ? (crc >> 1) ^ k_polynomial : crc >> 1;
+					}
+					table[0][i] = crc;
+				}
+				for (int k = 1; k < 8; k++)
+				{
+					for (uint32_t i = 0; i < 256; i++)
+					{
+						table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+					}
+				}
+			}
+		};
+		static uint32_t Crc32cScalar(uint32_t crc, const uint8_t *data, size_t size)
+		{
+			static const Crc32cTables tables;
+			const uint32_t (*table)[256] = tables.table;
+
+			crc = ~crc;
+			for (; size >= 8; data += 8, size -= 8)
+			{
+				uint32_t low = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+				uint32_t high = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+				crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+					table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+			}
+			for (; size > 0; data++, size--)
+			{
+				crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+#ifdef OSCILLIO_X86_KERNELS
+
+		// Packed truncation to integers only goes as far as 32 bits before AVX-512.  Values
+		// outside of that range take the scalar path.  The clamps put the limit first, min
+		// and max hand back their second operand for NaN, so it gets through like it does
+		// the scalar comparisons and is left to the scalar path as well
+		static const double k_truncate_limit = 2147483647.0;
+
+		/****************************** SSE4.2 ******************************/
+
+		__attribute__((target("sse4.2")))
+		static void QuantizeSse42(const double *values, size_t count, double min, double max, double scale, int64_t offset, int64_t *out)
+		{
+			const __m128d min_value = _mm_set1_pd(min);
+			const __m128d max_value = _mm_set1_pd(max);
+			const __m128d scale_value = _mm_set1_pd(scale);
+			const __m128d sign_mask = _mm_set1_pd(-0.0);
+			const __m128d limit = _mm_set1_pd(k_truncate_limit);
+			const __m128i offset_value = _mm_set1_epi64x(offset);
+
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				__m128d value = _mm_loadu_pd(values + i);
+				value = _mm_max_pd(min_value, _mm_min_pd(max_value, value));
+				value = _mm_mul_pd(value, scale_value);
+
+				if (_mm_movemask_pd(_mm_cmplt_pd(_mm_andnot_pd(sign_mask, value), limit)) == 0x3)
+				{
+					__m128i truncated = _mm_cvtepi32_epi64(_mm_cvttpd_epi32(value));
+					_mm_storeu_si128((__m128i *)(out + i), _mm_sub_epi64(truncated, offset_value));
+				}
+				else
+				{
+					QuantizeScalar(values + i, 2, min, max, scale, offset, out + i);
+				}
+			}
+			QuantizeScalar(values + i, count - i, min, max, scale, offset, out + i);
+		}
+
+		// Compare each value against the one before it with two overlapping loads
+		__attribute__((target("sse4.2")))
+		static void MarkChangesSse42(const int64_t *values, size_t count, int64_t previous, uint8_t *changed)
+		{
+			if (count == 0) return;
+			MarkChangesScalar(values, 1, previous, changed);
+
+			size_t i = 1;
+			for (; i + 2 <= count; i += 2)
+			{
+				__m128i current = _mm_loadu_si128((const __m128i *)(values + i));
+				__m128i before = _mm_loadu_si128((const __m128i *)(values + i - 1));
+				int same = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(current, before)));
+				changed[i] = (same & 0x1) ? 0 : 1;
+				changed[i + 1] = (same & 0x2) ? 0 : 1;
+			}
+			MarkChangesScalar(values + i, count - i, values[i - 1], changed + i);
+		}
+
+		// The crc32 instruction works on the reflected Castagnoli polynomial, the same CRC as
+		// the table.  Also used by the later variants, there is nothing wider to use
+		__attribute__((target("sse4.2")))
+		static uint32_t Crc32cSse42(uint32_t crc, const uint8_t *data, size_t size)
+		{
+			crc = ~crc;
+#ifdef __x86_64__
+			uint64_t crc64 = crc;
+			for (; size >= 8; data += 8, size -= 8)
+			{
+				uint64_t word;
+				memcpy(&word, data, 8);
+				crc64 = _mm_crc32_u64(crc64, word);
+			}
+			crc = (uint32_t)crc64;
+#endif
+			for (; size >= 4; data += 4, size -= 4)
+			{
+				uint32_t word;
+				memcpy(&word, data, 4);
+				crc = _mm_crc32_u32(crc, word);
+			}
+			for (; size > 0; data++, size--)
+			{
+				crc = _mm_crc32_u8(crc, *data);
+			}
+			return ~crc;
+		}
+
+		/****************************** AVX2 + BMI2 ******************************/
+
+		// Fields are gathered into byte, word or doubleword lanes with a single pext per 64
+		// bits.  Fields wider than 32 bits take the scalar path
+		static int LaneBits(int num_bits)
+		{
+			if (num_bits <= 8) return 8;
+			if (num_bits <= 16) return 16;
+			if (num_bits <= 32) return 32;
+			return 0;
+		}
+		static uint64_t LaneMask(int lane_bits, int num_bits)
+		{
+			uint64_t mask = 0;
+			for (int lane = 0; lane < 64 / lane_bits; lane++)
+			{
+				mask |= (((uint64_t)1 << num_bits) - 1) << (lane * lane_bits);
+			}
+			return mask;
+		}
+
+		__attribute__((target("bmi2")))
+		static void PackBitsBmi2(const uint64_t *values, size_t count, int num_bits, uint8_t *out, size_t bit_offset)
+		{
+			int lane_bits = LaneBits(num_bits);
+			if (lane_bits == 0)
+			{
+				PackBitsScalar(values, count, num_bits, out, bit_offset);
+				return;
+			}
+			int lanes = 64 / lane_bits;
+			int group_bits = lanes * num_bits;
+			uint64_t lane_mask = LaneMask(lane_bits, num_bits);
+			uint64_t field_mask = ((uint64_t)1 << num_bits) - 1;
+
+			BitPacker packer(out, bit_offset);
+			size_t i = 0;
+			for (; i + lanes <= count; i += lanes)
+			{
+				// First value goes in the top lane so it comes out first
+				uint64_t lanes_value = 0;
+				for (int lane = 0; lane < lanes; lane++)
+				{
+					lanes_value |= (values[i + lane] & field_mask) << ((lanes - 1 - lane) * lane_bits);
+				}
+				packer.Append(_pext_u64(lanes_value, lane_mask), group_bits);
+			}
+			for (; i < count; i++)
+			{
+				packer.Append(values[i], num_bits);
+			}
+			packer.Finish();
+		}
+
+		__attribute__((target("avx2")))
+		static void QuantizeAvx2(const double *values, size_t count, double min, double max, double scale, int64_t offset, int64_t *out)
+		{
+			const __m256d min_value = _mm256_set1_pd(min);
+			const __m256d max_value = _mm256_set1_pd(max);
+			const __m256d scale_value = _mm256_set1_pd(scale);
+			const __m256d sign_mask = _mm256_set1_pd(-0.0);
+			const __m256d limit = _mm256_set1_pd(k_truncate_limit);
+			const __m256i offset_value = _mm256_set1_epi64x(offset);
+
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256d value = _mm256_loadu_pd(values + i);
+				value = _mm256_max_pd(min_value, _mm256_min_pd(max_value, value));
+				value = _mm256_mul_pd(value, scale_value);
+
+				__m256d in_range = _mm256_cmp_pd(_mm256_andnot_pd(sign_mask, value), limit, _CMP_LT_OQ);
+				if (_mm256_movemask_pd(in_range) == 0xF)
+				{
+					__m256i truncated = _mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(value));
+					_mm256_storeu_si256((__m256i *)(out + i), _mm256_sub_epi64(truncated, offset_value));
+				}
+				else
+				{
+					QuantizeScalar(values + i, 4, min, max, scale, offset, out + i);
+				}
+			}
+			QuantizeScalar(values + i, count - i, min, max, scale, offset, out + i);
+		}
+
+		__attribute__((target("avx2")))
+		static void MarkChangesAvx2(const int64_t *values, size_t count, int64_t previous, uint8_t *changed)
+		{
+			if (count == 0) return;
+			MarkChangesScalar(values, 1, previous, changed);
+
+			size_t i = 1;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256i current = _mm256_loadu_si256((const __m256i *)(values + i));
+				__m256i before = _mm256_loadu_si256((const __m256i *)(values + i - 1));
+				int same = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(current, before)));
+				for (int lane = 0; lane < 4; lane++)
+				{
+					changed[i + lane] = ((same >> lane) & 0x1) ? 0 : 1;
+				}
+			}
+			MarkChangesScalar(values + i, count - i, values[i - 1], changed + i);
+		}
+
+		/****************************** AVX-512 ******************************/
+
+		// AVX-512DQ converts doubles to 64-bit integers directly, so the only check left is
+		// for NaN
+		__attribute__((target("avx512f,avx512dq")))
+		static void QuantizeAvx512(const double *values, size_t count, double min, double max, double scale, int64_t offset, int64_t *out)
+		{
+			const __m512d min_value = _mm512_set1_pd(min);
+			const __m512d max_value = _mm512_set1_pd(max);
+			const __m512d scale_value = _mm512_set1_pd(scale);
+			const __m512i offset_value = _mm512_set1_epi64(offset);
+
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m512d value = _mm512_loadu_pd(values + i);
+				value = _mm512_max_pd(min_value, _mm512_min_pd(max_value, value));
+				value = _mm512_mul_pd(value, scale_value);
+				if (_mm512_cmp_pd_mask(value, value, _CMP_ORD_Q) == 0xFF)
+				{
+					_mm512_storeu_si512((void *)(out + i), _mm512_sub_epi64(_mm512_cvttpd_epi64(value), offset_value));
+				}
+				else
+				{
+					QuantizeScalar(values + i, 8, min, max, scale, offset, out + i);
+				}
+			}
+			QuantizeScalar(values + i, count - i, min, max, scale, offset, out + i);
+		}
+
+		__attribute__((target("avx512f")))
+		static void MarkChangesAvx512(const int64_t *values, size_t count, int64_t previous, uint8_t *changed)
+		{
+			if (count == 0) return;
+			MarkChangesScalar(values, 1, previous, changed);
+
+			// Expand the comparison mask to ones and zeros and narrow them to bytes
+			const __m512i ones = _mm512_set1_epi64(1);
+			size_t i = 1;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m512i current = _mm512_loadu_si512((const void *)(values + i));
+				__m512i before = _mm512_loadu_si512((const void *)(values + i - 1));
+				__mmask8 different = _mm512_cmpneq_epi64_mask(current, before);
+				__m128i bytes = _mm512_cvtepi64_epi8(_mm512_maskz_mov_epi64(different, ones));
+				_mm_storel_epi64((__m128i *)(changed + i), bytes);
+			}
+			MarkChangesScalar(values + i, count - i, values[i - 1], changed + i);
+		}
+
+		static const Kernels kernel_table[k_kernel_variant_count] =
+		{
+			{ k_kernel_scalar, PackBitsScalar, QuantizeScalar, MarkChangesScalar, Crc32cScalar },
+			{ k_kernel_sse42, PackBitsScalar, QuantizeSse42, MarkChangesSse42, Crc32cSse42 },
+			{ k_kernel_avx2, PackBitsBmi2, QuantizeAvx2, MarkChangesAvx2, Crc32cSse42 },
+			{ k_kernel_avx512, PackBitsBmi2, QuantizeAvx512, MarkChangesAvx512, Crc32cSse42 }
+		};
+#else
+#ifdef OSCILLIO_ARM_CRC32
+		__attribute__((target("+crc")))
+		static uint32_t Crc32cArmv8(uint32_t crc, const uint8_t *data, size_t size)
+		{
+			crc = ~crc;
+			for (; size >= 8; data += 8, size -= 8)
+			{
+				uint64_t word;
+				memcpy(&word, data, 8);
+				crc = __crc32cd(crc, word);
+			}
+			for (; size > 0; data++, size--)
+			{
+				crc = __crc32cb(crc, *data);
+			}
+			return ~crc;
+		}
+		// There is only the one tier here, so the choice is made on each call
+		static uint32_t Crc32cPortable(uint32_t crc, const uint8_t *data, size_t size)
+		{
+			static const bool has_crc32 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+			return has_crc32 ? Crc32cArmv8(crc, data, size) : Crc32cScalar(crc, data, size);
+		}
+#else
+		static uint32_t Crc32cPortable(uint32_t crc, const uint8_t *data, size_t size)
+		{
+			return Crc32cScalar(crc, data, size);
+		}
+#endif
+		// Only the scalar kernels exist on this platform.  The other entries are never selected
+		static const Kernels kernel_table[k_kernel_variant_count] =
+		{
+			{ k_kernel_scalar, PackBitsScalar, QuantizeScalar, MarkChangesScalar, Crc32cPortable },
+			{ k_kernel_scalar, PackBitsScalar, QuantizeScalar, MarkChangesScalar, Crc32cPortable },
+			{ k_kernel_scalar, PackBitsScalar, QuantizeScalar, MarkChangesScalar, Crc32cPortable },
+			{ k_kernel_scalar, PackBitsScalar, QuantizeScalar, MarkChangesScalar, Crc32cPortable }
+		};
+#endif
+
+		static std::atomic<const Kernels *> current_kernels(nullptr);
+
+		KernelVariant DetectKernelVariant()
+		{
+#ifdef OSCILLIO_X86_KERNELS
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("bmi2"))
+			{
+				return k_kernel_avx512;
+			}
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+			{
+				return k_kernel_avx2;
+			}
+			if (__builtin_cpu_supports("sse4.2"))
+			{
+				return k_kernel_sse42;
+			}
+#endif
+			return k_kernel_scalar;
+		}
+		const Kernels &GetKernels()
+		{
+			const Kernels *kernels = current_kernels.load(std::memory_order_acquire);
+			if (!kernels)
+			{
+				// Every thread that races here detects the same thing, so whoever wins is fine
+				kernels = &kernel_table[DetectKernelVariant()];
+				current_kernels.store(kernels, std::memory_order_release);
+			}
+			return *kernels;
+		}
+		bool ForceKernelVariant(KernelVariant variant)
+		{
+			if (variant < k_kernel_scalar || variant >= k_kernel_variant_count) return false;
+			if (variant > DetectKernelVariant()) return false;
+
+			current_kernels.store(&kernel_table[variant], std::memory_order_release);
+			return true;
+		}
+		const char *KernelVariantName(KernelVariant variant)
+		{
+			switch (variant)
+			{
+			case k_kernel_scalar: return "scalar";
+			case k_kernel_sse42: return "sse4.2";
+			case k_kernel_avx2: return "avx2";
+			case k_kernel_avx512: return "avx512";
+			default: return "unknown";
+			}
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace oscill {
+	namespace io {
+		// Instruction set tiers the bulk kernels are built for.  Each tier implies the
+		// ones before it
+		enum KernelVariant
+		{
+			k_kernel_scalar = 0,
+			k_kernel_sse42,
+			// AVX2 along with BMI2 for pdep / pext
+			k_kernel_avx2,
+			// AVX-512 foundation and doubleword / quadword instructions
+			k_kernel_avx512,
+			k_kernel_variant_count
+		};
+
+		// Bulk kernels used by the batch encode paths and checksums.  All variants produce
+		// exactly the same results as the scalar code in the buffers, NaN included
+		struct Kernels
+		{
+			KernelVariant variant;
+
+			// Pack count values of num_bits ( 1 - 64 ) each, most significant bit first, into out
+			// starting at bit_offset.  Like WriteBits, the destination bits must be zeroed
+			void (*pack_bits)(const uint64_t *values, size_t count, int num_bits, uint8_t *out, size_t bit_offset);
+
+			// Clamp each value to [min, max], scale it, truncate it and subtract offset.  This is
+			// the quantization done when adding a value to a buffer
+			void (*quantize)(const double *values, size_t count, double min, double max, double scale, int64_t offset, int64_t *out);
+
+			// Set changed[i] to 1 if values[i] differs from the value before it and 0 otherwise.
+			// The first value is compared against previous
+			void (*mark_changes)(const int64_t *values, size_t count, int64_t previous, uint8_t *changed);
+
+			// CRC-32C ( Castagnoli ) of size bytes carrying on from crc.  Like zlib's crc32, start
+			// with 0 and pass the result back in to continue over more bytes
+			uint32_t (*crc32c)(uint32_t crc, const uint8_t *data, size_t size);
+		};
+
+		// Kernels for the best variant this CPU supports, detected once on first use
+		const Kernels &GetKernels();
+
+		// Best variant supported by this CPU and build
+		KernelVariant DetectKernelVariant();
+
+		// Force a specific variant, mostly for testing.  Returns false, leaving the current
+		// kernels in place, if the CPU or build doesn't support it
+		bool ForceKernelVariant(KernelVariant variant);
+
+		const char *KernelVariantName(KernelVariant variant);
+	}
+}
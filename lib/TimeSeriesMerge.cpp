@@ -0,0 +1,83 @@
+#include "TimeSeriesMerge.h"
+
+namespace oscill {
+	namespace io {
+
+		bool SingleTimeSeriesMerger::AddInput(SingleTimeSeriesReadBuffer &input)
+		{
+			if (m_started) return false;
+			m_inputs.push_back(SingleTimeSeriesRange(input).begin());
+			return true;
+		}
+		void SingleTimeSeriesMerger::mPush(size_t input)
+		{
+			if (m_inputs[input] != SingleTimeSeriesIterator())
+			{
+				m_heap.push({ m_inputs[input]->time, input });
+			}
+		}
+		bool SingleTimeSeriesMerger::mNext(SingleTimeSeriesValue *value)
+		{
+			if (m_heap.empty()) return false;
+
+			heap_entry_t top = m_heap.top();
+			m_heap.pop();
+			*value = *m_inputs[top.second];
+			++m_inputs[top.second];
+			mPush(top.second);
+			if (m_policy == k_duplicates_keep_all) return true;
+
+			// Ties come off the heap in input order, so the first is kept or each replaces it
+			while (!m_heap.empty() && m_heap.top().first == value->time)
+			{
+				heap_entry_t duplicate = m_heap.top();
+				m_heap.pop();
+				if (m_policy == k_duplicates_keep_last)
+				{
+					*value = *m_inputs[duplicate.second];
+				}
+				++m_inputs[duplicate.second];
+				mPush(duplicate.second);
+				m_duplicates_dropped++;
+			}
+			return true;
+		}
+		bool SingleTimeSeriesMerger::MergeInto(SingleTimeSeriesWriteBuffer &output, size_t *values_written)
+		{
+			if (!values_written) return false;
+			*values_written = 0;
+
+			if (!m_started)
+			{
+				m_started = true;
+				for (size_t input = 0; input < m_inputs.size(); input++)
+				{
+					mPush(input);
+				}
+			}
+
+			while (true)
+			{
+				// Top the batch up, whatever didn't fit last time goes first
+				if (m_pending_start == m_pending.size())
+				{
+					m_pending.clear();
+					m_pending_start = 0;
+				}
+				SingleTimeSeriesValue value;
+				while (m_pending.size() - m_pending_start < k_batch_size && mNext(&value))
+				{
+					m_pending.push_back(value);
+				}
+				size_t batch_size = m_pending.size() - m_pending_start;
+				if (batch_size == 0) return true;
+
+				size_t values_added = 0;
+				bool added = output.AddValues(m_pending.data() + m_pending_start, batch_size, &values_added);
+				m_pending_start += values_added;
+				*values_written += values_added;
+				if (!added) return false;
+			}
+		}
+	}
+}
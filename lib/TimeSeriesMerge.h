@@ -0,0 +1,64 @@
+#pragma once
+#include "TimeSeriesIterator.h"
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		// What to do with samples from different inputs ( or repeated in one ) that have the
+		// same timestamp
+		enum DuplicatePolicy
+		{
+			// The one from the input added first
+			k_duplicates_keep_first = 0,
+			// The one from the input added last, for when later inputs are newer
+			k_duplicates_keep_last,
+			// All of them, in the order the inputs were added
+			k_duplicates_keep_all
+		};
+
+		// Streaming k-way merge of single series buffers sorted by time into new buffers.  Only
+		// the next sample of each input and one batch of output are held at a time, whatever
+		// the size of the inputs.  The output is encoded with its own settings, so precision
+		// and codecs can change along the way
+		class SingleTimeSeriesMerger
+		{
+		public:
+			SingleTimeSeriesMerger(DuplicatePolicy policy = k_duplicates_keep_last) : m_policy(policy) {}
+			virtual ~SingleTimeSeriesMerger() {}
+
+			// Reads from the start of input with a cursor of its own.  The input has to outlive
+			// the merger, and inputs can't be added once merging has started
+			bool AddInput(SingleTimeSeriesReadBuffer &input);
+			// Merge into output until every input is used up.  Returns false if output filled up
+			// first, call again with a new output to carry on from there
+			bool MergeInto(SingleTimeSeriesWriteBuffer &output, size_t *values_written);
+			bool Done() { return m_started && m_heap.empty() && m_pending_start == m_pending.size(); }
+
+			// Samples dropped as duplicates so far
+			size_t DuplicatesDropped() { return m_duplicates_dropped; }
+
+			// Samples handed to the output in one go
+			static constexpr size_t k_batch_size = 256;
+
+		protected:
+			// Next sample in time order, with duplicates already dealt with
+			bool mNext(SingleTimeSeriesValue *value);
+			void mPush(size_t input);
+
+			DuplicatePolicy m_policy;
+			std::vector<SingleTimeSeriesIterator> m_inputs;
+			// Time of the current sample of each input that has one, earliest then lowest input first
+			typedef std::pair<uint64_t, size_t> heap_entry_t;
+			std::priority_queue<heap_entry_t, std::vector<heap_entry_t>, std::greater<heap_entry_t>> m_heap;
+			bool m_started = false;
+
+			// Samples taken from the inputs that the last output had no room for
+			std::vector<SingleTimeSeriesValue> m_pending;
+			size_t m_pending_start = 0;
+			size_t m_duplicates_dropped = 0;
+		};
+	}
+}
@@ -0,0 +1,311 @@
+#include "TimeSeriesQuery.h"
+#include <algorithm>
+#include <map>
+
+namespace oscill {
+	namespace io {
+
+		// Pool the current thread belongs to, if any, and its queue
+		static thread_local WorkStealingPool *current_pool = nullptr;
+		static thread_local size_t current_worker = 0;
+
+		WorkStealingPool::WorkStealingPool(size_t num_threads) : m_next_queue(0)
+		{
+			if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+			for (size_t i = 0; i < num_threads; i++)
+			{
+				m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+			}
+			for (size_t i = 0; i < num_threads; i++)
+			{
+				m_threads.push_back(std::thread(&WorkStealingPool::mWorkerLoop, this, i));
+			}
+		}
+		WorkStealingPool::~WorkStealingPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_wake_mutex);
+				m_stopping = true;
+			}
+			m_wake.notify_all();
+			for (auto &&thread : m_threads)
+			{
+				thread.join();
+			}
+		}
+		void WorkStealingPool::Submit(std::function<void()> task)
+		{
+			size_t queue = (current_pool == this) ? current_worker : m_next_queue++ % m_queues.size();
+			{
+				std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+				// Counted before any worker can see the task, or it could be taken and counted
+				// off first.  Workers never hold a queue lock while they take the wake lock
+				{
+					std::lock_guard<std::mutex> wake_lock(m_wake_mutex);
+					m_pending++;
+				}
+				m_queues[queue]->tasks.push_back(std::move(task));
+			}
+			m_wake.notify_one();
+		}
+		bool WorkStealingPool::mTakeTask(size_t worker, std::function<void()> *task)
+		{
+			// Newest of our own first, it is the most likely to still be in cache
+			{
+				WorkerQueue &own = *m_queues[worker];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (!own.tasks.empty())
+				{
+					*task = std::move(own.tasks.back());
+					own.tasks.pop_back();
+					return true;
+				}
+			}
+			// Then the oldest of anyone else's
+			for (size_t i = 1; i < m_queues.size(); i++)
+			{
+				WorkerQueue &victim = *m_queues[(worker + i) % m_queues.size()];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tasks.empty())
+				{
+					*task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+		void WorkStealingPool::mWorkerLoop(size_t worker)
+		{
+			current_pool = this;
+			current_worker = worker;
+			while (true)
+			{
+				std::function<void()> task;
+				if (mTakeTask(worker, &task))
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_wake_mutex);
+						m_pending--;
+					}
+					task();
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(m_wake_mutex);
+				if (m_stopping && m_pending == 0) return;
+				m_wake.wait(lock, [this]() { return m_pending > 0 || m_stopping; });
+			}
+		}
+
+		// Partial aggregate of one bucket, merged across chunks before it is finished
+		struct QueryBucket
+		{
+			uint64_t count = 0;
+			double sum = 0.0;
+			double min = 0.0;
+			double max = 0.0;
+		};
+		static void AddToBucket(QueryBucket &bucket, double value)
+		{
+			bucket.min = (bucket.count == 0) ? value : std::min(bucket.min, value);
+			bucket.max = (bucket.count == 0) ? value : std::max(bucket.max, value);
+			bucket.sum += value;
+			bucket.count++;
+		}
+		static void MergeBucket(QueryBucket &into, const QueryBucket &from)
+		{
+			if (from.count == 0) return;
+			into.min = (into.count == 0) ? from.min : std::min(into.min, from.min);
+			into.max = (into.count == 0) ? from.max : std::max(into.max, from.max);
+			into.sum += from.sum;
+			into.count += from.count;
+		}
+		static double FinishBucket(const QueryBucket &bucket, Aggregation aggregation)
+		{
+			switch (aggregation)
+			{
+			case k_aggregate_count: return (double)bucket.count;
+			case k_aggregate_sum: return bucket.sum;
+			case k_aggregate_min: return bucket.min;
+			case k_aggregate_max: return bucket.max;
+			default: return bucket.sum / (double)bucket.count;
+			}
+		}
+
+		// Everything about one series while its chunks are decoded
+		struct SeriesJob
+		{
+			QueryResult result;
+			std::vector<ChunkSnapshot> chunks;
+			// Output of each chunk, samples or buckets depending on the query
+			std::vector<std::vector<SingleTimeSeriesValue>> chunk_values;
+			std::vector<std::map<uint64_t, QueryBucket>> chunk_buckets;
+			std::atomic<size_t> chunks_left;
+		};
+
+		// What a whole query shares between its tasks
+		struct QueryRun
+		{
+			TimeSeriesStore *store;
+			const Query *query;
+			const std::function<void(QueryResult &)> *on_result;
+			std::vector<std::unique_ptr<SeriesJob>> jobs;
+
+			std::mutex result_mutex;
+			std::mutex done_mutex;
+			std::condition_variable done;
+			size_t series_left = 0;
+		};
+
+		static void FinishSeries(QueryRun &run, SeriesJob &job)
+		{
+			const Query &query = *run.query;
+			std::vector<SingleTimeSeriesValue> &values = job.result.values;
+			if (query.aggregation == k_aggregate_none)
+			{
+				// Chunks are oldest first, so putting them together in order keeps the samples in order
+				for (auto &&chunk_values : job.chunk_values)
+				{
+					values.insert(values.end(), chunk_values.begin(), chunk_values.end());
+				}
+			}
+			else
+			{
+				std::map<uint64_t, QueryBucket> buckets;
+				for (auto &&chunk_buckets : job.chunk_buckets)
+				{
+					for (auto &&bucket : chunk_buckets)
+					{
+						MergeBucket(buckets[bucket.first], bucket.second);
+					}
+				}
+				for (auto &&bucket : buckets)
+				{
+					uint64_t bucket_start = query.start + bucket.first * query.bucket_nanoseconds;
+					values.push_back({ bucket_start, FinishBucket(bucket.second, query.aggregation) });
+				}
+			}
+			job.chunks.clear();
+			job.chunk_values.clear();
+			job.chunk_buckets.clear();
+
+			{
+				std::lock_guard<std::mutex> lock(run.result_mutex);
+				(*run.on_result)(job.result);
+			}
+			// Notify under the lock, Run may return and take run with it as soon as it is released
+			std::lock_guard<std::mutex> lock(run.done_mutex);
+			run.series_left--;
+			run.done.notify_all();
+		}
+		static void DecodeChunk(QueryRun &run, SeriesJob &job, size_t chunk)
+		{
+			const Query &query = *run.query;
+			std::shared_ptr<const DecodedChunk> decoded = run.store->DecodeSnapshot(job.chunks[chunk]);
+			const std::vector<uint64_t> &times = decoded->times;
+			const std::vector<double> &values = decoded->values;
+
+			if (query.aggregation == k_aggregate_none)
+			{
+				std::vector<SingleTimeSeriesValue> &chunk_values = job.chunk_values[chunk];
+				for (size_t i = 0; i < times.size(); i++)
+				{
+					if (times[i] >= query.start && times[i] < query.end) chunk_values.push_back({ times[i], values[i] });
+				}
+			}
+			else
+			{
+				std::map<uint64_t, QueryBucket> &buckets = job.chunk_buckets[chunk];
+				for (size_t i = 0; i < times.size(); i++)
+				{
+					if (times[i] < query.start || times[i] >= query.end) continue;
+					uint64_t bucket = (query.bucket_nanoseconds == 0) ? 0 : (times[i] - query.start) / query.bucket_nanoseconds;
+					AddToBucket(buckets[bucket], values[i]);
+				}
+			}
+
+			// Whoever finishes the last chunk puts the series together
+			if (--job.chunks_left == 0)
+			{
+				FinishSeries(run, job);
+			}
+		}
+		static void StartSeries(TimeSeriesStore &store, WorkStealingPool &pool, QueryRun &run, SeriesJob &job)
+		{
+			const Query &query = *run.query;
+			job.result.found = store.SnapshotRange(job.result.series_id, query.start, query.end, &job.chunks);
+			if (job.chunks.empty())
+			{
+				FinishSeries(run, job);
+				return;
+			}
+
+			size_t num_chunks = job.chunks.size();
+			job.chunk_values.resize(num_chunks);
+			job.chunk_buckets.resize(num_chunks);
+			job.chunks_left = num_chunks;
+			for (size_t chunk = 0; chunk < num_chunks; chunk++)
+			{
+				SeriesJob *job_pointer = &job;
+				QueryRun *run_pointer = &run;
+				pool.Submit([run_pointer, job_pointer, chunk]() { DecodeChunk(*run_pointer, *job_pointer, chunk); });
+			}
+		}
+
+		bool QueryExecutor::Run(const Query &query, const std::function<void(QueryResult &)> &on_result)
+		{
+			if (query.end < query.start) return false;
+
+			QueryRun run;
+			run.store = &m_store;
+			run.query = &query;
+			run.on_result = &on_result;
+			run.series_left = query.series_ids.size();
+			for (auto &&series_id : query.series_ids)
+			{
+				std::unique_ptr<SeriesJob> job(new SeriesJob());
+				job->result.series_id = series_id;
+				job->chunks_left = 0;
+				run.jobs.push_back(std::move(job));
+			}
+
+			// Looking up the chunks is a task as well, so series start decoding as soon as
+			// a thread is free
+			for (auto &&job : run.jobs)
+			{
+				SeriesJob *job_pointer = job.get();
+				QueryRun *run_pointer = &run;
+				TimeSeriesStore *store = &m_store;
+				WorkStealingPool *pool = &m_pool;
+				m_pool.Submit([store, pool, run_pointer, job_pointer]() { StartSeries(*store, *pool, *run_pointer, *job_pointer); });
+			}
+
+			std::unique_lock<std::mutex> lock(run.done_mutex);
+			run.done.wait(lock, [&run]() { return run.series_left == 0; });
+			return true;
+		}
+		bool QueryExecutor::Run(const Query &query, std::vector<QueryResult> *results)
+		{
+			if (!results) return false;
+
+			// Results come in as they finish, put them back in the order they were asked for
+			std::vector<QueryResult> ordered(query.series_ids.size());
+			std::multimap<uint64_t, size_t> positions;
+			for (size_t i = 0; i < query.series_ids.size(); i++)
+			{
+				positions.insert({ query.series_ids[i], i });
+			}
+			bool ran = Run(query, [&ordered, &positions](QueryResult &result)
+			{
+				auto position = positions.find(result.series_id);
+				ordered[position->second] = std::move(result);
+				positions.erase(position);
+			});
+			if (!ran) return false;
+
+			results->insert(results->end(), std::make_move_iterator(ordered.begin()), std::make_move_iterator(ordered.end()));
+			return true;
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "TimeSeriesStore.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		// Fixed set of threads, each with its own queue of tasks.  A thread works through its
+		// own queue newest first, and takes the oldest task from another thread's queue when
+		// it runs out.  Tasks submitted from inside a task go on that thread's own queue
+		class WorkStealingPool
+		{
+		public:
+			// 0 threads uses one per hardware thread
+			WorkStealingPool(size_t num_threads = 0);
+			// Finishes every task already submitted
+			virtual ~WorkStealingPool();
+			void Submit(std::function<void()> task);
+			size_t ThreadCount() const { return m_threads.size(); }
+
+		protected:
+			struct WorkerQueue
+			{
+				std::mutex mutex;
+				std::deque<std::function<void()>> tasks;
+			};
+			bool mTakeTask(size_t worker, std::function<void()> *task);
+			void mWorkerLoop(size_t worker);
+
+			std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+			std::vector<std::thread> m_threads;
+			std::atomic<size_t> m_next_queue;
+
+			// Tasks submitted but not started yet, and whether the pool is shutting down
+			std::mutex m_wake_mutex;
+			std::condition_variable m_wake;
+			size_t m_pending = 0;
+			bool m_stopping = false;
+
+		private:
+			WorkStealingPool(const WorkStealingPool &) = delete;
+			WorkStealingPool &operator = (const WorkStealingPool &) = delete;
+		};
+
+		// How the samples of each series are combined into buckets
+		enum Aggregation
+		{
+			k_aggregate_none = 0,
+			k_aggregate_count,
+			k_aggregate_sum,
+			k_aggregate_min,
+			k_aggregate_max,
+			k_aggregate_mean
+		};
+
+		struct Query
+		{
+			std::vector<uint64_t> series_ids;
+			// Samples with start <= time < end
+			uint64_t start = 0;
+			uint64_t end = UINT64_MAX;
+			Aggregation aggregation = k_aggregate_none;
+			// Width of the buckets, counting from start.  0 puts the whole range in one
+			uint64_t bucket_nanoseconds = 0;
+		};
+
+		// Samples of one series, or one value per non empty bucket timed at the start of the
+		// bucket when aggregating.  found is false for series the store doesn't have
+		struct QueryResult
+		{
+			uint64_t series_id = 0;
+			bool found = false;
+			std::vector<SingleTimeSeriesValue> values;
+		};
+
+		// Runs queries across many series of a store, decoding every chunk as its own task
+		// on the pool.  Each series is handed over as soon as all of its chunks are done
+		class QueryExecutor
+		{
+		public:
+			QueryExecutor(TimeSeriesStore &store, WorkStealingPool &pool) : m_store(store), m_pool(pool) {}
+			virtual ~QueryExecutor() {}
+
+			// on_result is called once per series in the order they finish, from the pool's
+			// threads but never two at a time.  Returns once every series is done.  Must not be
+			// called from one of the pool's threads
+			bool Run(const Query &query, const std::function<void(QueryResult &)> &on_result);
+			// Every result, in the order of query.series_ids
+			bool Run(const Query &query, std::vector<QueryResult> *results);
+
+		protected:
+			TimeSeriesStore &m_store;
+			WorkStealingPool &m_pool;
+		};
+	}
+}
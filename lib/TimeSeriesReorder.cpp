@@ -0,0 +1,110 @@
+#include "TimeSeriesReorder.h"
+#include <algorithm>
+
+namespace oscill {
+	namespace io {
+
+		ReorderWindow::ReorderWindow(SingleTimeSeriesWriteBuffer *output, uint64_t window_nanoseconds, size_t max_samples, LatePolicy policy) :
+			m_output(output), m_window_nanoseconds(window_nanoseconds), m_max_samples(max_samples), m_policy(policy)
+		{
+			if (m_window_nanoseconds == 0 && m_max_samples == 0) m_max_samples = k_default_max_samples;
+		}
+		bool ReorderWindow::AddValue(SingleTimeSeriesValue ts_value)
+		{
+			bool kept = false;
+			return mAdd(ts_value, &kept);
+		}
+		bool ReorderWindow::AddValues(const SingleTimeSeriesValue *values, size_t count, size_t *values_added)
+		{
+			if (!values_added) return false;
+			*values_added = 0;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				bool kept = false;
+				bool added = mAdd(values[i], &kept);
+				if (kept) *values_added += 1;
+				if (!added) return false;
+			}
+			return true;
+		}
+		bool ReorderWindow::Flush()
+		{
+			return mRelease(0, true);
+		}
+		bool ReorderWindow::mAdd(SingleTimeSeriesValue ts_value, bool *kept)
+		{
+			*kept = false;
+
+			// Something newer has already been written, holding this one back won't help
+			if (m_have_written && ts_value.time < m_last_written_time)
+			{
+				m_late_count++;
+				switch (m_policy)
+				{
+				case k_late_drop:
+					*kept = true;
+					return true;
+				case k_late_reject:
+					return false;
+				default:
+					if (!m_output || !m_output->AddValue(ts_value)) return false;
+					*kept = true;
+					return true;
+				}
+			}
+
+			m_held.push_back({ ts_value, m_arrivals++ });
+			std::push_heap(m_held.begin(), m_held.end(), mLater);
+			*kept = true;
+			m_newest_time = std::max(m_newest_time, ts_value.time);
+
+			// Anything at least the window older than the newest sample goes out
+			uint64_t release_before = 0;
+			if (m_window_nanoseconds != 0 && m_newest_time >= m_window_nanoseconds)
+			{
+				release_before = m_newest_time - m_window_nanoseconds + 1;
+			}
+			return mRelease(release_before, false);
+		}
+		bool ReorderWindow::mRelease(uint64_t time, bool all)
+		{
+			HeldSample taken[k_batch_size];
+			SingleTimeSeriesValue values[k_batch_size];
+			while (true)
+			{
+				size_t count = 0;
+				while (!m_held.empty() && count < k_batch_size)
+				{
+					bool too_many = m_max_samples != 0 && m_held.size() > m_max_samples;
+					if (!all && !too_many && m_held.front().value.time >= time) break;
+
+					std::pop_heap(m_held.begin(), m_held.end(), mLater);
+					taken[count] = m_held.back();
+					values[count] = taken[count].value;
+					m_held.pop_back();
+					count++;
+				}
+				if (count == 0) return true;
+
+				size_t values_added = 0;
+				bool added = m_output && m_output->AddValues(values, count, &values_added);
+				if (values_added > 0)
+				{
+					m_have_written = true;
+					m_last_written_time = values[values_added - 1].time;
+				}
+				if (!added)
+				{
+					// The output is full, hold on to what didn't fit for the next one
+					for (size_t i = values_added; i < count; i++)
+					{
+						m_held.push_back(taken[i]);
+						std::push_heap(m_held.begin(), m_held.end(), mLater);
+					}
+					return false;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "TimeSeriesCompression.h"
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		// What happens to a sample older than one that was already written out
+		enum LatePolicy
+		{
+			// Counted and thrown away
+			k_late_drop = 0,
+			// AddValue returns false and nothing is kept
+			k_late_reject,
+			// Written out straight away, out of order, which is what the writer does without
+			// a window
+			k_late_write
+		};
+
+		// Holds samples back for a while in front of a single series writer, so ones that
+		// arrive a little out of order are written in time order.  A sample is written once
+		// something at least window_nanoseconds newer has arrived, or when more than
+		// max_samples are held.  Samples with the same time keep the order they came in
+		class ReorderWindow
+		{
+		public:
+			// 0 for either limit leaves that one off.  The window is always bounded, with both
+			// off it holds at most k_default_max_samples
+			ReorderWindow(SingleTimeSeriesWriteBuffer *output, uint64_t window_nanoseconds, size_t max_samples, LatePolicy policy = k_late_drop);
+			virtual ~ReorderWindow() {}
+
+			// Returns false if the sample was rejected as late, or if the output filled up.  The
+			// samples that didn't fit stay held, give a new output with SetOutput to carry on
+			bool AddValue(SingleTimeSeriesValue ts_value);
+			bool AddValues(const SingleTimeSeriesValue *values, size_t count, size_t *values_added);
+			// Write out everything held, before sealing the output for example
+			bool Flush();
+			void SetOutput(SingleTimeSeriesWriteBuffer *output) { m_output = output; }
+
+			size_t HeldCount() { return m_held.size(); }
+			// Samples that came in too late, whatever the policy did with them
+			size_t LateCount() { return m_late_count; }
+
+			// Most samples written to the output in one go
+			static constexpr size_t k_batch_size = 256;
+			// Sample limit of a window given neither limit
+			static constexpr size_t k_default_max_samples = 1024;
+
+		protected:
+			struct HeldSample
+			{
+				SingleTimeSeriesValue value;
+				uint64_t arrival;
+			};
+			// Comparison for the std heap functions, which keep the largest on top
+			static bool mLater(const HeldSample &a, const HeldSample &b)
+			{
+				return a.value.time > b.value.time || (a.value.time == b.value.time && a.arrival > b.arrival);
+			}
+			// kept is set if the sample was taken, even if the output then filled up
+			bool mAdd(SingleTimeSeriesValue ts_value, bool *kept);
+			// Write out held samples older than time ( or all of them ), and the oldest while
+			// there are too many
+			bool mRelease(uint64_t time, bool all);
+
+			SingleTimeSeriesWriteBuffer *m_output;
+			uint64_t m_window_nanoseconds;
+			size_t m_max_samples;
+			LatePolicy m_policy;
+
+			// Min heap on time then arrival
+			std::vector<HeldSample> m_held;
+			uint64_t m_arrivals = 0;
+			uint64_t m_newest_time = 0;
+			bool m_have_written = false;
+			uint64_t m_last_written_time = 0;
+			size_t m_late_count = 0;
+		};
+	}
+}
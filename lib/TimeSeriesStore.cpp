@@ -0,0 +1,340 @@
+#include "TimeSeriesStore.h"
+#include <algorithm>
+
+namespace oscill {
+	namespace io {
+
+		// Chunk ids start at 1, 0 is the chunk being written
+		static std::atomic<uint64_t> next_chunk_id(1);
+
+		TimeSeriesStore::TimeSeriesStore(const StoreOptions &options) :
+			m_options(options), m_memory_used(0)
+		{
+			if (m_options.num_shards == 0) m_options.num_shards = 1;
+			for (size_t i = 0; i < m_options.num_shards; i++)
+			{
+				m_shards.push_back(std::unique_ptr<StoreShard>(new StoreShard()));
+			}
+		}
+		TimeSeriesStore::StoreShard &TimeSeriesStore::mShard(uint64_t series_id)
+		{
+			// Mix the id so that ids in a row land on different shards
+			uint64_t mixed = series_id * 0x9E3779B97F4A7C15ull;
+			return *m_shards[(mixed >> 32) % m_shards.size()];
+		}
+		bool TimeSeriesStore::CreateSeries(uint64_t series_id, const SeriesSchema &schema)
+		{
+			if (schema.max < schema.min) return false;
+
+			StoreShard &shard = mShard(series_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			if (shard.series.count(series_id) != 0) return false;
+			shard.series[series_id].schema = schema;
+			return true;
+		}
+		bool TimeSeriesStore::DropSeries(uint64_t series_id)
+		{
+			StoreShard &shard = mShard(series_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.series.find(series_id);
+			if (found == shard.series.end()) return false;
+
+			for (auto &&chunk : found->second.sealed)
+			{
+				mReleaseChunk(chunk);
+			}
+			mReleaseChunk(found->second.head);
+			shard.series.erase(found);
+			return true;
+		}
+		void TimeSeriesStore::mReleaseChunk(StoreChunk &chunk)
+		{
+			if (!chunk.buffer) return;
+			m_memory_used -= chunk.bytes;
+			if (m_options.cache && chunk.sequence != 0)
+			{
+				m_options.cache->Erase(chunk.sequence);
+			}
+			chunk.buffer.reset();
+			chunk.bytes = 0;
+			chunk.count = 0;
+		}
+		bool TimeSeriesStore::mStartHead(StoreSeries &series)
+		{
+			const SeriesSchema &schema = series.schema;
+			series.head = StoreChunk();
+			// Only becomes the head once it is ready to take samples
+			std::unique_ptr<SingleTimeSeriesWriteBuffer> buffer(new SingleTimeSeriesWriteBuffer(schema.precision_decimal_places, schema.time_precision_nanoseconds_pow, schema.min, schema.max, m_options.chunk_size));
+			if (!buffer->RawData()) return false;
+			if (m_options.checksum && !buffer->SetChecksum()) return false;
+			series.head.buffer = std::move(buffer);
+			series.head.bytes = m_options.chunk_size;
+			m_memory_used += series.head.bytes;
+			return true;
+		}
+		void TimeSeriesStore::mSealHead(uint64_t series_id, StoreSeries &series)
+		{
+			StoreChunk &head = series.head;
+			if (m_options.entropy_coded)
+			{
+				head.buffer->SealEntropyCoded();
+			}
+			else
+			{
+				head.buffer->Seal();
+			}
+			m_memory_used -= head.bytes - head.buffer->Size();
+			head.bytes = head.buffer->Size();
+			head.sequence = next_chunk_id++;
+
+			if (m_options.memory_budget != 0)
+			{
+				std::lock_guard<std::mutex> lock(m_eviction_mutex);
+				m_eviction_queue.push_back({ series_id, head.sequence });
+			}
+			series.sealed.push_back(std::move(head));
+			series.head = StoreChunk();
+		}
+		bool TimeSeriesStore::mAppendLocked(uint64_t series_id, StoreSeries &series, const SingleTimeSeriesValue *values, size_t count, size_t *values_added, bool *sealed)
+		{
+			*values_added = 0;
+			while (*values_added < count)
+			{
+				if (!series.head.buffer)
+				{
+					if (!mStartHead(series)) return false;
+				}
+
+				StoreChunk &head = series.head;
+				const SingleTimeSeriesValue *to_add = values + *values_added;
+				size_t added = 0;
+				head.buffer->AddValues(to_add, count - *values_added, &added);
+				for (size_t i = 0; i < added; i++)
+				{
+					if (head.count == 0 && i == 0)
+					{
+						head.min_time = head.max_time = to_add[i].time;
+					}
+					head.min_time = std::min(head.min_time, to_add[i].time);
+					head.max_time = std::max(head.max_time, to_add[i].time);
+				}
+				head.count += added;
+				*values_added += added;
+
+				if (*values_added < count)
+				{
+					// Doesn't even fit in an empty chunk
+					if (head.count == 0) return false;
+					mSealHead(series_id, series);
+					*sealed = true;
+				}
+			}
+			return true;
+		}
+		bool TimeSeriesStore::Append(uint64_t series_id, SingleTimeSeriesValue ts_value)
+		{
+			size_t values_added = 0;
+			return Append(series_id, &ts_value, 1, &values_added);
+		}
+		bool TimeSeriesStore::Append(uint64_t series_id, const SingleTimeSeriesValue *values, size_t count, size_t *values_added)
+		{
+			if (!values_added) return false;
+			*values_added = 0;
+
+			bool sealed = false;
+			bool appended = false;
+			{
+				StoreShard &shard = mShard(series_id);
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				auto found = shard.series.find(series_id);
+				if (found == shard.series.end()) return false;
+				appended = mAppendLocked(series_id, found->second, values, count, values_added, &sealed);
+			}
+
+			// Only sealing adds to what can be dropped, and it has to happen outside of the shard lock
+			if (sealed && m_options.memory_budget != 0)
+			{
+				mEnforceBudget();
+			}
+			return appended;
+		}
+		void TimeSeriesStore::mEnforceBudget()
+		{
+			while (m_memory_used.load() > m_options.memory_budget)
+			{
+				EvictionEntry entry;
+				{
+					std::lock_guard<std::mutex> lock(m_eviction_mutex);
+					if (m_eviction_queue.empty()) return;
+					entry = m_eviction_queue.front();
+					m_eviction_queue.pop_front();
+				}
+
+				// A series seals its chunks in order, so if its chunk is still there it is the oldest
+				StoreShard &shard = mShard(entry.series_id);
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				auto found = shard.series.find(entry.series_id);
+				if (found == shard.series.end()) continue;
+				std::deque<StoreChunk> &sealed = found->second.sealed;
+				if (!sealed.empty() && sealed.front().sequence == entry.sequence)
+				{
+					mReleaseChunk(sealed.front());
+					sealed.pop_front();
+				}
+			}
+		}
+		bool TimeSeriesStore::SnapshotRange(uint64_t series_id, uint64_t start, uint64_t end, std::vector<ChunkSnapshot> *chunks)
+		{
+			if (!chunks) return false;
+
+			StoreShard &shard = mShard(series_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.series.find(series_id);
+			if (found == shard.series.end()) return false;
+
+			// Readers take a copy of the chunk, so this is all that happens under the lock
+			StoreSeries &series = found->second;
+			for (auto &&chunk : series.sealed)
+			{
+				if (chunk.max_time >= start && chunk.min_time < end)
+				{
+					ChunkSnapshot snapshot;
+					snapshot.chunk_id = chunk.sequence;
+					if (m_options.cache)
+					{
+						snapshot.decoded = m_options.cache->Find(chunk.sequence);
+					}
+					if (!snapshot.decoded)
+					{
+						snapshot.reader.reset(new SingleTimeSeriesReadBuffer(*chunk.buffer));
+					}
+					chunks->push_back(std::move(snapshot));
+				}
+			}
+			if (series.head.buffer && series.head.count > 0 && series.head.max_time >= start && series.head.min_time < end)
+			{
+				ChunkSnapshot snapshot;
+				snapshot.reader.reset(new SingleTimeSeriesReadBuffer(*series.head.buffer));
+				chunks->push_back(std::move(snapshot));
+			}
+			return true;
+		}
+		std::shared_ptr<const DecodedChunk> TimeSeriesStore::DecodeSnapshot(ChunkSnapshot &snapshot)
+		{
+			if (snapshot.decoded || !snapshot.reader) return snapshot.decoded;
+
+			std::vector<SingleTimeSeriesValue> values;
+			snapshot.reader->ReadAll(&values);
+			std::shared_ptr<DecodedChunk> decoded(new DecodedChunk());
+			decoded->times.resize(values.size());
+			decoded->values.resize(values.size());
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				decoded->times[i] = values[i].time;
+				decoded->values[i] = values[i].value;
+			}
+			snapshot.decoded = decoded;
+			snapshot.reader.reset();
+
+			// The chunk being written still changes, so only sealed ones are cached.  If the chunk
+			// was dropped meanwhile the entry is never found again and just ages out
+			if (m_options.cache && snapshot.chunk_id != 0)
+			{
+				m_options.cache->Insert(snapshot.chunk_id, snapshot.decoded);
+			}
+			return snapshot.decoded;
+		}
+		bool TimeSeriesStore::ReadRange(uint64_t series_id, uint64_t start, uint64_t end, std::vector<SingleTimeSeriesValue> *values)
+		{
+			if (!values) return false;
+
+			std::vector<ChunkSnapshot> chunks;
+			if (!SnapshotRange(series_id, start, end, &chunks)) return false;
+
+			for (auto &&chunk : chunks)
+			{
+				std::shared_ptr<const DecodedChunk> decoded = DecodeSnapshot(chunk);
+				for (size_t i = 0; i < decoded->times.size(); i++)
+				{
+					if (decoded->times[i] >= start && decoded->times[i] < end)
+					{
+						values->push_back({ decoded->times[i], decoded->values[i] });
+					}
+				}
+			}
+			return true;
+		}
+		size_t TimeSeriesStore::EvictOlderThan(uint64_t time)
+		{
+			size_t evicted = 0;
+			for (auto &&shard : m_shards)
+			{
+				std::lock_guard<std::mutex> lock(shard->mutex);
+				for (auto &&entry : shard->series)
+				{
+					StoreSeries &series = entry.second;
+					while (!series.sealed.empty() && series.sealed.front().max_time < time)
+					{
+						mReleaseChunk(series.sealed.front());
+						series.sealed.pop_front();
+						evicted++;
+					}
+					// The chunk being written goes too if all of it is too old, the next append
+					// starts a new one
+					if (series.sealed.empty() && series.head.buffer && series.head.count > 0 && series.head.max_time < time)
+					{
+						mReleaseChunk(series.head);
+						evicted++;
+					}
+				}
+			}
+
+			// Let go of budget entries for chunks that are gone now.  The shard lock is always
+			// taken before the eviction lock, so look at each entry without holding both
+			while (true)
+			{
+				EvictionEntry entry;
+				{
+					std::lock_guard<std::mutex> lock(m_eviction_mutex);
+					if (m_eviction_queue.empty()) break;
+					entry = m_eviction_queue.front();
+				}
+				{
+					StoreShard &shard = mShard(entry.series_id);
+					std::lock_guard<std::mutex> lock(shard.mutex);
+					auto found = shard.series.find(entry.series_id);
+					if (found != shard.series.end() && !found->second.sealed.empty() && found->second.sealed.front().sequence <= entry.sequence) break;
+				}
+				std::lock_guard<std::mutex> lock(m_eviction_mutex);
+				if (!m_eviction_queue.empty() && m_eviction_queue.front().series_id == entry.series_id && m_eviction_queue.front().sequence == entry.sequence)
+				{
+					m_eviction_queue.pop_front();
+				}
+			}
+			return evicted;
+		}
+		size_t TimeSeriesStore::ApplyRetention(uint64_t now)
+		{
+			if (m_options.retention_nanoseconds == 0) return 0;
+			return EvictOlderThan(now > m_options.retention_nanoseconds ? now - m_options.retention_nanoseconds : 0);
+		}
+		size_t TimeSeriesStore::SeriesCount()
+		{
+			size_t count = 0;
+			for (auto &&shard : m_shards)
+			{
+				std::lock_guard<std::mutex> lock(shard->mutex);
+				count += shard->series.size();
+			}
+			return count;
+		}
+		size_t TimeSeriesStore::ChunkCount(uint64_t series_id)
+		{
+			StoreShard &shard = mShard(series_id);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.series.find(series_id);
+			if (found == shard.series.end()) return 0;
+			return found->second.sealed.size() + (found->second.head.buffer ? 1 : 0);
+		}
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include "TimeSeriesCompression.h"
+#include "TimeSeriesCache.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		struct StoreOptions
+		{
+			// Bytes of each chunk.  A full chunk is sealed and a new one started
+			size_t chunk_size = 4096;
+			// Chunks with nothing newer than this, counting back from the time given to
+			// ApplyRetention, are dropped.  0 keeps everything
+			uint64_t retention_nanoseconds = 0;
+			// Most bytes of chunk storage to keep.  The chunks sealed longest ago go first once
+			// it is passed, chunks still being written are never dropped.  0 for no limit
+			size_t memory_budget = 0;
+			// Entropy code chunks when they are sealed ( see SealEntropyCoded )
+			bool entropy_coded = false;
+			// End each chunk with a checksum ( see SetChecksum ).  Readers of snapshots can check
+			// it with VerifyChecksum
+			bool checksum = false;
+			// Series are split into this many groups, each with its own lock
+			size_t num_shards = 64;
+			// Decoded sealed chunks are looked up in and added to this cache if given.  It can be
+			// shared between stores
+			DecodedChunkCache *cache = nullptr;
+		};
+
+		// A chunk taken out of a store to be decoded without it.  Either the decoded samples
+		// came from the cache, or reader has a copy of the chunk
+		struct ChunkSnapshot
+		{
+			// Stays the same for as long as a sealed chunk exists, and is never reused.  0 for
+			// the chunk still being written
+			uint64_t chunk_id = 0;
+			std::unique_ptr<SingleTimeSeriesReadBuffer> reader;
+			std::shared_ptr<const DecodedChunk> decoded;
+		};
+
+		// In memory store of many series.  Each series is a chain of sealed chunks plus the
+		// chunk being written, all single series buffers.  Series are spread over shards
+		// with a lock each, so appends to different series rarely wait on each other
+		class TimeSeriesStore
+		{
+		public:
+			TimeSeriesStore(const StoreOptions &options = StoreOptions());
+			virtual ~TimeSeriesStore() {}
+
+			// Returns false if the series already exists
+			bool CreateSeries(uint64_t series_id, const SeriesSchema &schema);
+			// Drop a series and all of its chunks
+			bool DropSeries(uint64_t series_id);
+			bool Append(uint64_t series_id, SingleTimeSeriesValue ts_value);
+			bool Append(uint64_t series_id, const SingleTimeSeriesValue *values, size_t count, size_t *values_added);
+			// Samples of the series with start <= time < end, in the order they were added
+			bool ReadRange(uint64_t series_id, uint64_t start, uint64_t end, std::vector<SingleTimeSeriesValue> *values);
+			// The chunks of the series that may have samples with start <= time < end, oldest
+			// first.  Only chunks that aren't cached are copied
+			bool SnapshotRange(uint64_t series_id, uint64_t start, uint64_t end, std::vector<ChunkSnapshot> *chunks);
+			// Samples of a snapshot, decoding them and adding them to the cache if need be
+			std::shared_ptr<const DecodedChunk> DecodeSnapshot(ChunkSnapshot &snapshot);
+
+			// Drop every chunk with nothing at or after time.  Returns the number of chunks dropped
+			size_t EvictOlderThan(uint64_t time);
+			// EvictOlderThan the retention period before now
+			size_t ApplyRetention(uint64_t now);
+
+			// Bytes of chunk storage in use, chunks being written count in full
+			size_t MemoryUsed() { return m_memory_used.load(); }
+			size_t SeriesCount();
+			size_t ChunkCount(uint64_t series_id);
+
+		protected:
+			struct StoreChunk
+			{
+				std::unique_ptr<SingleTimeSeriesWriteBuffer> buffer;
+				uint64_t min_time = 0;
+				uint64_t max_time = 0;
+				size_t count = 0;
+				size_t bytes = 0;
+				// Id given when the chunk is sealed, in the order they are sealed.  Ids come from
+				// one counter for every store so they can share a cache
+				uint64_t sequence = 0;
+			};
+			struct StoreSeries
+			{
+				SeriesSchema schema;
+				std::deque<StoreChunk> sealed;
+				StoreChunk head;
+			};
+			struct StoreShard
+			{
+				std::mutex mutex;
+				std::unordered_map<uint64_t, StoreSeries> series;
+			};
+			// Sealed chunks in the order they were sealed, for the memory budget.  Entries for
+			// chunks that were already dropped are skipped
+			struct EvictionEntry
+			{
+				uint64_t series_id;
+				uint64_t sequence;
+			};
+
+			StoreShard &mShard(uint64_t series_id);
+			// These expect the shard lock to be held
+			bool mAppendLocked(uint64_t series_id, StoreSeries &series, const SingleTimeSeriesValue *values, size_t count, size_t *values_added, bool *sealed);
+			bool mStartHead(StoreSeries &series);
+			void mSealHead(uint64_t series_id, StoreSeries &series);
+			void mReleaseChunk(StoreChunk &chunk);
+			// Drop the chunks sealed longest ago until the store is back within its budget
+			void mEnforceBudget();
+
+			StoreOptions m_options;
+			std::vector<std::unique_ptr<StoreShard>> m_shards;
+			std::atomic<size_t> m_memory_used;
+
+			std::mutex m_eviction_mutex;
+			std::deque<EvictionEntry> m_eviction_queue;
+
+		private:
+			TimeSeriesStore(const TimeSeriesStore &) = delete;
+			TimeSeriesStore &operator = (const TimeSeriesStore &) = delete;
+		};
+	}
+}
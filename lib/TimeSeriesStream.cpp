@@ -0,0 +1,150 @@
+#include "TimeSeriesStream.h"
+#include <algorithm>
+
+namespace oscill {
+	namespace io {
+
+		SingleTimeSeriesPushDecoder::SingleTimeSeriesPushDecoder(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max) :
+			SingleTimeSeriesReadBuffer(precision_decimal_places, time_precision_nanoseconds_pow, min, max)
+		{}
+		void SingleTimeSeriesPushDecoder::mSaveState(PointState *state)
+		{
+			state->previous_timestamp = m_previous_timestamp;
+			state->previous_delta = m_previous_delta;
+			state->value_state = m_value_state;
+			state->last_value = m_last_value;
+			state->last_quantized = m_last_quantized;
+			state->entropy_changed = m_entropy_changed;
+			state->index = m_index;
+		}
+		void SingleTimeSeriesPushDecoder::mRestoreState(const PointState &state)
+		{
+			m_previous_timestamp = state.previous_timestamp;
+			m_previous_delta = state.previous_delta;
+			m_value_state = state.value_state;
+			m_last_value = state.last_value;
+			m_last_quantized = state.last_quantized;
+			m_entropy_changed = state.entropy_changed;
+			m_index = state.index;
+		}
+		void SingleTimeSeriesPushDecoder::mView(const uint8_t *data, size_t size, size_t window_start)
+		{
+			m_data.AssignView(const_cast<uint8_t *>(data), size);
+			m_size = size;
+			m_window_start = window_start;
+		}
+		size_t SingleTimeSeriesPushDecoder::mHeldLimit()
+		{
+			size_t limit = (m_stream_bytes > m_holdback_bytes) ? (m_stream_bytes - m_holdback_bytes) * 8 : 0;
+			if (m_finished) limit = std::min(m_end_bits, m_stream_bytes * 8);
+			return limit;
+		}
+		bool SingleTimeSeriesPushDecoder::mDecode(size_t stop_bit, bool at_stream_end, std::vector<SingleTimeSeriesValue> *values)
+		{
+			while (m_position < stop_bit)
+			{
+				size_t limit = at_stream_end ? mHeldLimit() : (m_window_start + m_size) * 8;
+				if (m_position >= limit) break;
+
+				// Every attempt starts over from the last whole point
+				size_t bit_in_view = m_position - m_window_start * 8;
+				m_current_data_index = bit_in_view / 8;
+				m_remaining_bits_in_byte = (uint8_t)(8 - bit_in_view % 8);
+				m_num_bits_available = (int64_t)(limit - m_position);
+
+				if (m_first_read)
+				{
+					if (!m_ReadHeader())
+					{
+						// Not all there yet, anything it read gets read again
+						m_first_read = true;
+						m_flags = 0;
+						m_value_codec = k_value_raw;
+						break;
+					}
+					if (m_flags & (FormatFlags::k_regular_interval | FormatFlags::k_run_length | FormatFlags::k_swing_door)) m_failed = true;
+					if (m_value_codec == k_value_dictionary) m_failed = true;
+					if (m_failed) return false;
+					m_holdback_bytes = 1 + m_checksum_bits / 8;
+				}
+				else
+				{
+					PointState state;
+					mSaveState(&state);
+					SingleTimeSeriesValue ts_value;
+					if (!ReadNext(&ts_value))
+					{
+						mRestoreState(state);
+						break;
+					}
+					values->push_back(ts_value);
+				}
+				m_position = m_window_start * 8 + BitPosition();
+			}
+			return true;
+		}
+		void SingleTimeSeriesPushDecoder::mCarryRest(const uint8_t *data, size_t size)
+		{
+			size_t first_byte = m_position / 8 - m_window_start;
+			if (data == m_carry.data())
+			{
+				m_carry.erase(m_carry.begin(), m_carry.begin() + std::min(first_byte, m_carry.size()));
+			}
+			else
+			{
+				m_carry.assign(data + std::min(first_byte, size), data + size);
+			}
+			m_window_start += first_byte;
+			m_data.AssignView(nullptr, 0);
+			m_size = 0;
+		}
+		bool SingleTimeSeriesPushDecoder::Push(const void *data, size_t size, std::vector<SingleTimeSeriesValue> *values)
+		{
+			if (!values || m_finished || m_failed) return false;
+			const uint8_t *bytes = (const uint8_t *)data;
+			m_stream_bytes += size;
+
+			size_t fragment_start = m_stream_bytes - size;
+			if (!m_carry.empty())
+			{
+				// Finish the points that started in the carried bytes with the front of the fragment
+				size_t spliced = std::min(size, (size_t)k_splice_bytes);
+				m_carry.insert(m_carry.end(), bytes, bytes + spliced);
+				mView(m_carry.data(), m_carry.size(), m_window_start);
+				if (!mDecode(fragment_start * 8, spliced == size, values)) return false;
+
+				if (m_position < fragment_start * 8)
+				{
+					if (spliced < size)
+					{
+						// A point longer than expected, fall back on carrying the whole fragment
+						m_carry.insert(m_carry.end(), bytes + spliced, bytes + size);
+						mView(m_carry.data(), m_carry.size(), m_window_start);
+						if (!mDecode(SIZE_MAX, true, values)) return false;
+					}
+					mCarryRest(m_carry.data(), m_carry.size());
+					return true;
+				}
+				m_carry.clear();
+			}
+
+			// The rest is read straight out of the fragment
+			mView(bytes, size, fragment_start);
+			if (!mDecode(SIZE_MAX, true, values)) return false;
+			mCarryRest(bytes, size);
+			return true;
+		}
+		bool SingleTimeSeriesPushDecoder::Finish(size_t num_bits, std::vector<SingleTimeSeriesValue> *values)
+		{
+			if (!values || m_finished || m_failed) return false;
+			m_finished = true;
+			m_end_bits = num_bits;
+
+			// Whatever was held back is in the carried bytes
+			mView(m_carry.data(), m_carry.size(), m_window_start);
+			bool decoded = mDecode(SIZE_MAX, true, values);
+			mCarryRest(m_carry.data(), m_carry.size());
+			return decoded;
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "TimeSeriesCompression.h"
+#include <vector>
+
+namespace oscill {
+	namespace io {
+		// Decodes a single series buffer as it arrives, from fragments of any size, for
+		// example off of a socket.  Points come out as soon as all of their bits are in.
+		// Fragments are read in place, only the bytes of a point cut in two by the end of a
+		// fragment are carried over to the next one.  Takes the formats that concurrent reads
+		// do ( see SetConcurrentReads ), the others rewrite bits that may already have gone.
+		// A checksum at the end is skipped over, not checked
+		class SingleTimeSeriesPushDecoder : protected SingleTimeSeriesReadBuffer
+		{
+		public:
+			// Same settings the buffer was written with
+			SingleTimeSeriesPushDecoder(const int precision_decimal_places, const int time_precision_nanoseconds_pow, const double min, const double max);
+			virtual ~SingleTimeSeriesPushDecoder() {}
+
+			// Add the next bytes of the stream, and the points they complete to values.  Points
+			// ending in the last byte so far ( the last 5 with a checksum ) are held back, they
+			// could still be padding.  The header isn't read until 5 bytes past it are in, an
+			// empty buffer with a checksum is nothing but the checksum.  Returns false if the
+			// format can't be streamed or the stream was already finished
+			bool Push(const void *data, size_t size, std::vector<SingleTimeSeriesValue> *values);
+			// End of the stream.  num_bits is the number of bits of samples, what Seal returned,
+			// and decides which of the held back points are real
+			bool Finish(size_t num_bits, std::vector<SingleTimeSeriesValue> *values);
+
+			// Bytes carried over, waiting for the rest of a point
+			size_t BytesHeld() { return m_carry.size(); }
+			size_t PointCount() { return m_index; }
+
+			// More than any one point takes.  When bytes are carried over, this much of the next
+			// fragment is added to them to finish the point
+			static constexpr size_t k_splice_bytes = 64;
+
+		protected:
+			// Everything reading a point changes, to take back one that wasn't all there
+			struct PointState
+			{
+				uint64_t previous_timestamp;
+				uint64_t previous_delta;
+				ValueCodecState value_state;
+				double last_value;
+				uint64_t last_quantized;
+				bool entropy_changed;
+				uint32_t index;
+			};
+			void mSaveState(PointState *state);
+			void mRestoreState(const PointState &state);
+
+			// Read from data, which starts at byte window_start of the stream
+			void mView(const uint8_t *data, size_t size, size_t window_start);
+			// Read points starting before stop_bit while they fit.  Up to the end of the data in
+			// view, or up to what isn't held back if that is the end of what has arrived
+			bool mDecode(size_t stop_bit, bool at_stream_end, std::vector<SingleTimeSeriesValue> *values);
+			// Where points have to end by at the end of what has arrived
+			size_t mHeldLimit();
+			// Keep the bytes of data in view from the current position on
+			void mCarryRest(const uint8_t *data, size_t size);
+
+			std::vector<uint8_t> m_carry;
+			// Stream byte the data in view starts at, and the bit reading is up to
+			size_t m_window_start = 0;
+			size_t m_position = 0;
+			size_t m_stream_bytes = 0;
+			// Until the header says whether there is a checksum, leave room for one
+			size_t m_holdback_bytes = 5;
+			size_t m_end_bits = SIZE_MAX;
+			bool m_finished = false;
+			bool m_failed = false;
+		};
+	}
+}
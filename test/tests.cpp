@@ -1,8 +1,18 @@
 #include <vector>
 #include "../lib/TimeSeriesCompression.h"
+#include "../lib/TimeSeriesKernels.h"
+#include "../lib/TimeSeriesStore.h"
+#include "../lib/TimeSeriesQuery.h"
+#include "../lib/TimeSeriesIterator.h"
+#include "../lib/TimeSeriesMerge.h"
+#include "../lib/TimeSeriesReorder.h"
+#include "../lib/TimeSeriesStream.h"
 #include <iostream>
 #include <assert.h>
 #include <random>
+#include <limits>
+#include <algorithm>
+#include <thread>
 
 #define BUFFER_SIZE 65535
 
@@ -13,8 +23,8 @@ using std::endl;
 
 struct TestTimeValue
 {
-	oscill::io::TimeSeriesValue set;
-	oscill::io::TimeSeriesValue expected;
+	oscill::io::SingleTimeSeriesValue set;
+	oscill::io::SingleTimeSeriesValue expected;
 };
 
 struct TestTimeValues
@@ -232,7 +242,7 @@ int main()
 
 		for (auto&& value : test.values)
 		{
-			oscill::io::TimeSeriesValue to_read;
+			oscill::io::SingleTimeSeriesValue to_read;
 			assert(test_oscillio_read_buff.ReadNext(&to_read) != false);
 			if (to_read.time != value.expected.time)
 			{
@@ -247,7 +257,1677 @@ int main()
 		
 	}
 
-	
+	// Regular interval timestamps, including a missed sample and a late one
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> regular_values;
+		for (uint64_t i = 0; i < 50; i++)
+		{
+			regular_values.push_back({ 1000000000 + i * 1000000, (double)(i % 7) });
+		}
+		regular_values[20].time += 1000000;
+		regular_values[30].time += 250000;
+
+		oscill::io::SingleTimeSeriesWriteBuffer regular_write_buff(1, 3, 0.0, 100.0, 1024);
+		assert(regular_write_buff.SetRegularInterval(1000000));
+		for (auto&& value : regular_values)
+		{
+			assert(regular_write_buff.AddValue(value));
+		}
+		assert(regular_write_buff.SetRegularInterval(1000000) == false);
+
+		oscill::io::SingleTimeSeriesReadBuffer regular_read_buff(regular_write_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> regular_read = regular_read_buff.ReadAll();
+		assert(regular_read.size() == regular_values.size());
+		for (size_t i = 0; i < regular_values.size(); i++)
+		{
+			assert(regular_read[i].time == regular_values[i].time);
+			assert(regular_read[i].value == regular_values[i].value);
+		}
+
+		std::vector<oscill::io::ValueTypeDefinition> definitions{ { "temperature", 1, -50.0, 150.0 }, { "load", 2, 0.0, 1.0 } };
+		oscill::io::MultipleTimeSeriesWriteBuffer multiple_write_buff(3, definitions, 1024);
+		assert(multiple_write_buff.SetRegularInterval(1000000));
+		for (auto&& value : regular_values)
+		{
+			oscill::io::LabeledTimeSeriesValues row{ value.time, { { "temperature", value.value - 10.0 }, { "load", value.value / 10.0 } } };
+			assert(multiple_write_buff.AddValue(row));
+		}
+
+		oscill::io::MultipleTimeSeriesReadBuffer multiple_read_buff(multiple_write_buff.RawData(), multiple_write_buff.Size());
+		std::vector<uint64_t> times(regular_values.size());
+		assert(multiple_read_buff.GenerateTimes(0, times.size(), times.data()));
+		for (size_t i = 0; i < regular_values.size(); i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row;
+			assert(multiple_read_buff.ReadNext(&row));
+			assert(times[i] == regular_values[i].time);
+			assert(row.time == regular_values[i].time);
+			assert(row.labeled_values[0].first == "temperature");
+			assert(row.labeled_values[0].second == regular_values[i].value - 10.0);
+			assert(fabs(row.labeled_values[1].second - regular_values[i].value / 10.0) < 0.011);
+		}
+		oscill::io::LabeledTimeSeriesValues past_end;
+		assert(multiple_read_buff.ReadNext(&past_end) == false);
+	}
+
+	// Run length encoding of idle samples, including a run longer than a single token
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> flat_values;
+		for (uint64_t i = 0; i < 70000; i++)
+		{
+			double value = (i >= 5 && i < 8) ? 42.5 : 17.0;
+			flat_values.push_back({ 1000 + i * 10, value });
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer flat_write_buff(1, 0, 0.0, 100.0, 1024);
+		assert(flat_write_buff.SetRunLengthEncoding());
+		for (auto&& value : flat_values)
+		{
+			assert(flat_write_buff.AddValue(value));
+		}
+		assert(flat_write_buff.BitPosition() < 200);
+
+		oscill::io::SingleTimeSeriesReadBuffer flat_read_buff(flat_write_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> flat_read;
+		for (size_t i = 0; i < 20; i++)
+		{
+			oscill::io::SingleTimeSeriesValue to_read;
+			assert(flat_read_buff.ReadNext(&to_read));
+			flat_read.push_back(to_read);
+		}
+		flat_read_buff.ReadAll(&flat_read);
+		flat_read.resize(flat_values.size());
+		for (size_t i = 0; i < flat_values.size(); i++)
+		{
+			assert(flat_read[i].time == flat_values[i].time);
+			assert(flat_read[i].value == flat_values[i].value);
+		}
+
+		std::vector<oscill::io::ValueTypeDefinition> definitions{ { "state", 0, 0.0, 10.0 }, { "level", 1, 0.0, 100.0 } };
+		oscill::io::MultipleTimeSeriesWriteBuffer multiple_write_buff(0, definitions, 1024);
+		assert(multiple_write_buff.SetRunLengthEncoding());
+		for (uint64_t i = 0; i < 100; i++)
+		{
+			double level = (i == 50) ? 12.5 : 7.5;
+			oscill::io::LabeledTimeSeriesValues row{ 500 + i * 3, { { "state", 3.0 }, { "level", level } } };
+			assert(multiple_write_buff.AddValue(row));
+		}
+
+		oscill::io::MultipleTimeSeriesReadBuffer multiple_read_buff(multiple_write_buff.RawData(), multiple_write_buff.Size());
+		for (uint64_t i = 0; i < 100; i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row;
+			assert(multiple_read_buff.ReadNext(&row));
+			assert(row.time == 500 + i * 3);
+			assert(row.labeled_values[0].second == 3.0);
+			assert(row.labeled_values[1].second == ((i == 50) ? 12.5 : 7.5));
+		}
+	}
+
+	// Every class of timestamp control code, decoded through the lookup table and the
+	// bit at a time path at the very end of the buffer
+	{
+		std::vector<int64_t> deltas_of_deltas{ 0, 1, -1, 33, -40, 200, -255, 1500, -2000, 100000, -300000, 0, 5, 0 };
+		std::vector<oscill::io::SingleTimeSeriesValue> code_values;
+		uint64_t time = 1000000;
+		int64_t delta = 10;
+		code_values.push_back({ time, 1.0 });
+		for (auto&& delta_of_delta : deltas_of_deltas)
+		{
+			delta += delta_of_delta;
+			time += delta;
+			code_values.push_back({ time, 1.0 });
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer code_write_buff(0, 0, 0.0, 10.0, 34);
+		for (auto&& value : code_values)
+		{
+			assert(code_write_buff.AddValue(value));
+		}
+
+		oscill::io::SingleTimeSeriesReadBuffer code_read_buff(code_write_buff);
+		for (auto&& value : code_values)
+		{
+			oscill::io::SingleTimeSeriesValue to_read;
+			assert(code_read_buff.ReadNext(&to_read));
+			assert(to_read.time == value.time);
+			assert(to_read.value == value.value);
+		}
+	}
+
+	// Every kernel variant the CPU supports has to match the scalar kernels exactly
+	{
+		std::uniform_real_distribution<double> kernel_values(-3000000.0, 3000000.0);
+		std::vector<double> doubles(1003);
+		for (auto&& value : doubles)
+		{
+			value = kernel_values(gen);
+		}
+		doubles[5] = 1e300;
+		doubles[6] = -1e300;
+		doubles[7] = std::numeric_limits<double>::infinity();
+		doubles[8] = -std::numeric_limits<double>::infinity();
+		doubles[13] = std::numeric_limits<double>::quiet_NaN();
+
+		assert(oscill::io::ForceKernelVariant(oscill::io::k_kernel_scalar));
+		const oscill::io::Kernels scalar = oscill::io::GetKernels();
+		std::vector<int64_t> expected_quantized(doubles.size());
+		std::vector<int64_t> expected_narrow(doubles.size());
+		scalar.quantize(doubles.data(), doubles.size(), -2500000.0, 2500000.0, 1000.0, -2500000000, expected_quantized.data());
+		scalar.quantize(doubles.data(), doubles.size(), -1000.0, 1000.0, 100.0, -100000, expected_narrow.data());
+
+		for (int variant = oscill::io::k_kernel_scalar; variant <= oscill::io::DetectKernelVariant(); variant++)
+		{
+			assert(oscill::io::ForceKernelVariant((oscill::io::KernelVariant)variant));
+			const oscill::io::Kernels &kernels = oscill::io::GetKernels();
+			assert(kernels.variant == variant);
+
+			std::vector<int64_t> quantized(doubles.size());
+			kernels.quantize(doubles.data(), doubles.size(), -2500000.0, 2500000.0, 1000.0, -2500000000, quantized.data());
+			assert(quantized == expected_quantized);
+
+			// Everything clamped here fits the vector truncation, only NaN has to leave it
+			kernels.quantize(doubles.data(), doubles.size(), -1000.0, 1000.0, 100.0, -100000, quantized.data());
+			assert(quantized == expected_narrow);
+
+			for (int num_bits = 1; num_bits <= 64; num_bits++)
+			{
+				uint64_t mask = (num_bits == 64) ? ~(uint64_t)0 : (((uint64_t)1 << num_bits) - 1);
+				std::vector<uint64_t> fields(77);
+				for (auto&& field : fields)
+				{
+					field = dis(gen) & mask;
+				}
+
+				std::vector<uint8_t> packed((fields.size() * num_bits + 3 + 7) / 8);
+				std::vector<uint8_t> expected_packed(packed.size());
+				kernels.pack_bits(fields.data(), fields.size(), num_bits, packed.data(), 3);
+				scalar.pack_bits(fields.data(), fields.size(), num_bits, expected_packed.data(), 3);
+				assert(packed == expected_packed);
+			}
+
+			// Runs of repeats, including ones that cross the vector widths
+			std::vector<int64_t> steps(1001);
+			for (size_t i = 0; i < steps.size(); i++)
+			{
+				steps[i] = (int64_t)(i / (1 + i % 5));
+			}
+			std::vector<uint8_t> changed(steps.size());
+			std::vector<uint8_t> expected_changed(steps.size());
+			kernels.mark_changes(steps.data(), steps.size(), 0, changed.data());
+			scalar.mark_changes(steps.data(), steps.size(), 0, expected_changed.data());
+			assert(changed == expected_changed);
+		}
+		assert(oscill::io::ForceKernelVariant(oscill::io::DetectKernelVariant()));
+		assert(oscill::io::ForceKernelVariant(oscill::io::k_kernel_variant_count) == false);
+	}
+
+	// Adding values in batches has to give the same bits as adding them one at a time
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> batch_values;
+		std::uniform_int_distribution<int> batch_steps(0, 3);
+		std::uniform_real_distribution<double> batch_jumps(-6000000.0, 6000000.0);
+		double batch_value = 0.0;
+		for (uint64_t i = 0; i < 5000; i++)
+		{
+			// Mostly repeats, sometimes past the limits
+			int step = batch_steps(gen);
+			if (step == 3) batch_value = batch_jumps(gen);
+			oscill::io::SingleTimeSeriesValue value;
+			value.time = 1000000000ull * i;
+			value.value = batch_value;
+			batch_values.push_back(value);
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer single_buff(3, 0, -3000000.0, 3000000.0, 1024 * 64);
+		for (auto&& value : batch_values)
+		{
+			assert(single_buff.AddValue(value));
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer batch_buff(3, 0, -3000000.0, 3000000.0, 1024 * 64);
+		size_t values_added = 0;
+		assert(batch_buff.AddValues(batch_values, &values_added));
+		assert(values_added == batch_values.size());
+		assert(memcmp(single_buff.RawData(), batch_buff.RawData(), single_buff.Size()) == 0);
+
+		// Running out of room part way through has to stop at the same point too
+		oscill::io::SingleTimeSeriesWriteBuffer single_full_buff(3, 0, -3000000.0, 3000000.0, 1024 * 4);
+		size_t single_added = 0;
+		while (single_added < batch_values.size() && single_full_buff.AddValue(batch_values[single_added]))
+		{
+			single_added++;
+		}
+		assert(single_added < batch_values.size());
+
+		oscill::io::SingleTimeSeriesWriteBuffer batch_full_buff(3, 0, -3000000.0, 3000000.0, 1024 * 4);
+		assert(batch_full_buff.AddValues(batch_values.data(), batch_values.size(), &values_added) == false);
+		assert(values_added == single_added);
+		assert(memcmp(single_full_buff.RawData(), batch_full_buff.RawData(), single_full_buff.Size()) == 0);
+	}
+
+	// Filling a buffer to the last bit, then sealing it down to size
+	{
+		std::uniform_real_distribution<double> fill_dis(-3000000.0, 3000000.0);
+		std::vector<oscill::io::SingleTimeSeriesValue> fill_values;
+		for (uint64_t i = 0; i < 1000; i++)
+		{
+			// Every 7th sample is late so regular interval buffers collect exceptions
+			uint64_t late = (i % 7 == 3) ? 400000 : 0;
+			fill_values.push_back({ 1000000000ull + i * 1000000 + late, fill_dis(gen) });
+		}
+
+		for (int regular = 0; regular < 2; regular++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer fill_buff(3, 5, -3000000.0, 3000000.0, 96);
+			if (regular) assert(fill_buff.SetRegularInterval(1000000));
+			size_t fill_added = 0;
+			while (fill_buff.AddValue(fill_values[fill_added]))
+			{
+				fill_added++;
+			}
+			assert(fill_added > 0);
+
+			// The failed point left nothing behind
+			oscill::io::SingleTimeSeriesReadBuffer fill_read_buff(fill_buff);
+			std::vector<oscill::io::SingleTimeSeriesValue> fill_read = fill_read_buff.ReadAll();
+			assert(fill_read.size() == fill_added);
+
+			size_t used_bits = fill_buff.Seal();
+			assert(used_bits == fill_buff.BitPosition());
+			assert(fill_buff.Size() <= 96);
+			assert(fill_buff.AddValue(fill_values[0]) == false);
+
+			oscill::io::SingleTimeSeriesReadBuffer sealed_read_buff(3, 5, -3000000.0, 3000000.0, fill_buff.RawData(), fill_buff.Size());
+			assert(sealed_read_buff.LimitToBits(used_bits));
+			std::vector<oscill::io::SingleTimeSeriesValue> sealed_read = sealed_read_buff.ReadAll();
+			assert(sealed_read.size() == fill_added);
+			for (size_t i = 0; i < fill_added; i++)
+			{
+				assert(sealed_read[i].time == fill_read[i].time);
+				assert(sealed_read[i].value == fill_read[i].value);
+			}
+		}
+
+		std::vector<oscill::io::ValueTypeDefinition> definitions{ { "temperature", 2, -50.0, 150.0 }, { "load", 1, 0.0, 100.0 } };
+		oscill::io::MultipleTimeSeriesWriteBuffer multiple_fill_buff(3, definitions, 160);
+		size_t rows_added = 0;
+		while (true)
+		{
+			oscill::io::LabeledTimeSeriesValues row{ 1000000000ull + rows_added * 7000000, { { "temperature", (double)(rows_added % 150) }, { "load", (double)(rows_added % 90) } } };
+			if (!multiple_fill_buff.AddValue(row)) break;
+			rows_added++;
+		}
+		assert(rows_added > 0);
+		size_t multiple_used_bits = multiple_fill_buff.Seal();
+
+		oscill::io::MultipleTimeSeriesReadBuffer multiple_fill_read_buff(multiple_fill_buff.RawData(), multiple_fill_buff.Size());
+		assert(multiple_fill_read_buff.LimitToBits(multiple_used_bits));
+		for (size_t i = 0; i < rows_added; i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row;
+			assert(multiple_fill_read_buff.ReadNext(&row));
+			assert(row.time == 1000000000ull + i * 7000000);
+			assert(row.labeled_values[0].second == (double)(i % 150));
+			assert(row.labeled_values[1].second == (double)(i % 90));
+		}
+		oscill::io::LabeledTimeSeriesValues past_end;
+		assert(multiple_fill_read_buff.ReadNext(&past_end) == false);
+	}
+
+	// Estimated sizes match what actually gets written, whatever the encoding
+	{
+		std::uniform_int_distribution<int> estimate_steps(0, 9);
+		std::vector<oscill::io::SingleTimeSeriesValue> estimate_values;
+		std::vector<oscill::io::LabeledTimeSeriesValues> estimate_rows;
+		uint64_t estimate_time = 1000000000ull;
+		double estimate_value = 5.0;
+		for (int i = 0; i < 3000; i++)
+		{
+			// Mostly steady, with changed values, jitter and the odd big gap
+			int step = estimate_steps(gen);
+			if (i >= 500 && i < 800) step = 5;
+			estimate_time += 1000000;
+			if (step == 0) estimate_time += 3000;
+			if (step == 1 && i % 100 == 1) estimate_time += 100000000000ull;
+			if (step >= 7) estimate_value = (double)(dis2(gen) % 1000);
+			estimate_values.push_back({ estimate_time, estimate_value });
+			estimate_rows.push_back({ estimate_time, { { "a", estimate_value }, { "b", 2.0 } } });
+		}
+
+		for (int mode = 0; mode < 3; mode++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer estimate_buff(1, 3, 0.0, 1000.0, 1024 * 64);
+			if (mode == 1) assert(estimate_buff.SetRegularInterval(1000000));
+			if (mode == 2) assert(estimate_buff.SetRunLengthEncoding());
+
+			int64_t estimated_bits = estimate_buff.EstimateBits(estimate_values.data(), 1000);
+			assert(estimate_buff.BitPosition() == 0);
+			for (int i = 0; i < 1000; i++)
+			{
+				assert(estimate_buff.AddValue(estimate_values[i]));
+			}
+			int64_t used_bits = (int64_t)estimate_buff.Size() * 8 - estimate_buff.BitsAvailable();
+			assert(estimated_bits == used_bits);
+
+			// Estimating from part way through a buffer
+			estimated_bits = estimate_buff.EstimateBits(estimate_values.data() + 1000, 2000);
+			for (int i = 1000; i < 3000; i++)
+			{
+				assert(estimate_buff.AddValue(estimate_values[i]));
+			}
+			assert(estimated_bits == (int64_t)estimate_buff.Size() * 8 - estimate_buff.BitsAvailable() - used_bits);
+
+			std::vector<oscill::io::ValueTypeDefinition> definitions{ { "a", 1, 0.0, 1000.0 }, { "b", 2, 0.0, 10.0 } };
+			oscill::io::MultipleTimeSeriesWriteBuffer multiple_estimate_buff(3, definitions, 1024 * 64);
+			if (mode == 1) assert(multiple_estimate_buff.SetRegularInterval(1000000));
+			if (mode == 2) assert(multiple_estimate_buff.SetRunLengthEncoding());
+			estimated_bits = multiple_estimate_buff.EstimateBits(estimate_rows);
+			for (auto&& row : estimate_rows)
+			{
+				assert(multiple_estimate_buff.AddValue(row));
+			}
+			assert(estimated_bits == (int64_t)multiple_estimate_buff.Size() * 8 - multiple_estimate_buff.BitsAvailable());
+		}
+	}
+
+	// Every value codec reads back the same values, alone and with the other encodings
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> codec_values;
+		for (uint64_t i = 0; i < 2000; i++)
+		{
+			// A slow wave, a stretch of random jumps, and some flat spots
+			double value = 500.0 + 400.0 * sin(i / 50.0);
+			if (i >= 800 && i < 900) value = (double)(dis2(gen) % 1000);
+			if (i >= 1200 && i < 1300) value = 250.0;
+			codec_values.push_back({ 1000000000ull + i * 1000000, value });
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer raw_buff(2, 3, 0.0, 1000.0, 1024 * 64);
+		for (auto&& value : codec_values)
+		{
+			assert(raw_buff.AddValue(value));
+		}
+		oscill::io::SingleTimeSeriesReadBuffer raw_read_buff(raw_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> expected = raw_read_buff.ReadAll();
+		assert(expected.size() == codec_values.size());
+
+		for (int codec = oscill::io::k_value_raw; codec < oscill::io::k_value_codec_count; codec++)
+		{
+			for (int mode = 0; mode < 3; mode++)
+			{
+				oscill::io::SingleTimeSeriesWriteBuffer codec_buff(2, 3, 0.0, 1000.0, 1024 * 64);
+				if (mode == 1) assert(codec_buff.SetRegularInterval(1000000));
+				if (mode == 2) assert(codec_buff.SetRunLengthEncoding());
+				assert(codec_buff.SetValueCodec((oscill::io::ValueCodec)codec));
+
+				int64_t estimated_bits = codec_buff.EstimateBits(codec_values.data(), codec_values.size());
+				size_t values_added = 0;
+				assert(codec_buff.AddValues(codec_values, &values_added));
+				assert(estimated_bits == (int64_t)codec_buff.Size() * 8 - codec_buff.BitsAvailable());
+				assert(codec_buff.SetValueCodec(oscill::io::k_value_raw) == false);
+
+				oscill::io::SingleTimeSeriesReadBuffer codec_read_buff(codec_buff);
+				std::vector<oscill::io::SingleTimeSeriesValue> codec_read = codec_read_buff.ReadAll();
+				assert(codec_read.size() == expected.size());
+				for (size_t i = 0; i < expected.size(); i++)
+				{
+					assert(codec_read[i].time == expected[i].time);
+					assert(codec_read[i].value == expected[i].value);
+				}
+			}
+		}
+
+		// A slowly changing series is smallest as deltas
+		oscill::io::SingleTimeSeriesWriteBuffer select_buff(2, 3, 0.0, 1000.0, 1024 * 64);
+		assert(select_buff.SelectValueCodec(codec_values.data(), 500) == oscill::io::k_value_delta);
+		oscill::io::SingleTimeSeriesWriteBuffer tolerant_buff(2, 3, 0.0, 1000.0, 1024 * 64);
+		assert(tolerant_buff.SelectValueCodec(codec_values.data(), 500, 100.0) == oscill::io::k_value_raw);
+
+		// A first value at the minimum is the same as the starting last value
+		oscill::io::SingleTimeSeriesWriteBuffer xor_min_buff(2, 3, 0.0, 1000.0, 1024);
+		assert(xor_min_buff.SetValueCodec(oscill::io::k_value_xor));
+		std::vector<oscill::io::SingleTimeSeriesValue> xor_min_values = { { 1000000000ull, 0.0 }, { 2000000000ull, 1.5 }, { 3000000000ull, 1.5 }, { 4000000000ull, 0.0 } };
+		for (auto &&value : xor_min_values)
+		{
+			assert(xor_min_buff.AddValue(value));
+		}
+		oscill::io::SingleTimeSeriesReadBuffer xor_min_read(xor_min_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> xor_min_read_back = xor_min_read.ReadAll();
+		assert(xor_min_read_back.size() == xor_min_values.size());
+		for (size_t i = 0; i < xor_min_values.size(); i++)
+		{
+			assert(xor_min_read_back[i].time == xor_min_values[i].time && xor_min_read_back[i].value == xor_min_values[i].value);
+		}
+	}
+
+	// Counters take a couple of bits per sample, resets included
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> counter_values;
+		double counter = 0.0;
+		for (uint64_t i = 0; i < 5000; i++)
+		{
+			// Steady traffic with the odd burst, and a restart every so often
+			counter += (i % 97 == 5) ? 4096.0 + (double)(dis2(gen) % 1000) : 1500.0;
+			if (i % 1500 == 1499) counter = 12.0;
+			counter_values.push_back({ 1000000000ull + i * 1000000000ull, counter });
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer counter_buff(0, 9, 0.0, 4000000000.0, 1024 * 64);
+		assert(counter_buff.SelectValueCodec(counter_values.data(), 1000) == oscill::io::k_value_counter);
+		for (auto&& value : counter_values)
+		{
+			assert(counter_buff.AddValue(value));
+		}
+		assert(counter_buff.BitPosition() < counter_values.size() * 4);
+
+		oscill::io::SingleTimeSeriesReadBuffer counter_read_buff(counter_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> counter_read = counter_read_buff.ReadAll();
+		assert(counter_read.size() == counter_values.size());
+		for (size_t i = 0; i < counter_values.size(); i++)
+		{
+			assert(counter_read[i].time == counter_values[i].time);
+			assert(counter_read[i].value == counter_values[i].value);
+		}
+	}
+
+	// Swing door buffers keep only line segment end points, within the error bound
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> smooth_values;
+		for (uint64_t i = 0; i < 20000; i++)
+		{
+			// A slow wave with a step in the middle
+			double value = 50.0 + 40.0 * sin(i / 2000.0) + ((i >= 10000) ? 5.0 : 0.0);
+			smooth_values.push_back({ 1000000000ull + i * 1000000, value });
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer lossless_buff(3, 0, 0.0, 100.0, 1024 * 256);
+		size_t values_added = 0;
+		assert(lossless_buff.AddValues(smooth_values, &values_added));
+
+		oscill::io::SwingDoorWriteBuffer swing_buff(3, 0, 0.0, 100.0, 0.05, 1024 * 256);
+		assert(swing_buff.SetRegularInterval(1000000) == false);
+		assert(swing_buff.AddValues(smooth_values, &values_added));
+		assert(values_added == smooth_values.size());
+		assert(swing_buff.BitPosition() * 10 < lossless_buff.BitPosition());
+
+		oscill::io::SingleTimeSeriesReadBuffer swing_read_buff(swing_buff);
+		assert(swing_read_buff.ErrorBound() == 0.05);
+		std::vector<uint64_t> times;
+		for (auto&& value : smooth_values)
+		{
+			times.push_back(value.time);
+		}
+		std::vector<double> interpolated(times.size());
+		assert(swing_read_buff.Interpolate(times.data(), times.size() / 2, interpolated.data()));
+		assert(swing_read_buff.Interpolate(times.data() + times.size() / 2, times.size() - times.size() / 2, interpolated.data() + times.size() / 2));
+		for (size_t i = 0; i < smooth_values.size(); i++)
+		{
+			// The bound plus the quantization step
+			assert(fabs(interpolated[i] - smooth_values[i].value) <= 0.05 + 0.0011);
+		}
+
+		// The newest sample is always stored
+		oscill::io::SingleTimeSeriesReadBuffer swing_end_buff(swing_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> end_points = swing_end_buff.ReadAll();
+		assert(end_points.size() < smooth_values.size() / 10);
+		assert(end_points.front().time == smooth_values.front().time);
+		assert(end_points.back().time == smooth_values.back().time);
+	}
+
+	// Dictionary buffers store indexes of a few distinct values, and can be filtered on them
+	{
+		const double codes[5] = { 200.0, 404.0, 500.0, 200.0, 503.0 };
+		std::vector<oscill::io::SingleTimeSeriesValue> status_values;
+		std::vector<uint64_t> expected_404;
+		for (uint64_t i = 0; i < 3000; i++)
+		{
+			double code = codes[dis2(gen) % 5];
+			status_values.push_back({ 1000000000ull + i * 1000000, code });
+			if (code == 404.0) expected_404.push_back(status_values.back().time);
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer status_raw_buff(0, 3, 0.0, 100000.0, 1024 * 64);
+		size_t values_added = 0;
+		assert(status_raw_buff.AddValues(status_values, &values_added));
+
+		for (uint32_t capacity = 2; capacity <= 8; capacity += 6)
+		{
+			// With room for only 2 entries the rest are escaped
+			oscill::io::SingleTimeSeriesWriteBuffer status_buff(0, 3, 0.0, 100000.0, 1024 * 64);
+			assert(status_buff.SetDictionary(capacity));
+			int64_t estimated_bits = status_buff.EstimateBits(status_values.data(), status_values.size());
+			assert(status_buff.AddValues(status_values, &values_added));
+			assert(estimated_bits == (int64_t)status_buff.BitPosition());
+			if (capacity == 8) assert(status_buff.BitPosition() < status_raw_buff.BitPosition() * 3 / 4);
+
+			oscill::io::SingleTimeSeriesReadBuffer status_read_buff(status_buff);
+			std::vector<oscill::io::SingleTimeSeriesValue> status_read = status_read_buff.ReadAll();
+			assert(status_read.size() == status_values.size());
+			for (size_t i = 0; i < status_values.size(); i++)
+			{
+				assert(status_read[i].value == status_values[i].value);
+			}
+
+			oscill::io::SingleTimeSeriesReadBuffer status_filter_buff(status_buff);
+			std::vector<uint64_t> times_404;
+			assert(status_filter_buff.FindEqual(404.0, &times_404));
+			assert(times_404 == expected_404);
+		}
+
+		// Entries found by a value that didn't fit are taken back out
+		oscill::io::SingleTimeSeriesWriteBuffer status_full_buff(0, 3, 0.0, 100000.0, 48);
+		assert(status_full_buff.SetDictionary(4));
+		size_t status_added = 0;
+		while (status_full_buff.AddValue(status_values[status_added]))
+		{
+			status_added++;
+		}
+		oscill::io::SingleTimeSeriesReadBuffer status_full_read_buff(status_full_buff);
+		std::vector<oscill::io::SingleTimeSeriesValue> status_full_read = status_full_read_buff.ReadAll();
+		assert(status_full_read.size() == status_added);
+		for (size_t i = 0; i < status_added; i++)
+		{
+			assert(status_full_read[i].value == status_values[i].value);
+		}
+	}
+
+	// Entropy coding the points of a sealed buffer makes it smaller and reads back the same
+	{
+		std::vector<oscill::io::SingleTimeSeriesValue> jitter_values;
+		uint64_t jitter_time = 1000000000ull;
+		for (uint64_t i = 0; i < 5000; i++)
+		{
+			// Mostly on time, sometimes a little late or early, with the odd long gap
+			int jitter = (int)(dis2(gen) % 7) - 3;
+			jitter_time += 1000000 + ((i % 4 == 0) ? jitter * 1000 : 0) + ((i % 997 == 0) ? 5000000000ull : 0);
+			// Starting at zero covers the XOR codec's first value matching the initial last value
+			jitter_values.push_back({ jitter_time, (i == 0) ? 0.0 : (double)(dis2(gen) % 4) * 10.0 });
+		}
+
+		for (int codec = oscill::io::k_value_raw; codec < oscill::io::k_value_codec_count; codec++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer plain_buff(1, 3, 0.0, 100.0, 1024 * 64);
+			oscill::io::SingleTimeSeriesWriteBuffer entropy_buff(1, 3, 0.0, 100.0, 1024 * 64);
+			assert(plain_buff.SetValueCodec((oscill::io::ValueCodec)codec));
+			assert(entropy_buff.SetValueCodec((oscill::io::ValueCodec)codec));
+			size_t values_added = 0;
+			assert(plain_buff.AddValues(jitter_values, &values_added));
+			assert(entropy_buff.AddValues(jitter_values, &values_added));
+
+			size_t plain_bits = plain_buff.Seal();
+			size_t entropy_bits = entropy_buff.SealEntropyCoded();
+			assert(entropy_buff.IsSealed());
+			assert(entropy_bits < plain_bits);
+			assert(entropy_buff.Size() < plain_buff.Size());
+			assert(entropy_buff.AddValue(jitter_values.back()) == false);
+
+			oscill::io::SingleTimeSeriesReadBuffer entropy_read_buff(entropy_buff);
+			std::vector<oscill::io::SingleTimeSeriesValue> entropy_read = entropy_read_buff.ReadAll();
+			assert(entropy_read.size() == jitter_values.size());
+			for (size_t i = 0; i < jitter_values.size(); i++)
+			{
+				assert(entropy_read[i].time == jitter_values[i].time);
+				assert(entropy_read[i].value == jitter_values[i].value);
+			}
+
+			std::vector<uint64_t> plain_times;
+			std::vector<uint64_t> entropy_times;
+			oscill::io::SingleTimeSeriesReadBuffer plain_filter_buff(plain_buff);
+			oscill::io::SingleTimeSeriesReadBuffer entropy_filter_buff(entropy_buff);
+			assert(plain_filter_buff.FindEqual(20.0, &plain_times));
+			assert(entropy_filter_buff.FindEqual(20.0, &entropy_times));
+			assert(!entropy_times.empty() && entropy_times == plain_times);
+		}
+
+		// Runs are already as small as they get, so those stay plain
+		oscill::io::SingleTimeSeriesWriteBuffer run_buff(1, 3, 0.0, 100.0, 1024 * 64);
+		assert(run_buff.SetRunLengthEncoding());
+		size_t values_added = 0;
+		assert(run_buff.AddValues(jitter_values, &values_added));
+		size_t run_bits = run_buff.BitPosition();
+		assert(run_buff.SealEntropyCoded() == run_bits);
+	}
+
+	// Buffers draw their storage from the default allocator and give it back to it
+	{
+		for (int huge_pages = 0; huge_pages < 2; huge_pages++)
+		{
+			oscill::io::SlabBufferAllocator slab_allocator(huge_pages != 0);
+			oscill::io::SetDefaultBufferAllocator(&slab_allocator);
+
+			std::vector<oscill::io::SingleTimeSeriesValue> slab_values;
+			for (uint64_t i = 0; i < 1000; i++)
+			{
+				slab_values.push_back({ 1000000000ull + i * 1000000, (double)(i % 50) });
+			}
+
+			void *first_storage = nullptr;
+			for (int round = 0; round < 3; round++)
+			{
+				oscill::io::SingleTimeSeriesWriteBuffer slab_buff(1, 3, 0.0, 100.0, 1024 * 64);
+				if (round == 0) first_storage = slab_buff.RawData();
+
+				// Retired storage is reused, and comes back zeroed
+				if (round == 2) assert(slab_buff.RawData() == first_storage);
+				size_t values_added = 0;
+				assert(slab_buff.AddValues(slab_values, &values_added));
+
+				oscill::io::SingleTimeSeriesReadBuffer slab_read_buff(slab_buff);
+				std::vector<oscill::io::SingleTimeSeriesValue> slab_read = slab_read_buff.ReadAll();
+				assert(slab_read.size() == slab_values.size());
+				for (size_t i = 0; i < slab_values.size(); i++)
+				{
+					assert(slab_read[i].time == slab_values[i].time);
+					assert(slab_read[i].value == slab_values[i].value);
+				}
+
+				// Sealing moves the samples into a smaller block
+				slab_buff.Seal();
+				assert(slab_buff.Size() < 1024 * 64);
+				assert(slab_buff.RawData() != first_storage);
+				oscill::io::SingleTimeSeriesReadBuffer sealed_read_buff(slab_buff);
+				assert(sealed_read_buff.ReadAll().size() == slab_values.size());
+			}
+			assert(slab_allocator.SlabCount() > 0 && slab_allocator.SlabCount() <= 4);
+
+			// Too big for a slab, straight from the heap
+			size_t big_capacity = 0;
+			uint8_t *big = slab_allocator.Allocate(oscill::io::SlabBufferAllocator::k_max_block_size + 1, &big_capacity);
+			assert(big && big_capacity == oscill::io::SlabBufferAllocator::k_max_block_size + 1);
+			slab_allocator.Release(big, big_capacity);
+
+			oscill::io::SetDefaultBufferAllocator(nullptr);
+		}
+	}
+
+	// A head block keeps many open series in packed arrays and shared pages
+	{
+		static_assert(oscill::io::HeadBlock::k_state_bytes_per_series < 100, "head block state per series");
+
+		oscill::io::HeadBlock head;
+		uint32_t fine_schema = 0;
+		uint32_t coarse_schema = 0;
+		assert(head.AddSchema({ 3, 3, -1000.0, 1000.0 }, &fine_schema));
+		assert(head.AddSchema({ 0, 6, 0.0, 100.0 }, &coarse_schema));
+		uint32_t unknown_schema_series = 0;
+		assert(head.AddSeries(7, &unknown_schema_series) == false);
+
+		const uint32_t num_series = 1000;
+		for (uint32_t i = 0; i < num_series; i++)
+		{
+			uint32_t series_id = 0;
+			assert(head.AddSeries((i % 3 == 0) ? coarse_schema : fine_schema, &series_id));
+			assert(series_id == i);
+		}
+		assert(head.SeriesCount() == num_series);
+
+		// Samples arrive interleaved across the series, until the chunks fill up
+		std::vector<std::vector<oscill::io::SingleTimeSeriesValue>> head_expected(num_series);
+		std::vector<bool> head_full(num_series, false);
+		for (uint64_t step = 0; step < 200; step++)
+		{
+			for (uint32_t i = 0; i < num_series; i++)
+			{
+				if (head_full[i]) continue;
+				uint64_t time = 1000000000ull + step * 1000000000ull + ((step % 5 == 0) ? 3000000 * (i % 4) : 0);
+				double value = (i % 3 == 0) ? (double)((step / 10 + i) % 100) : (double)((int)(step * 7 + i) % 2000 - 1000) / 8.0;
+				if (head.AddValue(i, { time, value }))
+				{
+					head_expected[i].push_back({ time, value });
+				}
+				else
+				{
+					head_full[i] = true;
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < num_series; i++)
+		{
+			std::vector<oscill::io::SingleTimeSeriesValue> head_read;
+			assert(head.ReadSeries(i, &head_read));
+			assert(head_read.size() == head_expected[i].size() && head_read.size() > 10);
+			for (size_t j = 0; j < head_read.size(); j++)
+			{
+				assert(head_read[j].time == head_expected[i][j].time);
+				assert(head_read[j].value == head_expected[i][j].value);
+			}
+
+			// The chunk reads the same as a single series buffer with the same samples
+			const oscill::io::SeriesSchema &schema = head.Schema(i);
+			oscill::io::SingleTimeSeriesWriteBuffer same_buff(schema.precision_decimal_places, schema.time_precision_nanoseconds_pow, schema.min, schema.max, head.ChunkSize());
+			size_t values_added = 0;
+			assert(same_buff.AddValues(head_expected[i], &values_added));
+			assert(same_buff.BitPosition() == head.SeriesBits(i));
+			assert(memcmp(same_buff.RawData(), head.SeriesData(i), head.ChunkSize()) == 0);
+		}
+
+		// A full series starts over once it is moved out
+		head.ResetSeries(0);
+		assert(head.SeriesBits(0) == 0);
+		assert(head.AddValue(0, { 5000000000000ull, 42.0 }));
+		std::vector<oscill::io::SingleTimeSeriesValue> reset_read;
+		assert(head.ReadSeries(0, &reset_read));
+		assert(reset_read.size() == 1 && reset_read[0].time == 5000000000000ull && reset_read[0].value == 42.0);
+	}
+
+	// The store keeps a chain of chunks per series, appended to from many threads at once
+	{
+		oscill::io::StoreOptions store_options;
+		store_options.chunk_size = 256;
+		store_options.retention_nanoseconds = 500ull * 1000000000ull;
+		oscill::io::TimeSeriesStore store(store_options);
+
+		const uint64_t num_store_series = 64;
+		const uint64_t samples_per_series = 1000;
+		for (uint64_t id = 0; id < num_store_series; id++)
+		{
+			assert(store.CreateSeries(id * 1000, { 2, 6, 0.0, 1000.0 }));
+		}
+		assert(store.CreateSeries(0, { 2, 6, 0.0, 1000.0 }) == false);
+		assert(store.SeriesCount() == num_store_series);
+		assert(store.Append(12345, { 1, 1.0 }) == false);
+
+		// Each thread appends to every series, taking turns on the timestamps so they stay in order
+		auto store_value = [](uint64_t id, uint64_t i) { return (double)((id + i / 3) % 1000) / 4.0; };
+		auto store_time = [](uint64_t i) { return 1000000000ull * (i + 1); };
+		const int num_threads = 4;
+		std::vector<std::thread> writers;
+		for (int t = 0; t < num_threads; t++)
+		{
+			writers.push_back(std::thread([&, t]()
+			{
+				for (uint64_t id = t; id < num_store_series; id += num_threads)
+				{
+					for (uint64_t i = 0; i < samples_per_series; i += 50)
+					{
+						std::vector<oscill::io::SingleTimeSeriesValue> batch;
+						for (uint64_t j = i; j < i + 50; j++)
+						{
+							batch.push_back({ store_time(j), store_value(id, j) });
+						}
+						size_t values_added = 0;
+						assert(store.Append(id * 1000, batch.data(), batch.size(), &values_added));
+						assert(values_added == batch.size());
+					}
+				}
+			}));
+		}
+		for (auto &&writer : writers)
+		{
+			writer.join();
+		}
+
+		for (uint64_t id = 0; id < num_store_series; id++)
+		{
+			assert(store.ChunkCount(id * 1000) > 2);
+			std::vector<oscill::io::SingleTimeSeriesValue> range;
+			assert(store.ReadRange(id * 1000, store_time(100), store_time(900), &range));
+			assert(range.size() == 800);
+			for (size_t i = 0; i < range.size(); i++)
+			{
+				assert(range[i].time == store_time(100 + i));
+				assert(range[i].value == store_value(id, 100 + i));
+			}
+		}
+
+		// Retention drops whole chunks that are entirely too old
+		size_t memory_before = store.MemoryUsed();
+		assert(store.ApplyRetention(store_time(samples_per_series)) > 0);
+		assert(store.MemoryUsed() < memory_before);
+		std::vector<oscill::io::SingleTimeSeriesValue> retained;
+		assert(store.ReadRange(0, 0, store_time(samples_per_series), &retained));
+		assert(retained.back().time == store_time(samples_per_series - 1));
+		assert(retained.front().time <= store_time(samples_per_series - 500) && retained.front().time > store_time(0));
+
+		assert(store.DropSeries(0));
+		assert(store.DropSeries(0) == false);
+		assert(store.ReadRange(0, 0, store_time(samples_per_series), &retained) == false);
+
+		// With a budget the chunks sealed longest ago are dropped first
+		store_options.retention_nanoseconds = 0;
+		store_options.memory_budget = 16 * 1024;
+		oscill::io::TimeSeriesStore budget_store(store_options);
+		for (uint64_t id = 0; id < 8; id++)
+		{
+			assert(budget_store.CreateSeries(id, { 2, 6, 0.0, 1000.0 }));
+		}
+		for (uint64_t i = 0; i < 5000; i++)
+		{
+			for (uint64_t id = 0; id < 8; id++)
+			{
+				assert(budget_store.Append(id, { store_time(i), store_value(id, i) }));
+			}
+			assert(budget_store.MemoryUsed() <= store_options.memory_budget + 8 * store_options.chunk_size);
+		}
+		std::vector<oscill::io::SingleTimeSeriesValue> budget_read;
+		assert(budget_store.ReadRange(3, 0, store_time(5000), &budget_read));
+		assert(budget_read.back().time == store_time(4999) && budget_read.front().time > store_time(0));
+	}
+
+	// Queries across many series decode every chunk on the pool and stream each series back
+	{
+		oscill::io::StoreOptions query_options;
+		query_options.chunk_size = 512;
+		oscill::io::TimeSeriesStore query_store(query_options);
+		auto query_time = [](uint64_t i) { return 1000000000ull * (i + 1); };
+		auto query_value = [](uint64_t id, uint64_t i) { return (double)((id * 7 + i) % 500) / 2.0; };
+
+		oscill::io::Query query;
+		for (uint64_t id = 0; id < 200; id++)
+		{
+			assert(query_store.CreateSeries(id, { 1, 6, 0.0, 500.0 }));
+			std::vector<oscill::io::SingleTimeSeriesValue> series_values;
+			for (uint64_t i = 0; i < 2000; i++)
+			{
+				series_values.push_back({ query_time(i), query_value(id, i) });
+			}
+			size_t values_added = 0;
+			assert(query_store.Append(id, series_values.data(), series_values.size(), &values_added));
+			query.series_ids.push_back(id);
+		}
+		query.series_ids.push_back(999999);
+		query.start = query_time(150);
+		query.end = query_time(1850);
+
+		oscill::io::WorkStealingPool pool(4);
+		assert(pool.ThreadCount() == 4);
+		oscill::io::QueryExecutor executor(query_store, pool);
+
+		std::vector<oscill::io::QueryResult> query_results;
+		assert(executor.Run(query, &query_results));
+		assert(query_results.size() == query.series_ids.size());
+		for (size_t r = 0; r < 200; r++)
+		{
+			std::vector<oscill::io::SingleTimeSeriesValue> expected;
+			assert(query_store.ReadRange(r, query.start, query.end, &expected));
+			assert(query_results[r].found && query_results[r].series_id == r);
+			assert(query_results[r].values.size() == 1700);
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				assert(query_results[r].values[i].time == expected[i].time);
+				assert(query_results[r].values[i].value == expected[i].value);
+			}
+		}
+		assert(query_results.back().found == false && query_results.back().values.empty());
+
+		// Streamed one series at a time, bucketed into 100 second means
+		query.aggregation = oscill::io::k_aggregate_mean;
+		query.bucket_nanoseconds = 100ull * 1000000000ull;
+		std::vector<int> seen(query.series_ids.size(), 0);
+		assert(executor.Run(query, [&](oscill::io::QueryResult &result)
+		{
+			size_t index = (result.series_id == 999999) ? 200 : (size_t)result.series_id;
+			seen[index]++;
+			if (!result.found) return;
+
+			assert(result.values.size() == 17);
+			for (size_t b = 0; b < result.values.size(); b++)
+			{
+				double sum = 0.0;
+				for (uint64_t i = 150 + b * 100; i < 250 + b * 100; i++)
+				{
+					sum += query_value(result.series_id, i);
+				}
+				assert(result.values[b].time == query.start + b * query.bucket_nanoseconds);
+				assert(fabs(result.values[b].value - sum / 100.0) < 1e-9);
+			}
+		}));
+		for (auto &&count : seen)
+		{
+			assert(count == 1);
+		}
+
+		query.aggregation = oscill::io::k_aggregate_max;
+		query.bucket_nanoseconds = 0;
+		query_results.clear();
+		assert(executor.Run(query, &query_results));
+		assert(query_results[3].values.size() == 1 && query_results[3].values[0].value == 249.5);
+	}
+
+	// Decoded chunks are cached, a scan of chunks used once doesn't push out the ones used again
+	{
+		auto make_chunk = [](size_t count)
+		{
+			std::shared_ptr<oscill::io::DecodedChunk> chunk(new oscill::io::DecodedChunk());
+			chunk->times.assign(count, 1);
+			chunk->values.assign(count, 1.0);
+			return chunk;
+		};
+		size_t chunk_bytes = make_chunk(100)->Bytes();
+		oscill::io::DecodedChunkCache cache(chunk_bytes * 10, 1);
+		cache.Insert(1, make_chunk(100));
+		cache.Insert(2, make_chunk(100));
+		assert(cache.Find(1) && cache.Find(2));
+		for (uint64_t id = 100; id < 200; id++)
+		{
+			cache.Insert(id, make_chunk(100));
+		}
+		assert(cache.Find(1) && cache.Find(2));
+		assert(!cache.Find(100) && cache.Find(199));
+		oscill::io::DecodedChunkCache::Counters counters = cache.GetCounters();
+		assert(counters.hits == 5 && counters.misses == 1 && counters.insertions == 102);
+		assert(counters.evictions == 92 && counters.bytes == chunk_bytes * 10);
+		cache.Erase(1);
+		assert(!cache.Find(1) && cache.GetCounters().bytes == chunk_bytes * 9);
+
+		// A store reading through the cache gives the same samples and skips decoding the second time
+		oscill::io::DecodedChunkCache store_cache(1 << 24);
+		oscill::io::StoreOptions cached_options;
+		cached_options.chunk_size = 256;
+		cached_options.cache = &store_cache;
+		oscill::io::TimeSeriesStore cached_store(cached_options);
+		oscill::io::TimeSeriesStore plain_store;
+		for (uint64_t id = 0; id < 20; id++)
+		{
+			assert(cached_store.CreateSeries(id, { 2, 6, -100.0, 100.0 }));
+			assert(plain_store.CreateSeries(id, { 2, 6, -100.0, 100.0 }));
+			for (uint64_t i = 0; i < 1000; i++)
+			{
+				oscill::io::SingleTimeSeriesValue value = { 1000000000ull * (i + 1), sin((double)(id + i) / 10.0) * 50.0 };
+				assert(cached_store.Append(id, value) && plain_store.Append(id, value));
+			}
+		}
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (uint64_t id = 0; id < 20; id++)
+			{
+				std::vector<oscill::io::SingleTimeSeriesValue> cached_read, plain_read;
+				assert(cached_store.ReadRange(id, 1000000000ull * 100, 1000000000ull * 900, &cached_read));
+				assert(plain_store.ReadRange(id, 1000000000ull * 100, 1000000000ull * 900, &plain_read));
+				assert(cached_read.size() == 800 && cached_read.size() == plain_read.size());
+				for (size_t i = 0; i < cached_read.size(); i++)
+				{
+					assert(cached_read[i].time == plain_read[i].time && cached_read[i].value == plain_read[i].value);
+				}
+			}
+			counters = store_cache.GetCounters();
+			assert(pass == 0 ? (counters.hits == 0 && counters.insertions > 0) : (counters.hits == counters.insertions));
+		}
+
+		// The executor goes through the cache as well
+		oscill::io::WorkStealingPool pool(2);
+		oscill::io::QueryExecutor executor(cached_store, pool);
+		oscill::io::Query query;
+		query.series_ids = { 0, 5, 19 };
+		query.aggregation = oscill::io::k_aggregate_count;
+		std::vector<oscill::io::QueryResult> query_results;
+		uint64_t hits_before = store_cache.GetCounters().hits;
+		assert(executor.Run(query, &query_results));
+		assert(query_results.size() == 3 && query_results[1].values[0].value == 1000.0);
+		assert(store_cache.GetCounters().hits > hits_before);
+
+		// Dropping a series takes its chunks out of the cache
+		size_t bytes_before = store_cache.GetCounters().bytes;
+		assert(cached_store.DropSeries(0));
+		assert(store_cache.GetCounters().bytes < bytes_before);
+	}
+
+	// A live buffer can be read in place from other threads while values are still being added
+	{
+		const size_t live_count = 100000;
+		auto live_value = [](size_t i) { return (double)(i % 1000) / 4.0; };
+		oscill::io::SingleTimeSeriesWriteBuffer live_buffer(2, 3, 0.0, 300.0, 1 << 20);
+		assert(live_buffer.SetConcurrentReads() && live_buffer.ConcurrentReads());
+		assert(!live_buffer.SetRegularInterval(1000) && !live_buffer.SetRunLengthEncoding());
+		assert(!live_buffer.SetDictionary(16));
+
+		// Nothing published yet
+		oscill::io::SingleTimeSeriesReadBuffer empty_reader(live_buffer, true);
+		oscill::io::SingleTimeSeriesValue live_read;
+		assert(!empty_reader.ReadNext(&live_read));
+
+		std::atomic<bool> writing(true);
+		std::thread writer([&]()
+		{
+			// Every other block of 50 goes in one value at a time
+			std::vector<oscill::io::SingleTimeSeriesValue> batch;
+			for (size_t i = 0; i < live_count; i++)
+			{
+				oscill::io::SingleTimeSeriesValue value = { 1000000ull * (i + 1) + (i % 7) * 1000, live_value(i) };
+				if ((i / 50) % 2 == 0)
+				{
+					assert(live_buffer.AddValue(value));
+					continue;
+				}
+				batch.push_back(value);
+				if (batch.size() == 50 || i + 1 == live_count)
+				{
+					size_t values_added = 0;
+					assert(live_buffer.AddValues(batch, &values_added) && values_added == batch.size());
+					batch.clear();
+				}
+			}
+			writing = false;
+		});
+
+		// Whole reads from the start, and a reader following the tail with Refresh
+		std::thread snapshot_reader([&]()
+		{
+			size_t last_size = 0;
+			while (writing)
+			{
+				oscill::io::SingleTimeSeriesReadBuffer reader(live_buffer, true);
+				std::vector<oscill::io::SingleTimeSeriesValue> values = reader.ReadAll();
+				assert(values.size() >= last_size);
+				for (size_t i = 0; i < values.size(); i++)
+				{
+					assert(values[i].value == live_value(i));
+				}
+				last_size = values.size();
+			}
+		});
+		std::vector<oscill::io::SingleTimeSeriesValue> tailed;
+		oscill::io::SingleTimeSeriesReadBuffer tail_reader(live_buffer, true);
+		while (tailed.size() < live_count)
+		{
+			assert(tail_reader.Refresh());
+			while (tail_reader.ReadNext(&live_read))
+			{
+				tailed.push_back(live_read);
+			}
+		}
+		writer.join();
+		snapshot_reader.join();
+
+		std::vector<oscill::io::SingleTimeSeriesValue> copied = oscill::io::SingleTimeSeriesReadBuffer(live_buffer).ReadAll();
+		assert(copied.size() == live_count);
+		for (size_t i = 0; i < live_count; i++)
+		{
+			assert(tailed[i].time == copied[i].time && tailed[i].value == copied[i].value);
+		}
+		assert(empty_reader.Refresh() && empty_reader.ReadAll().size() == live_count);
+
+		// Without concurrent reads the reader takes a copy, and swing door can't have them
+		oscill::io::SingleTimeSeriesWriteBuffer plain_buffer(2, 3, 0.0, 300.0, 4096);
+		assert(plain_buffer.AddValue({ 1000000, 1.5 }));
+		oscill::io::SingleTimeSeriesReadBuffer copy_reader(plain_buffer, true);
+		assert(!copy_reader.Refresh() && copy_reader.ReadAll().size() == 1);
+		assert(!plain_buffer.SetConcurrentReads());
+		oscill::io::SwingDoorWriteBuffer live_swing(2, 3, 0.0, 300.0, 0.5, 4096);
+		assert(!live_swing.SetConcurrentReads());
+	}
+
+	// Iterators decode lazily, each begin() is a cursor of its own, and AdvanceTo skips ahead
+	{
+		for (int runs = 0; runs < 2; runs++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer iterate_buffer(1, 6, 0.0, 100.0, 1 << 16);
+			if (runs) assert(iterate_buffer.SetRunLengthEncoding());
+			std::vector<oscill::io::SingleTimeSeriesValue> iterate_values;
+			for (uint64_t i = 0; i < 5000; i++)
+			{
+				iterate_values.push_back({ 1000000000ull * (i + 1), (double)((i / 40) % 100) });
+			}
+			size_t values_added = 0;
+			assert(iterate_buffer.AddValues(iterate_values, &values_added) && values_added == iterate_values.size());
+
+			oscill::io::SingleTimeSeriesReadBuffer iterate_reader(iterate_buffer);
+			oscill::io::SingleTimeSeriesRange range(iterate_reader);
+			size_t index = 0;
+			for (auto &&value : range)
+			{
+				assert(value.time == iterate_values[index].time && value.value == iterate_values[index].value);
+				index++;
+			}
+			assert(index == iterate_values.size());
+			assert(std::count_if(range.begin(), range.end(), [](const oscill::io::SingleTimeSeriesValue &value) { return value.value == 3.0; }) == 80);
+
+			// Two cursors don't disturb each other or the reader
+			oscill::io::SingleTimeSeriesIterator first = range.begin();
+			oscill::io::SingleTimeSeriesIterator second = range.begin();
+			assert(first != second && first != range.end());
+			first.AdvanceTo(iterate_values[1234].time + 1);
+			assert(first->time == iterate_values[1235].time && first->value == iterate_values[1235].value);
+			assert((*second++).time == iterate_values[0].time && second->time == iterate_values[1].time);
+			first.AdvanceTo(0);
+			assert(first->time == iterate_values[1235].time);
+			++first;
+			assert(first->time == iterate_values[1236].time && first->value == iterate_values[1236].value);
+			first.AdvanceTo(iterate_values.back().time);
+			assert(first->value == iterate_values.back().value);
+			assert(++first == range.end());
+			second.AdvanceTo(iterate_values.back().time + 1);
+			assert(second == range.end());
+			oscill::io::SingleTimeSeriesValue reader_first;
+			assert(iterate_reader.ReadNext(&reader_first) && reader_first.time == iterate_values[0].time);
+		}
+
+		std::vector<oscill::io::ValueTypeDefinition> definitions{ { "temperature", 2, -50.0, 150.0 }, { "load", 1, 0.0, 100.0 } };
+		oscill::io::MultipleTimeSeriesWriteBuffer multiple_iterate_buff(3, definitions, 1 << 14);
+		for (uint64_t i = 0; i < 500; i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row{ 1000000000ull + i * 7000000, { { "temperature", (double)(i % 150) }, { "load", (double)(i % 90) } } };
+			assert(multiple_iterate_buff.AddValue(row));
+		}
+		size_t multiple_iterate_bits = multiple_iterate_buff.Seal();
+		oscill::io::MultipleTimeSeriesReadBuffer multiple_iterate_read(multiple_iterate_buff.RawData(), multiple_iterate_buff.Size());
+		assert(multiple_iterate_read.LimitToBits(multiple_iterate_bits));
+		oscill::io::MultipleTimeSeriesRange multiple_range(multiple_iterate_read);
+		oscill::io::MultipleTimeSeriesIterator row = multiple_range.begin();
+		row.AdvanceTo(1000000000ull + 300 * 7000000);
+		assert(row->labeled_values[0].second == 0.0 && row->labeled_values[1].second == 30.0);
+		size_t rows = 0;
+		for (auto &&multiple_row : multiple_range)
+		{
+			assert(multiple_row.time == 1000000000ull + rows * 7000000);
+			rows++;
+		}
+		assert(rows == 500);
+	}
+
+	// Sorted buffers merge into new ones a batch at a time, with duplicate timestamps resolved
+	{
+		// Three overlapping inputs, every third time appears in two of them
+		std::vector<std::vector<oscill::io::SingleTimeSeriesValue>> merge_values(3);
+		std::vector<std::unique_ptr<oscill::io::SingleTimeSeriesWriteBuffer>> merge_writers;
+		std::vector<std::unique_ptr<oscill::io::SingleTimeSeriesReadBuffer>> merge_readers;
+		for (uint64_t input = 0; input < 3; input++)
+		{
+			for (uint64_t i = input; i < 6000; i += 2 + (i % 3 == 0 ? 0 : 1))
+			{
+				merge_values[input].push_back({ 1000000000ull * (i + 1), (double)(i % 200) + (double)input / 10.0 });
+			}
+			merge_writers.emplace_back(new oscill::io::SingleTimeSeriesWriteBuffer(1, 6, 0.0, 300.0, 1 << 16));
+			size_t values_added = 0;
+			assert(merge_writers.back()->AddValues(merge_values[input], &values_added) && values_added == merge_values[input].size());
+			merge_readers.emplace_back(new oscill::io::SingleTimeSeriesReadBuffer(*merge_writers.back()));
+		}
+
+		for (int policy = oscill::io::k_duplicates_keep_first; policy <= oscill::io::k_duplicates_keep_all; policy++)
+		{
+			// What the merge should come up with, done the slow way
+			std::vector<std::pair<oscill::io::SingleTimeSeriesValue, size_t>> all_values;
+			for (size_t input = 0; input < 3; input++)
+			{
+				for (auto &&value : merge_values[input]) all_values.push_back({ value, input });
+			}
+			std::stable_sort(all_values.begin(), all_values.end(), [](const std::pair<oscill::io::SingleTimeSeriesValue, size_t> &a, const std::pair<oscill::io::SingleTimeSeriesValue, size_t> &b)
+			{
+				return a.first.time < b.first.time || (a.first.time == b.first.time && a.second < b.second);
+			});
+			std::vector<oscill::io::SingleTimeSeriesValue> expected;
+			for (auto &&value : all_values)
+			{
+				bool duplicate = !expected.empty() && expected.back().time == value.first.time;
+				if (!duplicate || policy == oscill::io::k_duplicates_keep_all) expected.push_back(value.first);
+				else if (policy == oscill::io::k_duplicates_keep_last) expected.back() = value.first;
+			}
+
+			// Compacted into small buffers one after another, with the delta codec
+			oscill::io::SingleTimeSeriesMerger merger((oscill::io::DuplicatePolicy)policy);
+			for (auto &&reader : merge_readers)
+			{
+				assert(merger.AddInput(*reader));
+			}
+			std::vector<oscill::io::SingleTimeSeriesValue> merged;
+			size_t outputs = 0;
+			while (!merger.Done())
+			{
+				oscill::io::SingleTimeSeriesWriteBuffer output(1, 6, 0.0, 300.0, 2048);
+				assert(output.SetValueCodec(oscill::io::k_value_delta));
+				size_t values_written = 0;
+				bool finished = merger.MergeInto(output, &values_written);
+				assert(finished == merger.Done() && values_written > 0);
+				std::vector<oscill::io::SingleTimeSeriesValue> output_values = oscill::io::SingleTimeSeriesReadBuffer(output).ReadAll();
+				assert(output_values.size() == values_written);
+				merged.insert(merged.end(), output_values.begin(), output_values.end());
+				outputs++;
+			}
+			assert(outputs > 1 && !merger.AddInput(*merge_readers[0]));
+			assert(merged.size() == expected.size());
+			assert(merger.DuplicatesDropped() == all_values.size() - expected.size());
+			assert(policy == oscill::io::k_duplicates_keep_all ? merger.DuplicatesDropped() == 0 : merger.DuplicatesDropped() > 1000);
+			for (size_t i = 0; i < merged.size(); i++)
+			{
+				assert(merged[i].time == expected[i].time && fabs(merged[i].value - expected[i].value) < 1e-9);
+			}
+		}
+
+		// Re-encoding at a lower precision rounds the values the way the output is set up to
+		oscill::io::SingleTimeSeriesMerger coarse_merger;
+		assert(coarse_merger.AddInput(*merge_readers[1]));
+		oscill::io::SingleTimeSeriesWriteBuffer coarse_output(0, 6, 0.0, 300.0, 1 << 16);
+		size_t coarse_written = 0;
+		assert(coarse_merger.MergeInto(coarse_output, &coarse_written) && coarse_written == merge_values[1].size());
+		std::vector<oscill::io::SingleTimeSeriesValue> coarse_values = oscill::io::SingleTimeSeriesReadBuffer(coarse_output).ReadAll();
+		assert(coarse_values.size() == merge_values[1].size() && coarse_values[1].value == (double)(int)merge_values[1][1].value);
+	}
+
+	// A reorder window puts jittered samples back in order before they are encoded
+	{
+		// Every sample is up to 3 seconds late, one a second
+		std::mt19937 jitter_random(47);
+		std::uniform_int_distribution<int> jitter(0, 3);
+		std::vector<std::pair<uint64_t, oscill::io::SingleTimeSeriesValue>> delayed;
+		for (uint64_t i = 0; i < 20000; i++)
+		{
+			delayed.push_back({ i + jitter(jitter_random), { 1000000000ull * (i + 1), (double)(i % 50) } });
+		}
+		std::stable_sort(delayed.begin(), delayed.end(), [](const std::pair<uint64_t, oscill::io::SingleTimeSeriesValue> &a, const std::pair<uint64_t, oscill::io::SingleTimeSeriesValue> &b) { return a.first < b.first; });
+		std::vector<oscill::io::SingleTimeSeriesValue> arrivals;
+		for (auto &&arrival : delayed)
+		{
+			arrivals.push_back(arrival.second);
+		}
+
+		oscill::io::SingleTimeSeriesWriteBuffer unordered_buffer(1, 6, 0.0, 100.0, 1 << 18);
+		size_t values_added = 0;
+		assert(unordered_buffer.AddValues(arrivals, &values_added) && values_added == arrivals.size());
+
+		oscill::io::SingleTimeSeriesWriteBuffer ordered_buffer(1, 6, 0.0, 100.0, 1 << 18);
+		oscill::io::ReorderWindow window(&ordered_buffer, 5000000000ull, 0);
+		assert(window.AddValues(arrivals.data(), arrivals.size(), &values_added) && values_added == arrivals.size());
+		assert(window.HeldCount() > 0 && window.Flush() && window.HeldCount() == 0 && window.LateCount() == 0);
+		assert(ordered_buffer.BitPosition() < unordered_buffer.BitPosition());
+		std::vector<oscill::io::SingleTimeSeriesValue> reordered = oscill::io::SingleTimeSeriesReadBuffer(ordered_buffer).ReadAll();
+		assert(reordered.size() == arrivals.size());
+		for (size_t i = 0; i < reordered.size(); i++)
+		{
+			assert(reordered[i].time == 1000000000ull * (i + 1) && reordered[i].value == (double)(i % 50));
+		}
+
+		// A count limit instead, and what happens to samples that come too late
+		for (int policy = oscill::io::k_late_drop; policy <= oscill::io::k_late_write; policy++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer late_buffer(1, 6, 0.0, 100.0, 4096);
+			oscill::io::ReorderWindow late_window(&late_buffer, 0, 2, (oscill::io::LatePolicy)policy);
+			for (uint64_t t : { 10, 30, 20, 40, 50 })
+			{
+				assert(late_window.AddValue({ t * 1000000000ull, 1.0 }));
+			}
+			assert(late_window.HeldCount() == 2);
+			bool added = late_window.AddValue({ 5 * 1000000000ull, 2.0 });
+			assert(added == (policy != oscill::io::k_late_reject) && late_window.LateCount() == 1);
+			assert(late_window.Flush());
+			std::vector<oscill::io::SingleTimeSeriesValue> late_read = oscill::io::SingleTimeSeriesReadBuffer(late_buffer).ReadAll();
+			assert(late_read.size() == (policy == oscill::io::k_late_write ? 6u : 5u));
+			assert(late_read[1].time == 20 * 1000000000ull && late_read[2].time == 30 * 1000000000ull);
+		}
+
+		// Samples that don't fit stay held until there is a new output
+		oscill::io::SingleTimeSeriesWriteBuffer small_buffer(1, 6, 0.0, 100.0, 64);
+		oscill::io::ReorderWindow small_window(&small_buffer, 0, 1);
+		size_t small_added = 0;
+		assert(!small_window.AddValues(arrivals.data(), 1000, &small_added));
+		oscill::io::SingleTimeSeriesWriteBuffer next_buffer(1, 6, 0.0, 100.0, 1 << 16);
+		small_window.SetOutput(&next_buffer);
+		size_t more_added = 0;
+		assert(small_window.AddValues(arrivals.data() + small_added, 1000 - small_added, &more_added) && small_window.Flush());
+		size_t small_count = oscill::io::SingleTimeSeriesReadBuffer(small_buffer).ReadAll().size();
+		assert(small_count + oscill::io::SingleTimeSeriesReadBuffer(next_buffer).ReadAll().size() + small_window.LateCount() == 1000);
+	}
+
+	// Multiple series buffers can refer to a registered schema instead of writing it out
+	{
+		std::vector<oscill::io::ValueTypeDefinition> wide_schema;
+		for (int column = 0; column < 20; column++)
+		{
+			wide_schema.push_back({ "sensor_" + std::to_string(column), 1, -100.0, 100.0 });
+		}
+		oscill::io::SchemaRegistry registry;
+		std::vector<oscill::io::LabeledTimeSeriesValues> registry_rows;
+		for (uint64_t i = 0; i < 8; i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row{ 1000000000ull * (i + 1), {} };
+			for (int column = 0; column < 20; column++)
+			{
+				row.labeled_values.push_back({ wide_schema[column].label, (double)((int)(i * 3 + column) % 50) });
+			}
+			registry_rows.push_back(row);
+		}
+
+		for (int chunk = 0; chunk < 10; chunk++)
+		{
+			oscill::io::MultipleTimeSeriesWriteBuffer inline_buffer(3, wide_schema, 4096);
+			oscill::io::MultipleTimeSeriesWriteBuffer referenced_buffer(3, wide_schema, 4096);
+			assert(referenced_buffer.SetSchemaRegistry(registry));
+			int64_t estimated_bits = referenced_buffer.EstimateBits(registry_rows);
+			int64_t inline_estimated_bits = inline_buffer.EstimateBits(registry_rows);
+			size_t rows_added = 0;
+			assert(inline_buffer.AddValues(registry_rows, &rows_added) && rows_added == registry_rows.size());
+			assert(referenced_buffer.AddValues(registry_rows, &rows_added) && rows_added == registry_rows.size());
+			assert(estimated_bits == (int64_t)referenced_buffer.Size() * 8 - referenced_buffer.BitsAvailable());
+			assert(inline_estimated_bits == (int64_t)inline_buffer.Size() * 8 - inline_buffer.BitsAvailable());
+			assert(referenced_buffer.BitPosition() + 20 * 8 * 8 < inline_buffer.BitPosition());
+			size_t referenced_bits = referenced_buffer.Seal();
+
+			oscill::io::MultipleTimeSeriesReadBuffer referenced_read(referenced_buffer.RawData(), referenced_buffer.Size());
+			assert(referenced_read.LimitToBits(referenced_bits));
+			referenced_read.SetSchemaRegistry(&registry);
+			std::unique_ptr<oscill::io::MultipleTimeSeriesReadBuffer> cursor = referenced_read.NewCursor();
+			for (auto &&expected : registry_rows)
+			{
+				oscill::io::LabeledTimeSeriesValues row, cursor_row;
+				assert(referenced_read.ReadNext(&row) && cursor->ReadNext(&cursor_row));
+				assert(row.time == expected.time && row.labeled_values.size() == 20 && cursor_row.time == expected.time);
+				for (int column = 0; column < 20; column++)
+				{
+					assert(row.labeled_values[column].first == expected.labeled_values[column].first);
+					assert(row.labeled_values[column].second == expected.labeled_values[column].second);
+				}
+			}
+
+			// Without the registry there is nothing to read the values with
+			oscill::io::MultipleTimeSeriesReadBuffer unresolved_read(referenced_buffer.RawData(), referenced_buffer.Size());
+			oscill::io::LabeledTimeSeriesValues unresolved_row;
+			assert(!unresolved_read.ReadNext(&unresolved_row));
+		}
+		assert(registry.Count() == 1);
+
+		// The regular interval header follows the schema id the same as the definitions
+		std::vector<oscill::io::LabeledTimeSeriesValues> regular_registry_rows;
+		for (uint64_t i = 0; i < 50; i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row = registry_rows[i % registry_rows.size()];
+			row.time = 1000000000ull * (i + 1) + ((i % 9 == 8) ? 1000000ull : 0);
+			regular_registry_rows.push_back(row);
+		}
+		oscill::io::MultipleTimeSeriesWriteBuffer regular_referenced_buffer(3, wide_schema, 4096);
+		assert(regular_referenced_buffer.SetRegularInterval(1000000000ull));
+		assert(regular_referenced_buffer.SetSchemaRegistry(registry));
+		int64_t regular_estimated_bits = regular_referenced_buffer.EstimateBits(regular_registry_rows);
+		for (auto &&row : regular_registry_rows)
+		{
+			assert(regular_referenced_buffer.AddValue(row));
+		}
+		assert(regular_estimated_bits == (int64_t)regular_referenced_buffer.Size() * 8 - regular_referenced_buffer.BitsAvailable());
+		size_t regular_referenced_bits = regular_referenced_buffer.Seal();
+		oscill::io::MultipleTimeSeriesReadBuffer regular_referenced_read(regular_referenced_buffer.RawData(), regular_referenced_buffer.Size());
+		assert(regular_referenced_read.LimitToBits(regular_referenced_bits));
+		regular_referenced_read.SetSchemaRegistry(&registry);
+		for (auto &&expected : regular_registry_rows)
+		{
+			oscill::io::LabeledTimeSeriesValues row;
+			assert(regular_referenced_read.ReadNext(&row) && row.time == expected.time);
+			assert(row.labeled_values[19].second == expected.labeled_values[19].second);
+		}
+		assert(registry.Count() == 1);
+
+		uint32_t first_id = 0, second_id = 0;
+		assert(registry.Register(wide_schema, &first_id) && first_id == oscill::io::SchemaRegistry::SchemaId(wide_schema));
+		wide_schema[3].max = 101.0;
+		assert(registry.Register(wide_schema, &second_id) && second_id != first_id && registry.Count() == 2);
+		std::vector<oscill::io::ValueTypeDefinition> found_schema;
+		assert(registry.Find(second_id, &found_schema) && found_schema[3].max == 101.0);
+		assert(!registry.Find(second_id + 1, &found_schema));
+	}
+
+	// Sealed buffers can end with a CRC-32C that readers check
+	{
+		const char *check_input = "123456789";
+		for (int variant = oscill::io::k_kernel_scalar; variant <= (int)oscill::io::DetectKernelVariant(); variant++)
+		{
+			assert(oscill::io::ForceKernelVariant((oscill::io::KernelVariant)variant));
+			const oscill::io::Kernels &kernels = oscill::io::GetKernels();
+			assert(kernels.crc32c(0, (const uint8_t *)check_input, 9) == 0xE3069283);
+			uint32_t split = kernels.crc32c(kernels.crc32c(0, (const uint8_t *)check_input, 4), (const uint8_t *)check_input + 4, 5);
+			assert(split == 0xE3069283);
+			assert(kernels.crc32c(0, nullptr, 0) == 0);
+		}
+		assert(oscill::io::ForceKernelVariant(oscill::io::DetectKernelVariant()));
+
+		for (int entropy = 0; entropy < 2; entropy++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer checked_buffer(2, 3, -100.0, 100.0, 4096);
+			if (entropy == 0) assert(checked_buffer.SetRegularInterval(1000000000ull));
+			assert(checked_buffer.SetChecksum());
+			assert(!checked_buffer.SetConcurrentReads());
+			std::vector<oscill::io::SingleTimeSeriesValue> checked_values;
+			for (uint64_t i = 0; i < 300; i++)
+			{
+				// Every 50th sample is late, which makes an exception on the regular grid
+				uint64_t time = 1000000000ull * (i + 1) + ((i % 50 == 49) ? 1000000ull : 0);
+				checked_values.push_back({ time, (double)((int)(i * 7) % 40) - 20.0 });
+				assert(checked_buffer.AddValue(checked_values.back()));
+			}
+			assert(!checked_buffer.SetChecksum());
+			size_t checked_bits = (entropy == 0) ? checked_buffer.Seal() : checked_buffer.SealEntropyCoded();
+			assert(checked_bits + 32 <= checked_buffer.Size() * 8);
+
+			oscill::io::SingleTimeSeriesReadBuffer checked_read(2, 3, -100.0, 100.0, checked_buffer.RawData(), checked_buffer.Size());
+			assert(checked_read.LimitToBits(checked_bits));
+			checked_read.SetVerifyChecksum(true);
+			std::vector<oscill::io::SingleTimeSeriesValue> read_back = checked_read.ReadAll();
+			assert(read_back.size() == checked_values.size());
+			for (size_t i = 0; i < read_back.size(); i++)
+			{
+				assert(read_back[i].time == checked_values[i].time && read_back[i].value == checked_values[i].value);
+			}
+			assert(checked_read.VerifyChecksum());
+
+			// Any flipped bit is caught, and a checking reader reads nothing
+			std::vector<uint8_t> damaged((uint8_t *)checked_buffer.RawData(), (uint8_t *)checked_buffer.RawData() + checked_buffer.Size());
+			damaged[damaged.size() / 2] ^= 0x10;
+			oscill::io::SingleTimeSeriesReadBuffer damaged_read(2, 3, -100.0, 100.0, damaged.data(), damaged.size());
+			assert(!damaged_read.VerifyChecksum());
+			oscill::io::SingleTimeSeriesReadBuffer checking_read(2, 3, -100.0, 100.0, damaged.data(), damaged.size());
+			checking_read.SetVerifyChecksum(true);
+			assert(checking_read.ReadAll().empty());
+		}
+
+		// Buffers without one don't verify, but read as usual with checking on
+		oscill::io::SingleTimeSeriesWriteBuffer unchecked_buffer(2, 3, -100.0, 100.0, 256);
+		assert(unchecked_buffer.AddValue({ 1000000000ull, 1.0 }) && unchecked_buffer.AddValue({ 2000000000ull, 2.0 }));
+		size_t unchecked_bits = unchecked_buffer.Seal();
+		oscill::io::SingleTimeSeriesReadBuffer unchecked_read(2, 3, -100.0, 100.0, unchecked_buffer.RawData(), unchecked_buffer.Size());
+		assert(unchecked_read.LimitToBits(unchecked_bits));
+		unchecked_read.SetVerifyChecksum(true);
+		assert(unchecked_read.ReadAll().size() == 2);
+		assert(!unchecked_read.VerifyChecksum());
+
+		std::vector<oscill::io::ValueTypeDefinition> checked_schema = { { "pressure", 1, 0.0, 200.0 }, { "flow", 2, -50.0, 50.0 } };
+		oscill::io::MultipleTimeSeriesWriteBuffer checked_rows(3, checked_schema, 4096);
+		assert(checked_rows.SetRegularInterval(1000000000ull));
+		assert(checked_rows.SetChecksum());
+		for (uint64_t i = 0; i < 100; i++)
+		{
+			uint64_t time = 1000000000ull * (i + 1) + ((i % 25 == 24) ? 1000000ull : 0);
+			assert(checked_rows.AddValue({ time, { { "pressure", (double)(i % 90) }, { "flow", (double)(i % 20) - 10.0 } } }));
+		}
+		size_t checked_row_bits = checked_rows.Seal();
+		oscill::io::MultipleTimeSeriesReadBuffer checked_rows_read(checked_rows.RawData(), checked_rows.Size());
+		assert(checked_rows_read.LimitToBits(checked_row_bits));
+		checked_rows_read.SetVerifyChecksum(true);
+		for (uint64_t i = 0; i < 100; i++)
+		{
+			oscill::io::LabeledTimeSeriesValues row;
+			assert(checked_rows_read.ReadNext(&row));
+			assert(row.time == 1000000000ull * (i + 1) + ((i % 25 == 24) ? 1000000ull : 0));
+			assert(row.labeled_values[0].second == (double)(i % 90) && row.labeled_values[1].second == (double)(i % 20) - 10.0);
+		}
+		assert(checked_rows_read.VerifyChecksum());
+		std::vector<uint8_t> damaged_rows((uint8_t *)checked_rows.RawData(), (uint8_t *)checked_rows.RawData() + checked_rows.Size());
+		damaged_rows[damaged_rows.size() - 1] ^= 0x01;
+		oscill::io::MultipleTimeSeriesReadBuffer damaged_rows_read(damaged_rows.data(), damaged_rows.size());
+		damaged_rows_read.SetVerifyChecksum(true);
+		oscill::io::LabeledTimeSeriesValues damaged_row;
+		assert(!damaged_rows_read.ReadNext(&damaged_row));
+		assert(!damaged_rows_read.VerifyChecksum());
+	}
+
+	// Buffers can be decoded as they arrive, a few bytes at a time
+	{
+		for (int setup = 0; setup < 4; setup++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer streamed_buffer(2, 3, -1000.0, 1000.0, 16384);
+			if (setup == 1) assert(streamed_buffer.SetValueCodec(oscill::io::k_value_xor));
+			if (setup == 3)
+			{
+				assert(streamed_buffer.SetValueCodec(oscill::io::k_value_delta));
+				assert(streamed_buffer.SetChecksum());
+			}
+			for (uint64_t i = 0; i < 2000; i++)
+			{
+				uint64_t time = 1000000000ull * i + ((i % 13 == 0) ? 7000000ull : 0);
+				double value = (i % 5 == 0) ? 0.5 : (double)((int)(i * 37) % 900) - 450.0 + 0.25;
+				if (!streamed_buffer.AddValue({ time, value })) break;
+			}
+			size_t streamed_bits = (setup == 2) ? streamed_buffer.SealEntropyCoded() : streamed_buffer.Seal();
+
+			oscill::io::SingleTimeSeriesReadBuffer expected_read(2, 3, -1000.0, 1000.0, streamed_buffer.RawData(), streamed_buffer.Size());
+			assert(expected_read.LimitToBits(streamed_bits));
+			std::vector<oscill::io::SingleTimeSeriesValue> expected = expected_read.ReadAll();
+			assert(expected.size() > 500);
+
+			oscill::io::SingleTimeSeriesPushDecoder decoder(2, 3, -1000.0, 1000.0);
+			std::vector<oscill::io::SingleTimeSeriesValue> decoded;
+			const uint8_t *stream = (const uint8_t *)streamed_buffer.RawData();
+			size_t sent = 0;
+			while (sent < streamed_buffer.Size())
+			{
+				// Mostly small fragments, now and then a big one
+				size_t fragment = (rand() % 10 == 0) ? 300 + rand() % 200 : 1 + rand() % 20;
+				fragment = std::min(fragment, streamed_buffer.Size() - sent);
+				assert(decoder.Push(stream + sent, fragment, &decoded));
+				sent += fragment;
+				assert(decoder.BytesHeld() <= oscill::io::SingleTimeSeriesPushDecoder::k_splice_bytes);
+				assert(decoded.size() <= expected.size());
+			}
+			// Only what could still be padding is held back
+			assert(decoded.size() + 40 >= expected.size());
+			assert(decoder.Finish(streamed_bits, &decoded));
+			assert(!decoder.Push(stream, 1, &decoded));
+			assert(decoded.size() == expected.size() && decoder.PointCount() == expected.size());
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				assert(decoded[i].time == expected[i].time && decoded[i].value == expected[i].value);
+			}
+		}
+
+		// An empty buffer with a checksum has no header, its checksum isn't read as points
+		oscill::io::SingleTimeSeriesWriteBuffer empty_stream_buffer(2, 3, -1000.0, 1000.0, 1024);
+		assert(empty_stream_buffer.SetChecksum());
+		size_t empty_stream_bits = empty_stream_buffer.Seal();
+		assert(empty_stream_bits == 0);
+		for (size_t fragment = 1; fragment <= empty_stream_buffer.Size(); fragment++)
+		{
+			oscill::io::SingleTimeSeriesPushDecoder empty_decoder(2, 3, -1000.0, 1000.0);
+			std::vector<oscill::io::SingleTimeSeriesValue> empty_decoded;
+			const uint8_t *empty_stream = (const uint8_t *)empty_stream_buffer.RawData();
+			for (size_t sent = 0; sent < empty_stream_buffer.Size(); sent += fragment)
+			{
+				assert(empty_decoder.Push(empty_stream + sent, std::min(fragment, empty_stream_buffer.Size() - sent), &empty_decoded));
+			}
+			assert(empty_decoded.empty());
+			assert(empty_decoder.Finish(empty_stream_bits, &empty_decoded));
+			assert(empty_decoded.empty() && empty_decoder.PointCount() == 0);
+		}
+
+		// Formats that go back and rewrite bits can't be streamed
+		oscill::io::SingleTimeSeriesWriteBuffer regular_stream_buffer(2, 3, -1000.0, 1000.0, 1024);
+		assert(regular_stream_buffer.SetRegularInterval(1000000000ull));
+		assert(regular_stream_buffer.AddValue({ 1000000000ull, 1.0 }) && regular_stream_buffer.AddValue({ 2000000000ull, 2.0 }));
+		regular_stream_buffer.Seal();
+		oscill::io::SingleTimeSeriesPushDecoder regular_decoder(2, 3, -1000.0, 1000.0);
+		std::vector<oscill::io::SingleTimeSeriesValue> regular_decoded;
+		assert(!regular_decoder.Push(regular_stream_buffer.RawData(), regular_stream_buffer.Size(), &regular_decoded));
+		assert(regular_decoded.empty());
+	}
+
+	// Buffers whose storage can't be allocated are empty rather than pointing at nothing
+	{
+		struct FailingAllocator : public oscill::io::BufferAllocator
+		{
+			virtual uint8_t *Allocate(size_t, size_t *capacity) { *capacity = 0; return nullptr; }
+			virtual void Release(uint8_t *, size_t) {}
+		};
+		FailingAllocator failing_allocator;
+		oscill::io::SetDefaultBufferAllocator(&failing_allocator);
+		oscill::io::SingleTimeSeriesWriteBuffer failed_write(2, 3, 0.0, 100.0, 1024);
+		assert(failed_write.Size() == 0 && failed_write.BitsAvailable() == 0);
+		assert(!failed_write.AddValue({ 1000000000ull, 1.0 }));
+		uint8_t source[16] = { 0 };
+		oscill::io::SingleTimeSeriesReadBuffer failed_read(2, 3, 0.0, 100.0, source, sizeof(source));
+		assert(failed_read.Size() == 0 && failed_read.ReadAll().empty());
+		oscill::io::SetDefaultBufferAllocator(nullptr);
+	}
+
+	// An entropy coded seal that can't get new storage seals the plain encoding instead
+	{
+		struct FailingAllocator : public oscill::io::BufferAllocator
+		{
+			virtual uint8_t *Allocate(size_t, size_t *capacity) { *capacity = 0; return nullptr; }
+			virtual void Release(uint8_t *, size_t) {}
+		};
+		oscill::io::SingleTimeSeriesWriteBuffer fallback_buffer(2, 3, -1000.0, 1000.0, 16384);
+		oscill::io::SingleTimeSeriesWriteBuffer plain_buffer(2, 3, -1000.0, 1000.0, 16384);
+		for (uint64_t i = 0; i < 500; i++)
+		{
+			assert(fallback_buffer.AddValue({ 1000000000ull * i, (double)(i % 7) }));
+			assert(plain_buffer.AddValue({ 1000000000ull * i, (double)(i % 7) }));
+		}
+		size_t plain_bits = plain_buffer.Seal();
+		FailingAllocator failing_allocator;
+		oscill::io::SetDefaultBufferAllocator(&failing_allocator);
+		size_t fallback_bits = fallback_buffer.SealEntropyCoded();
+		oscill::io::SetDefaultBufferAllocator(nullptr);
+		assert(fallback_bits == plain_bits && fallback_buffer.IsSealed());
+		oscill::io::SingleTimeSeriesReadBuffer fallback_read(2, 3, -1000.0, 1000.0, fallback_buffer.RawData(), fallback_buffer.Size());
+		assert(fallback_read.LimitToBits(fallback_bits));
+		std::vector<oscill::io::SingleTimeSeriesValue> fallback_values = fallback_read.ReadAll();
+		assert(fallback_values.size() == 500);
+		for (uint64_t i = 0; i < 500; i++)
+		{
+			assert(fallback_values[i].time == 1000000000ull * i && fallback_values[i].value == (double)(i % 7));
+		}
+	}
+
+	// Sealing hands back the storage the samples didn't need, entropy coded or not
+	{
+		struct CountingAllocator : public oscill::io::BufferAllocator
+		{
+			size_t live = 0;
+			virtual uint8_t *Allocate(size_t size, size_t *capacity)
+			{
+				uint8_t *data = (uint8_t *)calloc(size > 0 ? size : 1, 1);
+				*capacity = data ? size : 0;
+				live += *capacity;
+				return data;
+			}
+			virtual void Release(uint8_t *data, size_t capacity) { live -= capacity; free(data); }
+		};
+		CountingAllocator counting_allocator;
+		oscill::io::SetDefaultBufferAllocator(&counting_allocator);
+		for (int entropy = 0; entropy < 2; entropy++)
+		{
+			oscill::io::SingleTimeSeriesWriteBuffer counted_buffer(2, 3, -1000.0, 1000.0, 65536);
+			assert(counting_allocator.live == 65536);
+			for (uint64_t i = 0; i < 2000; i++)
+			{
+				assert(counted_buffer.AddValue({ 1000000000ull * i, (double)((int)(i * 37) % 900) - 450.0 }));
+			}
+			size_t counted_bits = entropy ? counted_buffer.SealEntropyCoded() : counted_buffer.Seal();
+			assert(counted_bits > 0 && counted_buffer.Size() < 65536);
+			assert(counting_allocator.live == counted_buffer.Size());
+		}
+		assert(counting_allocator.live == 0);
+		oscill::io::SetDefaultBufferAllocator(nullptr);
+	}
+
+	// A store chunk that can't be set up isn't left behind as the head
+	{
+		oscill::io::StoreOptions tiny_options;
+		tiny_options.chunk_size = 3;
+		tiny_options.checksum = true;
+		oscill::io::TimeSeriesStore tiny_store(tiny_options);
+		assert(tiny_store.CreateSeries(1, { 2, 6, 0.0, 1000.0 }));
+		assert(!tiny_store.Append(1, { 1000000000ull, 1.0 }));
+		assert(tiny_store.ChunkCount(1) == 0 && tiny_store.MemoryUsed() == 0);
+	}
+
+	// A reorder window without either limit still only holds so much
+	{
+		oscill::io::SingleTimeSeriesWriteBuffer unbounded_buffer(2, 3, 0.0, 100.0, 1024 * 64);
+		oscill::io::ReorderWindow unbounded_window(&unbounded_buffer, 0, 0);
+		for (uint64_t i = 0; i < 3000; i++)
+		{
+			assert(unbounded_window.AddValue({ 1000000000ull * (i + 1), 1.0 }));
+			assert(unbounded_window.HeldCount() <= oscill::io::ReorderWindow::k_default_max_samples);
+		}
+		assert(unbounded_window.HeldCount() == oscill::io::ReorderWindow::k_default_max_samples);
+	}
 
 	return 0;
 }
\ No newline at end of file